@@ -0,0 +1,39 @@
+﻿#include <light/CirclesSimulation.h>
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+
+void addStepThreadsCounts(benchmark::internal::Benchmark* benchmark)
+{
+    const auto threadsCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; threads < threadsCount; threads *= 2)
+    {
+        benchmark->Arg(threads);
+    }
+    benchmark->Arg(threadsCount);
+}
+
+}
+
+// Steps of 1M circles covering about a tenth of the area, the argument is count of threads.
+void BM_CirclesSimulationStep(benchmark::State& state)
+{
+    light::CirclesSimulation simulation{
+        { 0, 0 }, { 1, 1 }, 1000 * 1000, 0.00018f, 0.05f, size_t(state.range(0)), 1
+    };
+
+    for (auto _ : state)
+    {
+        simulation.simulateStep(1 / 60.0f);
+    }
+}
+
+BENCHMARK(BM_CirclesSimulationStep)
+  ->Apply(addStepThreadsCounts)
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
@@ -48,3 +48,78 @@ void BM_VectorRW(benchmark::State& state)
 
 BENCHMARK(BM_VectorRW);
 BENCHMARK(BM_FastArrayRW);
+
+constexpr auto TRAVERSALS_COUNT = 10000;
+
+struct TraverseNode
+{
+    uint32_t node;
+    uint32_t depth;
+    float minDistance;
+};
+
+// Depth first walk of a complete quadtree of the depth taken by state.range(0), pruned to
+// about half of the children, with a new stack per walk as in every area query.
+template<typename TStack>
+void BM_TraversalStack(benchmark::State& state)
+{
+    const auto maxDepth = static_cast<uint32_t>(state.range(0));
+
+    for (auto _ : state)
+    {
+        uint32_t visited = 0;
+        for (uint32_t traversal = 0; traversal < TRAVERSALS_COUNT; ++traversal)
+        {
+            TStack quadsToCheck;
+            quadsToCheck.push_back({ 0, 0, 0 });
+            while (!quadsToCheck.empty())
+            {
+                TraverseNode quad;
+                if constexpr (requires { quadsToCheck.pop(); })
+                {
+                    quad = quadsToCheck.pop();
+                }
+                else
+                {
+                    quad = quadsToCheck.back();
+                    quadsToCheck.pop_back();
+                }
+                ++visited;
+
+                if (quad.depth == maxDepth)
+                {
+                    continue;
+                }
+                for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+                {
+                    const auto child = quad.node * 4 + quadrant + 1;
+                    if (((child + traversal) * 2654435761u) >> 31)
+                    {
+                        quadsToCheck.push_back({ child, quad.depth + 1, float(quadrant) });
+                    }
+                }
+            }
+        }
+        benchmark::DoNotOptimize(visited);
+    }
+}
+
+void BM_VectorTraversalStack(benchmark::State& state)
+{
+    BM_TraversalStack<std::vector<TraverseNode>>(state);
+}
+
+void BM_FastArrayTraversalStack(benchmark::State& state)
+{
+    BM_TraversalStack<light::FastArray<TraverseNode>>(state);
+}
+
+// Inline capacity below the stack depth, so every walk spills to the heap once.
+void BM_SmallFastArrayTraversalStack(benchmark::State& state)
+{
+    BM_TraversalStack<light::FastArray<TraverseNode, 8>>(state);
+}
+
+BENCHMARK(BM_VectorTraversalStack)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FastArrayTraversalStack)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SmallFastArrayTraversalStack)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond);
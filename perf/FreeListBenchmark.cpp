@@ -2,6 +2,9 @@
 
 #include <benchmark/benchmark.h>
 
+#include <cstdint>
+#include <random>
+
 const auto ELEMENTS_COUNT = 1000 * 1000;
 
 void FreeListElementsAddRemove()
@@ -13,3 +16,35 @@ void VectorElementsAddRemove()
 {
     //
 }
+
+// Pool of 10M slots with the argument percent of them live, erased slots are spread randomly.
+void BM_FreeListForEachLive(benchmark::State& state)
+{
+    constexpr uint32_t slotsCount = 10 * 1000 * 1000;
+    std::mt19937 rng{};
+    std::uniform_int_distribution<int> percentDist(0, 99);
+
+    light::FreeList<uint32_t> list;
+    list.reserve(slotsCount);
+    for (uint32_t i = 0; i < slotsCount; ++i)
+    {
+        list.push_back(i);
+    }
+    for (uint32_t i = 0; i < slotsCount; ++i)
+    {
+        if (percentDist(rng) >= state.range(0))
+        {
+            list.erase(i);
+        }
+    }
+
+    for (auto _ : state)
+    {
+        uint64_t sum = 0;
+        list.forEachLive([&sum](uint32_t, uint32_t value) { sum += value; });
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * int64_t(list.size()));
+}
+
+BENCHMARK(BM_FreeListForEachLive)->Arg(100)->Arg(50)->Arg(1)->Unit(benchmark::kMillisecond);
@@ -1,10 +1,283 @@
-﻿#include <light/Quadtree.h>
+﻿#include <light/LinearQuadtree.h>
+#include <light/LooseQuadtree.h>
+#include <light/PointQuadtree.h>
+#include <light/Quadtree.inl>
+#include <light/QuadtreeIO.h>
+#include <light/QuadtreeView.h>
+#include <light/ThreadPool.h>
 
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <filesystem>
+#include <limits>
 #include <random>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 constexpr auto POINTS_COUNT = 2 * 1000 * 1000;
+constexpr auto MOVING_RECTANGLE_HALF_SIZE = 0.0005f;
+constexpr auto MOVING_RECTANGLE_STEP = 0.0002f;
+constexpr auto QUERY_RECTANGLES_COUNT = 100 * 1000;
+constexpr auto QUERY_HALF_SIZE = 0.005f;
+constexpr size_t LEAF_SCAN_COUNT = 4096;
+constexpr auto NEAREST_ELEMENTS_COUNT = 100 * 1000;
+constexpr auto NEAREST_QUERIES_COUNT = 10 * 1000;
+constexpr auto NEAREST_START_HALF_SIZE = 0.002f;
+constexpr auto RAYCAST_QUERIES_COUNT = 10 * 1000;
+constexpr auto FIXED_POINT_SCALE = 1 << 20;
+
+namespace
+{
+
+struct MovingRectangles
+{
+    explicit MovingRectangles(size_t count)
+    {
+        std::mt19937 rng{};
+        std::uniform_real_distribution<float> positionDist(0.01f, 0.99f);
+        std::uniform_real_distribution<float> directionDist(-1, 1);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            positions.emplace_back(positionDist(rng), positionDist(rng));
+            velocities.push_back(
+              glm::normalize(light::Point(directionDist(rng), directionDist(rng))) *
+              MOVING_RECTANGLE_STEP);
+        }
+    }
+
+    void move()
+    {
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            auto& position = positions[i];
+            position += velocities[i];
+            if (position.x < 0.01f || position.x > 0.99f)
+            {
+                velocities[i].x = -velocities[i].x;
+            }
+            if (position.y < 0.01f || position.y > 0.99f)
+            {
+                velocities[i].y = -velocities[i].y;
+            }
+        }
+    }
+
+    light::Point bottomLeft(size_t i) const
+    {
+        return positions[i] - light::Point(MOVING_RECTANGLE_HALF_SIZE, MOVING_RECTANGLE_HALF_SIZE);
+    }
+
+    light::Point topRight(size_t i) const
+    {
+        return positions[i] + light::Point(MOVING_RECTANGLE_HALF_SIZE, MOVING_RECTANGLE_HALF_SIZE);
+    }
+
+    std::vector<light::Point> positions;
+    std::vector<light::Point> velocities;
+};
+
+// Represents a reference to QuadElement in the linked list of leaf elements.
+struct QuadElementNode
+{
+    // Points to the next QuadElementNode in the leaf node, NIL indicates the end of the list.
+    uint32_t next;
+
+    // Stores the index of the QuadElement.
+    uint32_t quadElementIndex;
+};
+
+// Quadtree with leaves storing singly linked lists of element references, the layout
+// Quadtree used before leaves got contiguous slots. Kept as a reference for benchmarks.
+class LinkedLeavesQuadtree
+{
+public:
+    LinkedLeavesQuadtree(light::Point areaBottomLeft,
+                         light::Point areaTopRight,
+                         uint32_t maxElementsPerNode = 8,
+                         uint32_t maxDepth = 8)
+      : m_areaBottomLeft{ areaBottomLeft }
+      , m_areaSize{ areaTopRight - areaBottomLeft }
+      , m_maxElementsPerNode{ maxElementsPerNode }
+      , m_maxDepth{ maxDepth }
+    {
+        m_quadNodes.push_back({ light::NIL, 0, 0 });
+    }
+
+    void insert(light::Point rectBottomLeft, light::Point rectTopRight, light::Id id)
+    {
+        const auto elementIndex = m_elements.push_back({ id, rectBottomLeft, rectTopRight });
+
+        FastArray<InsertData> elementsToInsert;
+        elementsToInsert.push_back({ elementIndex, 0, 0, m_areaBottomLeft, m_areaSize });
+
+        while (!elementsToInsert.empty())
+        {
+            const auto data = elementsToInsert.pop();
+            auto& quad = m_quadNodes[data.quadIndex];
+
+            if (quad.isLeaf())
+            {
+                if (quad.count < m_maxElementsPerNode || data.depth == m_maxDepth)
+                {
+                    quad.firstChild =
+                      m_elementNodes.push_back({ quad.firstChild, data.elementIndex });
+
+                    ++quad.count;
+                    continue;
+                }
+
+                for (auto nodeIndex = quad.firstChild; nodeIndex != light::NIL;)
+                {
+                    const auto node = m_elementNodes[nodeIndex];
+                    elementsToInsert.push_back({ node.quadElementIndex,
+                                                 data.quadIndex,
+                                                 data.depth,
+                                                 data.bottomLeft,
+                                                 data.size });
+                    m_elementNodes.erase(nodeIndex);
+                    nodeIndex = node.next;
+                }
+
+                const auto firstChild = static_cast<uint32_t>(m_quadNodes.size());
+                quad.firstChild = firstChild;
+                quad.count = light::NIL;
+                for (int i = 0; i < 4; ++i)
+                {
+                    m_quadNodes.push_back({ light::NIL, 0, 0 });
+                }
+            }
+
+            const auto firstChild = m_quadNodes[data.quadIndex].firstChild;
+            const auto& element = m_elements[data.elementIndex];
+            const auto subQuadSize = data.size * 0.5f;
+            const auto center = data.bottomLeft + subQuadSize;
+            const light::Point bottomLefts[4] = { data.bottomLeft + light::Point(0, subQuadSize.y),
+                                                  center,
+                                                  data.bottomLeft,
+                                                  data.bottomLeft +
+                                                    light::Point(subQuadSize.x, 0) };
+            const bool overlaps[4] = {
+                element.bottomLeft.x < center.x && element.topRight.y > center.y,
+                element.topRight.x > center.x && element.topRight.y > center.y,
+                element.bottomLeft.x < center.x && element.bottomLeft.y < center.y,
+                element.topRight.x > center.x && element.bottomLeft.y < center.y
+            };
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                if (overlaps[quadrant])
+                {
+                    elementsToInsert.push_back({ data.elementIndex,
+                                                 firstChild + quadrant,
+                                                 data.depth + 1,
+                                                 bottomLefts[quadrant],
+                                                 subQuadSize });
+                }
+            }
+        }
+    }
+
+    template<typename Callback>
+    void forEachObjectInArea(light::Point rectBottomLeft,
+                             light::Point rectTopRight,
+                             Callback&& callback) const
+    {
+        FastArray<TraverseData> quadsToCheck;
+        quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaSize });
+
+        while (!quadsToCheck.empty())
+        {
+            const auto data = quadsToCheck.pop();
+            const auto& quad = m_quadNodes[data.quadIndex];
+
+            if (quad.isLeaf())
+            {
+                for (auto nodeIndex = quad.firstChild; nodeIndex != light::NIL;)
+                {
+                    const auto& node = m_elementNodes[nodeIndex];
+                    const auto& element = m_elements[node.quadElementIndex];
+                    if (light::isRectanglesOverlap(
+                          rectBottomLeft, rectTopRight, element.bottomLeft, element.topRight))
+                    {
+                        callback(element.id, element.bottomLeft, element.topRight);
+                    }
+                    nodeIndex = node.next;
+                }
+                continue;
+            }
+
+            const auto subQuadSize = data.size * 0.5f;
+            const auto center = data.bottomLeft + subQuadSize;
+            if (rectBottomLeft.x < center.x && rectTopRight.y > center.y)
+            {
+                quadsToCheck.push_back({ quad.firstChild + 0,
+                                         data.bottomLeft + light::Point(0, subQuadSize.y),
+                                         subQuadSize });
+            }
+            if (rectTopRight.x > center.x && rectTopRight.y > center.y)
+            {
+                quadsToCheck.push_back({ quad.firstChild + 1, center, subQuadSize });
+            }
+            if (rectBottomLeft.x < center.x && rectBottomLeft.y < center.y)
+            {
+                quadsToCheck.push_back({ quad.firstChild + 2, data.bottomLeft, subQuadSize });
+            }
+            if (rectTopRight.x > center.x && rectBottomLeft.y < center.y)
+            {
+                quadsToCheck.push_back({ quad.firstChild + 3,
+                                         data.bottomLeft + light::Point(subQuadSize.x, 0),
+                                         subQuadSize });
+            }
+        }
+    }
+
+private:
+    template<typename T>
+    using FastArray = light::FastArray<T>;
+
+    struct InsertData
+    {
+        uint32_t elementIndex;
+        uint32_t quadIndex;
+        uint32_t depth;
+        light::Point bottomLeft;
+        light::Point size;
+    };
+
+    struct TraverseData
+    {
+        uint32_t quadIndex;
+        light::Point bottomLeft;
+        light::Point size;
+    };
+
+    light::FreeList<light::QuadElement> m_elements;
+    light::FreeList<QuadElementNode> m_elementNodes;
+    std::vector<light::QuadNode> m_quadNodes;
+
+    light::Point m_areaBottomLeft;
+    light::Point m_areaSize;
+    uint32_t m_maxElementsPerNode;
+    uint32_t m_maxDepth;
+};
+
+light::Quadtree buildQueryQuadtree(const MovingRectangles& rectangles)
+{
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    return quadtree;
+}
+
+}
 
 void BM_QuadtreePoints(benchmark::State& state)
 {
@@ -33,5 +306,1061 @@ void BM_VectorPoints(benchmark::State& state)
     }
 }
 
+void BM_QuadtreeInsert(benchmark::State& state)
+{
+    MovingRectangles rectangles(POINTS_COUNT);
+
+    for (auto _ : state)
+    {
+        light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        for (size_t i = 0; i < rectangles.positions.size(); ++i)
+        {
+            benchmark::DoNotOptimize(
+              quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i)));
+        }
+        benchmark::DoNotOptimize(quadtree.size());
+    }
+}
+
+// Points inserted as degenerate rectangles, compared to BM_PointQuadtreeInsert.
+void BM_QuadtreeInsertPoints(benchmark::State& state)
+{
+    MovingRectangles points(POINTS_COUNT);
+
+    for (auto _ : state)
+    {
+        light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        for (size_t i = 0; i < points.positions.size(); ++i)
+        {
+            benchmark::DoNotOptimize(
+              quadtree.insert(points.positions[i], points.positions[i], light::Id(i)));
+        }
+        benchmark::DoNotOptimize(quadtree.size());
+    }
+}
+
+void BM_PointQuadtreeInsert(benchmark::State& state)
+{
+    MovingRectangles points(POINTS_COUNT);
+
+    for (auto _ : state)
+    {
+        light::PointQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        for (size_t i = 0; i < points.positions.size(); ++i)
+        {
+            quadtree.insert(points.positions[i], light::Id(i));
+        }
+        benchmark::DoNotOptimize(quadtree.size());
+    }
+}
+
+void BM_QuadtreeBuild(benchmark::State& state)
+{
+    MovingRectangles rectangles(POINTS_COUNT);
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+
+    for (auto _ : state)
+    {
+        light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        quadtree.build(elements);
+        benchmark::DoNotOptimize(quadtree.size());
+        state.counters["bytes"] = double(quadtree.memoryUsage());
+    }
+}
+
+// Startup from the image saved by saveQuadtree: the file is mapped and one area is queried.
+void BM_QuadtreeViewOpen(benchmark::State& state)
+{
+    MovingRectangles rectangles(POINTS_COUNT);
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+    const auto path = std::filesystem::temp_directory_path() / "quadtree_benchmark.bin";
+    {
+        light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        quadtree.build(elements);
+        light::saveQuadtree(quadtree, path);
+    }
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        light::QuadtreeView view;
+        view.open(path);
+        std::vector<light::Id> ids;
+        view.findObjectsInArea(rectangles.positions[0] - halfSize,
+                               rectangles.positions[0] + halfSize,
+                               ids);
+        benchmark::DoNotOptimize(ids.data());
+    }
+    state.counters["bytes"] = double(std::filesystem::file_size(path));
+    std::filesystem::remove(path);
+}
+
+void BM_LinearQuadtreeBuild(benchmark::State& state)
+{
+    MovingRectangles rectangles(POINTS_COUNT);
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+
+    for (auto _ : state)
+    {
+        light::LinearQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        quadtree.build(elements);
+        benchmark::DoNotOptimize(quadtree.size());
+        state.counters["bytes"] = double(quadtree.memoryUsage());
+    }
+}
+
+// Queries around every element with the callback passed as std::function.
+void BM_QuadtreeBuildParallel(benchmark::State& state)
+{
+    MovingRectangles rectangles(POINTS_COUNT);
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+
+    light::ThreadPool pool{ size_t(state.range(0)) };
+    for (auto _ : state)
+    {
+        light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+        quadtree.build(elements, pool);
+        benchmark::DoNotOptimize(quadtree.size());
+    }
+}
+
+// Arguments of benchmarks running on thread pools: powers of two up to hardware concurrency.
+void addThreadsCounts(benchmark::internal::Benchmark* benchmark)
+{
+    const auto threadsCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threads = 1; threads < threadsCount; threads *= 2)
+    {
+        benchmark->Arg(threads);
+    }
+    benchmark->Arg(threadsCount);
+}
+
+void BM_QuadtreeQueryFunction(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto quadtree = buildQueryQuadtree(rectangles);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        const light::Quadtree::IterateObjectsCallback callback =
+          [&found](const light::Id&, light::Point, light::Point)
+        {
+            ++found;
+            return true;
+        };
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize, position + halfSize, callback);
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Same queries with the lambda inlined into the traversal.
+void BM_QuadtreeQueryLambda(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto quadtree = buildQueryQuadtree(rectangles);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+void BM_LooseQuadtreeQuery(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    light::LooseQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i));
+    }
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Points stored as degenerate rectangles, compared to BM_PointQuadtreeQuery.
+void BM_QuadtreeQueryPoints(benchmark::State& state)
+{
+    MovingRectangles points(QUERY_RECTANGLES_COUNT);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    for (size_t i = 0; i < points.positions.size(); ++i)
+    {
+        benchmark::DoNotOptimize(
+          quadtree.insert(points.positions[i], points.positions[i], light::Id(i)));
+    }
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : points.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+void BM_PointQuadtreeQuery(benchmark::State& state)
+{
+    MovingRectangles points(QUERY_RECTANGLES_COUNT);
+    light::PointQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    for (size_t i = 0; i < points.positions.size(); ++i)
+    {
+        quadtree.insert(points.positions[i], light::Id(i));
+    }
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : points.positions)
+        {
+            quadtree.forEachPointInArea(position - halfSize,
+                                        position + halfSize,
+                                        [&found](const light::Id&, light::Point)
+                                        {
+                                            ++found;
+                                            return true;
+                                        });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Same queries with statistics, reports how many leaf copies of elements were skipped.
+void BM_QuadtreeQueryStats(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto quadtree = buildQueryQuadtree(rectangles);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    light::QueryStats stats;
+    size_t found = 0;
+    for (auto _ : state)
+    {
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(
+              position - halfSize,
+              position + halfSize,
+              [&found](const light::Id&, light::Point, light::Point)
+              {
+                  ++found;
+                  return true;
+              },
+              &stats);
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.counters["found"] = benchmark::Counter(double(found), benchmark::Counter::kAvgIterations);
+    state.counters["suppressed"] =
+      benchmark::Counter(double(stats.suppressedDuplicates), benchmark::Counter::kAvgIterations);
+}
+
+// Same queries in one batch on the given count of threads.
+void BM_QuadtreeQueryBatch(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto quadtree = buildQueryQuadtree(rectangles);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    std::vector<light::AABB> areas;
+    for (const auto& position : rectangles.positions)
+    {
+        areas.push_back({ position - halfSize, position + halfSize });
+    }
+
+    light::ThreadPool pool{ size_t(state.range(0)) };
+    light::QueryBatchResults results;
+    for (auto _ : state)
+    {
+        quadtree.queryBatch(areas, results, pool);
+        benchmark::DoNotOptimize(results.ids.data());
+    }
+}
+
+void BM_QuadtreeQueryBuffer(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto quadtree = buildQueryQuadtree(rectangles);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+    std::vector<light::Id> ids;
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            ids.clear();
+            quadtree.findObjectsInArea(position - halfSize, position + halfSize, ids);
+            found += ids.size();
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Queries over leaves with linked lists of elements, both trees are filled by insert.
+void BM_QuadtreeQueryLinkedLeaves(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    LinkedLeavesQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i));
+    }
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         { ++found; });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Queries over leaves with contiguous slots.
+void BM_QuadtreeQueryLeafSlots(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        benchmark::DoNotOptimize(
+          quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i)));
+    }
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Same queries as BM_QuadtreeQueryLambda over the tree without nodes.
+// Same queries on the image of the tree mapped from a file.
+void BM_QuadtreeViewQuery(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto path = std::filesystem::temp_directory_path() / "quadtree_benchmark_query.bin";
+    light::saveQuadtree(buildQueryQuadtree(rectangles), path);
+    light::QuadtreeView view;
+    view.open(path);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            view.forEachObjectInArea(position - halfSize,
+                                     position + halfSize,
+                                     [&found](const light::Id&, light::Point, light::Point)
+                                     {
+                                         ++found;
+                                         return true;
+                                     });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    view.close();
+    std::filesystem::remove(path);
+}
+
+void BM_LinearQuadtreeQuery(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+    light::LinearQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Queries over trees with maxElementsPerNode specified by the argument.
+void BM_QuadtreeQueryLeafCapacity(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    std::vector<light::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back({ light::Id(i), rectangles.bottomLeft(i), rectangles.topRight(i) });
+    }
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 }, int(state.range(0)) };
+    quadtree.build(elements);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Queries over BasicQuadtree instantiation. Integer trees store coordinates in fixed point with
+// FIXED_POINT_SCALE units in the side of work area.
+template<typename QuadtreeType>
+void BM_BasicQuadtreeQuery(benchmark::State& state)
+{
+    using Point = typename QuadtreeType::Point;
+    using Scalar = typename Point::value_type;
+    constexpr float scale = std::is_floating_point_v<Scalar> ? 1.0f : float(FIXED_POINT_SCALE);
+    const auto toPoint = [](light::Point point) { return Point(point.x * scale, point.y * scale); };
+
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    std::vector<typename QuadtreeType::QuadElement> elements;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        elements.push_back(
+          { light::Id(i), toPoint(rectangles.bottomLeft(i)), toPoint(rectangles.topRight(i)) });
+    }
+    QuadtreeType quadtree{ { 0, 0 }, toPoint({ 1, 1 }) };
+    quadtree.build(elements);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (const auto& position : rectangles.positions)
+        {
+            quadtree.forEachObjectInArea(toPoint(position - halfSize),
+                                         toPoint(position + halfSize),
+                                         [&found](const light::Id&, Point, Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Scans bounds of LEAF_SCAN_COUNT elements with kernel returned by the argument.
+template<typename Kernel>
+void runLeafScan(benchmark::State& state, Kernel kernel)
+{
+    std::mt19937 rng{};
+    std::uniform_real_distribution<float> positionDist(0, 1);
+    std::vector<float> minX(LEAF_SCAN_COUNT);
+    std::vector<float> minY(LEAF_SCAN_COUNT);
+    std::vector<float> maxX(LEAF_SCAN_COUNT);
+    std::vector<float> maxY(LEAF_SCAN_COUNT);
+    for (size_t i = 0; i < LEAF_SCAN_COUNT; ++i)
+    {
+        minX[i] = positionDist(rng);
+        minY[i] = positionDist(rng);
+        maxX[i] = minX[i] + 0.01f;
+        maxY[i] = minY[i] + 0.01f;
+    }
+    const light::Point rectBottomLeft{ 0.25, 0.25 };
+    const light::Point rectTopRight{ 0.5, 0.5 };
+
+    for (auto _ : state)
+    {
+        uint32_t found = 0;
+        for (size_t i = 0; i < LEAF_SCAN_COUNT; i += light::LEAF_SCAN_WIDTH)
+        {
+            found += std::popcount(
+              kernel(&minX[i], &minY[i], &maxX[i], &maxY[i], rectBottomLeft, rectTopRight));
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * LEAF_SCAN_COUNT);
+}
+
+void BM_LeafScanScalar(benchmark::State& state)
+{
+    runLeafScan(state, light::getOverlapMaskScalar<float>);
+}
+
+// Kernel chosen at compile time.
+void BM_LeafScan(benchmark::State& state)
+{
+    runLeafScan(state, light::getOverlapMask);
+}
+
+// Collided pairs found with one area query per element, every pair is found twice.
+void BM_QuadtreePairsByQueries(benchmark::State& state)
+{
+    const MovingRectangles rectangles(state.range(0));
+    const auto quadtree = buildQueryQuadtree(rectangles);
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        for (size_t i = 0; i < rectangles.positions.size(); ++i)
+        {
+            quadtree.forEachObjectInArea(
+              rectangles.bottomLeft(i),
+              rectangles.topRight(i),
+              [&found, i](const light::Id& id, light::Point, light::Point)
+              {
+                  found += id != i;
+                  return true;
+              });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+void BM_QuadtreeOverlappingPairs(benchmark::State& state)
+{
+    const MovingRectangles rectangles(state.range(0));
+    const auto quadtree = buildQueryQuadtree(rectangles);
+
+    for (auto _ : state)
+    {
+        size_t found = 0;
+        quadtree.forEachOverlappingPair(
+          [&found](const light::Id&, const light::Id&)
+          {
+              ++found;
+              return true;
+          });
+        benchmark::DoNotOptimize(found);
+    }
+}
+
+// Elements of nearest search benchmarks, uniformly distributed or gathered in a few clusters.
+std::vector<light::QuadElement> generateNearestElements(bool isClustered)
+{
+    std::mt19937 rng{ 29 };
+    std::uniform_real_distribution<float> uniformDist(0.01f, 0.99f);
+    std::normal_distribution<float> clusterDist(0, 0.02f);
+    std::vector<light::Point> clusterCenters;
+    for (int i = 0; i < 16; ++i)
+    {
+        clusterCenters.emplace_back(uniformDist(rng), uniformDist(rng));
+    }
+
+    const light::Point halfSize{ MOVING_RECTANGLE_HALF_SIZE, MOVING_RECTANGLE_HALF_SIZE };
+    std::vector<light::QuadElement> elements;
+    for (light::Id id = 0; id < NEAREST_ELEMENTS_COUNT; ++id)
+    {
+        auto position = isClustered ? clusterCenters[id % clusterCenters.size()] +
+                                        light::Point(clusterDist(rng), clusterDist(rng))
+                                    : light::Point(uniformDist(rng), uniformDist(rng));
+        position = glm::clamp(position, light::Point(0.01f), light::Point(0.99f));
+        elements.push_back({ id, position - halfSize, position + halfSize });
+    }
+    return elements;
+}
+
+// Expanding box search used before nearest: box around the point is queried and doubled until
+// it contains k elements nearer than its half size.
+void findNearestByExpandingBox(const light::Quadtree& quadtree,
+                               light::Point point,
+                               size_t k,
+                               std::vector<std::pair<float, light::Id>>& found)
+{
+    float halfSize = NEAREST_START_HALF_SIZE;
+    while (true)
+    {
+        found.clear();
+        quadtree.forEachObjectInArea(
+          point - light::Point(halfSize),
+          point + light::Point(halfSize),
+          [&](const light::Id& id, light::Point bottomLeft, light::Point topRight)
+          {
+              const auto nearestPoint = glm::clamp(point, bottomLeft, topRight);
+              found.emplace_back(glm::length(point - nearestPoint), id);
+              return true;
+          });
+        if (found.size() >= k)
+        {
+            std::nth_element(found.begin(), found.begin() + (k - 1), found.end());
+            if (found[k - 1].first <= halfSize || halfSize > 1)
+            {
+                found.resize(k);
+                return;
+            }
+        }
+        halfSize *= 2;
+    }
+}
+
+void BM_QuadtreeNearestExpandingBox(benchmark::State& state)
+{
+    const auto elements = generateNearestElements(state.range(0) != 0);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    const MovingRectangles points(NEAREST_QUERIES_COUNT);
+    const auto k = static_cast<size_t>(state.range(1));
+
+    std::vector<std::pair<float, light::Id>> found;
+    for (auto _ : state)
+    {
+        for (const auto& point : points.positions)
+        {
+            findNearestByExpandingBox(quadtree, point, k, found);
+            benchmark::DoNotOptimize(found.data());
+        }
+    }
+}
+
+void BM_QuadtreeNearest(benchmark::State& state)
+{
+    const auto elements = generateNearestElements(state.range(0) != 0);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    const MovingRectangles points(NEAREST_QUERIES_COUNT);
+    const auto k = static_cast<size_t>(state.range(1));
+
+    std::vector<light::Id> ids;
+    for (auto _ : state)
+    {
+        for (const auto& point : points.positions)
+        {
+            ids.clear();
+            quadtree.nearest(point, k, ids);
+            benchmark::DoNotOptimize(ids.data());
+        }
+    }
+}
+
+// Area queries over uniform or clustered elements, the second argument enables node bounds.
+// Reports nodes visited per query.
+void BM_QuadtreeQueryNodeBounds(benchmark::State& state)
+{
+    const auto elements = generateNearestElements(state.range(0) != 0);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 8, 8, state.range(1) != 0 };
+    quadtree.build(elements);
+    const MovingRectangles areas(QUERY_RECTANGLES_COUNT);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+
+    light::QueryStats stats;
+    size_t found = 0;
+    for (auto _ : state)
+    {
+        for (const auto& position : areas.positions)
+        {
+            quadtree.forEachObjectInArea(
+              position - halfSize,
+              position + halfSize,
+              [&found](const light::Id&, light::Point, light::Point)
+              {
+                  ++found;
+                  return true;
+              },
+              &stats);
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    const auto queriesCount = double(areas.positions.size());
+    state.counters["nodes"] = benchmark::Counter(double(stats.nodesVisited) / queriesCount,
+                                                 benchmark::Counter::kAvgIterations);
+}
+
+// Circle queries as the bounding box query filtered by distance if the argument is 0, or as
+// the circle query pruning quads by the circle itself if it's 1. Reports nodes visited per query.
+void BM_QuadtreeQueryCircle(benchmark::State& state)
+{
+    MovingRectangles rectangles(QUERY_RECTANGLES_COUNT);
+    const auto quadtree = buildQueryQuadtree(rectangles);
+    constexpr auto radius = 8 * QUERY_HALF_SIZE;
+    const light::Point halfSize{ radius, radius };
+
+    light::QueryStats stats;
+    size_t found = 0;
+    for (auto _ : state)
+    {
+        for (const auto& center : rectangles.positions)
+        {
+            if (state.range(0) == 0)
+            {
+                quadtree.forEachObjectInArea(
+                  center - halfSize,
+                  center + halfSize,
+                  [&found, center](const light::Id&, light::Point bottomLeft, light::Point topRight)
+                  {
+                      const auto offset = glm::clamp(center, bottomLeft, topRight) - center;
+                      found += glm::dot(offset, offset) < radius * radius;
+                      return true;
+                  },
+                  &stats);
+            }
+            else
+            {
+                quadtree.forEachObjectInCircle(
+                  center,
+                  radius,
+                  [&found](const light::Id&, light::Point, light::Point)
+                  {
+                      ++found;
+                      return true;
+                  },
+                  &stats);
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    const auto queriesCount = double(rectangles.positions.size());
+    state.counters["nodes"] = benchmark::Counter(double(stats.nodesVisited) / queriesCount,
+                                                 benchmark::Counter::kAvgIterations);
+}
+
+// Queries on a tree churned by moves, removals and inserts, compacted if the argument is 1.
+void BM_QuadtreeQueryChurned(benchmark::State& state)
+{
+    MovingRectangles rectangles(POINTS_COUNT);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.reserve(rectangles.positions.size());
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        indices.push_back(
+          quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i)));
+    }
+    for (int step = 0; step < 20; ++step)
+    {
+        rectangles.move();
+        for (size_t i = 0; i < rectangles.positions.size(); ++i)
+        {
+            quadtree.update(indices[i], rectangles.bottomLeft(i), rectangles.topRight(i));
+        }
+        // every step a tenth of rectangles leaves and comes back
+        for (size_t i = step % 10; i < rectangles.positions.size(); i += 10)
+        {
+            quadtree.remove(indices[i]);
+        }
+        for (size_t i = step % 10; i < rectangles.positions.size(); i += 10)
+        {
+            indices[i] =
+              quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i));
+        }
+    }
+    if (state.range(0) != 0)
+    {
+        quadtree.compact();
+    }
+
+    const MovingRectangles areas(QUERY_RECTANGLES_COUNT);
+    const light::Point halfSize{ QUERY_HALF_SIZE, QUERY_HALF_SIZE };
+    size_t found = 0;
+    for (auto _ : state)
+    {
+        for (const auto& position : areas.positions)
+        {
+            quadtree.forEachObjectInArea(position - halfSize,
+                                         position + halfSize,
+                                         [&found](const light::Id&, light::Point, light::Point)
+                                         {
+                                             ++found;
+                                             return true;
+                                         });
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.counters["memory"] = double(quadtree.memoryUsage());
+}
+
+struct Ray
+{
+    light::Point origin;
+    light::Point direction;
+};
+
+// Rays starting inside work area in random directions.
+std::vector<Ray> generateRays()
+{
+    std::mt19937 rng{ 31 };
+    std::uniform_real_distribution<float> positionDist(0, 1);
+    std::uniform_real_distribution<float> angleDist(0, 6.2831853f);
+    std::vector<Ray> rays;
+    for (int i = 0; i < RAYCAST_QUERIES_COUNT; ++i)
+    {
+        const auto angle = angleDist(rng);
+        rays.push_back({ { positionDist(rng), positionDist(rng) },
+                         { std::cos(angle), std::sin(angle) } });
+    }
+    return rays;
+}
+
+// First hit found the way it was done before raycast: bounding box of the ray segment is
+// queried and every element in it is tested against the ray.
+void BM_QuadtreeRaycastByArea(benchmark::State& state)
+{
+    const auto elements = generateNearestElements(false);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    const auto rays = generateRays();
+    const auto maxT = static_cast<float>(state.range(0)) / 100;
+
+    for (auto _ : state)
+    {
+        for (const auto& [origin, direction] : rays)
+        {
+            const auto end = origin + direction * maxT;
+            auto firstT = std::numeric_limits<float>::infinity();
+            quadtree.forEachObjectInArea(
+              glm::min(origin, end),
+              glm::max(origin, end),
+              [&](const light::Id&, light::Point bottomLeft, light::Point topRight)
+              {
+                  const auto t1 = (bottomLeft - origin) / direction;
+                  const auto t2 = (topRight - origin) / direction;
+                  const auto tEnter =
+                    std::max({ std::min(t1.x, t2.x), std::min(t1.y, t2.y), 0.0f });
+                  const auto tExit =
+                    std::min({ std::max(t1.x, t2.x), std::max(t1.y, t2.y), maxT });
+                  if (tEnter <= tExit)
+                  {
+                      firstT = std::min(firstT, tEnter);
+                  }
+                  return true;
+              });
+            benchmark::DoNotOptimize(firstT);
+        }
+    }
+}
+
+void BM_QuadtreeRaycast(benchmark::State& state)
+{
+    const auto elements = generateNearestElements(false);
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    const auto rays = generateRays();
+    const auto maxT = static_cast<float>(state.range(0)) / 100;
+
+    for (auto _ : state)
+    {
+        for (const auto& [origin, direction] : rays)
+        {
+            auto firstT = std::numeric_limits<float>::infinity();
+            quadtree.raycast(origin,
+                             direction,
+                             maxT,
+                             [&firstT](const light::Id&, float t)
+                             {
+                                 firstT = t;
+                                 return false;
+                             });
+            benchmark::DoNotOptimize(firstT);
+        }
+    }
+}
+
+void BM_QuadtreeMoveRebuild(benchmark::State& state)
+{
+    MovingRectangles rectangles(state.range(0));
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+
+    for (auto _ : state)
+    {
+        rectangles.move();
+        quadtree.clear();
+        for (size_t i = 0; i < rectangles.positions.size(); ++i)
+        {
+            benchmark::DoNotOptimize(
+              quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i)));
+        }
+    }
+}
+
+void BM_QuadtreeMoveUpdate(benchmark::State& state)
+{
+    MovingRectangles rectangles(state.range(0));
+    light::Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        indices.push_back(
+          quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i)));
+    }
+
+    for (auto _ : state)
+    {
+        rectangles.move();
+        for (size_t i = 0; i < rectangles.positions.size(); ++i)
+        {
+            quadtree.update(indices[i], rectangles.bottomLeft(i), rectangles.topRight(i));
+        }
+    }
+}
+
+void BM_LooseQuadtreeMoveUpdate(benchmark::State& state)
+{
+    MovingRectangles rectangles(state.range(0));
+    light::LooseQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < rectangles.positions.size(); ++i)
+    {
+        indices.push_back(
+          quadtree.insert(rectangles.bottomLeft(i), rectangles.topRight(i), light::Id(i)));
+    }
+
+    for (auto _ : state)
+    {
+        rectangles.move();
+        for (size_t i = 0; i < rectangles.positions.size(); ++i)
+        {
+            quadtree.update(indices[i], rectangles.bottomLeft(i), rectangles.topRight(i));
+        }
+    }
+}
+
 BENCHMARK(BM_QuadtreePoints);
+BENCHMARK(BM_QuadtreeInsert)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeInsertPoints)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PointQuadtreeInsert)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeBuild)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeViewOpen)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LinearQuadtreeBuild)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeBuildParallel)
+  ->Apply(addThreadsCounts)
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_QuadtreeMoveRebuild)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeMoveUpdate)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LooseQuadtreeMoveUpdate)
+  ->Arg(100000)
+  ->Arg(1000000)
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_QuadtreeQueryFunction)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryLambda)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LooseQuadtreeQuery)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LinearQuadtreeQuery)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeViewQuery)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryPoints)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_PointQuadtreeQuery)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryStats)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryBuffer)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryBatch)
+  ->Apply(addThreadsCounts)
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryLinkedLeaves)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryLeafSlots)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryLeafCapacity)->Arg(8)->Arg(32)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BasicQuadtreeQuery, light::Quadtree)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BasicQuadtreeQuery, light::BasicQuadtree<float, 8, 8>)
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BasicQuadtreeQuery, light::BasicQuadtree<double>)
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BasicQuadtreeQuery, light::BasicQuadtree<int32_t, 8, 8>)
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_QuadtreePairsByQueries)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeOverlappingPairs)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMillisecond);
+
+// arguments are whether elements are clustered and k
+BENCHMARK(BM_QuadtreeNearestExpandingBox)
+  ->ArgsProduct({ { 0, 1 }, { 1, 16 } })
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeNearest)->ArgsProduct({ { 0, 1 }, { 1, 16 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeQueryNodeBounds)
+  ->ArgsProduct({ { 0, 1 }, { 0, 1 } })
+  ->Unit(benchmark::kMillisecond);
+// argument is whether the circle query is used instead of the bounding box one
+BENCHMARK(BM_QuadtreeQueryCircle)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+// argument is length of rays in hundredths of work area size
+BENCHMARK(BM_QuadtreeQueryChurned)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeRaycastByArea)->Arg(5)->Arg(100)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_QuadtreeRaycast)->Arg(5)->Arg(100)->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_LeafScanScalar);
+BENCHMARK(BM_LeafScan);
+
 BENCHMARK(BM_VectorPoints);
@@ -110,7 +110,7 @@ int main()
         sf::RectangleShape verticalLine({ quadBorderThickness, workAreaSize.y });
         verticalLine.setFillColor(sf::Color::Red);
 
-        simulation.getQuadtree().traverseQuads(
+        simulation.getQuadtree()->traverseQuads(
           [&](light::Point bottomLeft, light::Point size)
           {
               horizontalLine.setSize(
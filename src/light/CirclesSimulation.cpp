@@ -1,5 +1,7 @@
 ﻿#include "CirclesSimulation.h"
 
+#include <algorithm>
+#include <numeric>
 #include <random>
 #include <stdexcept>
 
@@ -44,19 +46,23 @@ CirclesSimulation::CirclesSimulation(const Point& bottomLeft,
                                      const Point& topRight,
                                      size_t circlesCount,
                                      float circleRadius,
-                                     float speed)
+                                     float speed,
+                                     size_t threadsCount,
+                                     std::optional<uint32_t> seed)
   : m_bottomLeft{ bottomLeft }
   , m_topRight{ topRight }
   , m_radius{ circleRadius }
-  , m_quadtree{ bottomLeft, topRight }
+  , m_quadtrees{ bottomLeft, topRight }
+  , m_pool{ threadsCount }
 {
-    std::random_device rd;
-    std::mt19937 mt{ rd() };
+    std::mt19937 mt{ seed ? *seed : std::random_device{}() };
     std::uniform_real_distribution<float> positionDist(2 * m_radius, 1.0f - 2 * m_radius);
     std::uniform_real_distribution<float> directionDist(-1, 1);
 
+    // placement queries run on the back buffer, nothing is published until the first step
+    auto& quadtree = m_quadtrees.back();
     m_circles.reserve(circlesCount);
-    m_quadtree.reserve(circlesCount);
+    quadtree.reserve(circlesCount);
 
     for (size_t i = 0; i < circlesCount; ++i)
     {
@@ -75,12 +81,10 @@ CirclesSimulation::CirclesSimulation(const Point& bottomLeft,
 
             isOverlaps = false;
 
-            const auto [circleBottomLeft, circleTopRight] =
-              getCircleCorners(circleCenter, m_radius);
-
-            m_quadtree.forEachObjectInArea(
-              circleBottomLeft,
-              circleTopRight,
+            // circles closer than a diameter have boxes closer than a radius to the center
+            quadtree.forEachObjectInCircle(
+              circleCenter,
+              m_radius,
               [&](const Id& id, const auto _, const auto)
               {
                   const auto& existingCircle = m_circles[id];
@@ -94,8 +98,13 @@ CirclesSimulation::CirclesSimulation(const Point& bottomLeft,
 
             if (!isOverlaps)
             {
+                const auto [circleBottomLeft, circleTopRight] =
+                  getCircleCorners(circleCenter, m_radius);
                 m_circles.push_back(CircleData{ speed, circleCenter, direction });
-                m_quadtree.insert(circleBottomLeft, circleTopRight, Id(i));
+                [[maybe_unused]] const auto index =
+                  quadtree.insert(circleBottomLeft, circleTopRight, Id(i));
+                // circles lie inside the work area, so they are always stored
+                assert(index != NIL);
             }
         }
 
@@ -109,7 +118,7 @@ CirclesSimulation::CirclesSimulation(const Point& bottomLeft,
     /*m_circles.push_back(CircleData{ speed, { 0.2, 0.5 }, { 1, 0 } });
     m_circles.push_back(CircleData{ speed, { 0.6, 0.5 }, { -1, 0 } });    */
 
-    m_quadtree.clear();
+    quadtree.clear();
 }
 
 size_t CirclesSimulation::size() const
@@ -119,98 +128,173 @@ size_t CirclesSimulation::size() const
 
 void CirclesSimulation::simulateStep(float timeDelta)
 {
-    // update circles position and build quadtree
-    const Point circleRectHalfSize{ m_radius, m_radius };
-
-    m_quadtree.clear();
-    assert(m_quadtree.size() == 0);
+    integrate(timeDelta);
+    findCandidatePairs();
+    findCollisions();
+    collectContacts();
+    resolveContacts();
+}
 
-    for (size_t i = 0; i < size(); ++i)
-    {
-        auto& currentCircle = m_circles[i];
-        currentCircle.position += currentCircle.movementDirection * timeDelta * currentCircle.speed;
+void CirclesSimulation::integrate(float timeDelta)
+{
+    m_circleElements.resize(size());
+    m_pool.parallelFor(
+      size(),
+      [&](size_t begin, size_t end)
+      {
+          for (auto i = begin; i < end; ++i)
+          {
+              auto& circle = m_circles[i];
+              circle.position += circle.movementDirection * timeDelta * circle.speed;
+
+              const auto [circleBottomLeft, circleTopRight] =
+                getCircleCorners(circle.position, m_radius);
+              m_circleElements[i] = QuadElement{ Id(i), circleBottomLeft, circleTopRight };
+          }
+      });
+}
 
-        const auto [circleBottomLeft, circleTopRight] =
-          getCircleCorners(currentCircle.position, m_radius);
-        m_quadtree.insert(circleBottomLeft, circleTopRight, Id(i));
-    }
+void CirclesSimulation::findCandidatePairs()
+{
+    // readers of the previous step keep it, the new one is published as soon as it's built
+    auto& quadtree = m_quadtrees.back();
+    quadtree.build(m_circleElements, m_pool);
+    m_quadtrees.publish();
+
+    // the tree is walked once, which is much faster than a query per circle. pairs come in the
+    // order of the tree layout, later stages don't depend on it
+    m_candidatePairs.clear();
+    quadtree.forEachOverlappingPair(
+      [&](const Id& id1, const Id& id2)
+      {
+          m_candidatePairs.push_back({ std::min(id1, id2), std::max(id1, id2), false, {} });
+          return true;
+      });
+}
 
-    // check for collision and update movement direction
-    for (size_t i = 0; i < size(); ++i)
-    {
-        auto& circle1 = m_circles[i];
-        m_quadtree.forEachObjectInArea(
-          circle1.position - circleRectHalfSize,
-          circle1.position + circleRectHalfSize,
-          [&](const Id& id, const auto, const auto)
+void CirclesSimulation::findCollisions()
+{
+    m_pool.parallelFor(
+      m_candidatePairs.size(),
+      [&](size_t begin, size_t end)
+      {
+          for (auto i = begin; i < end; ++i)
           {
-              if (i == id)
+              auto& pair = m_candidatePairs[i];
+              const auto& circle1 = m_circles[pair.id1];
+              const auto& circle2 = m_circles[pair.id2];
+
+              // circles are considered as collided
+              pair.isCollided =
+                isCollided(circle1.position, m_radius, circle2.position, m_radius);
+              if (pair.isCollided)
               {
-                  return true;
+                  pair.normal = glm::normalize(circle2.position - circle1.position);
               }
+          }
+      });
+}
 
-              auto& circle2 = m_circles[id];
+void CirclesSimulation::collectContacts()
+{
+    // counting sort of contacts by circles, offsets hold ends of contacts of every circle after
+    // the prefix sum and their beginnings after contacts are put before them
+    m_contactOffsets.assign(size() + 1, 0);
+    for (const auto& pair : m_candidatePairs)
+    {
+        if (pair.isCollided)
+        {
+            ++m_contactOffsets[pair.id1];
+            ++m_contactOffsets[pair.id2];
+        }
+    }
+    std::partial_sum(m_contactOffsets.begin(), m_contactOffsets.end(), m_contactOffsets.begin());
 
-              // if collision is considered - resolve it
+    m_contacts.resize(m_contactOffsets.back());
+    for (const auto& pair : m_candidatePairs)
+    {
+        if (pair.isCollided)
+        {
+            m_contacts[--m_contactOffsets[pair.id1]] = { pair.id2, pair.normal };
+            m_contacts[--m_contactOffsets[pair.id2]] = { pair.id1, -pair.normal };
+        }
+    }
 
-              // circles are considered as collided
-              if (isCollided(circle1.position, m_radius, circle2.position, m_radius))
-              {
-                  // todo add masses/speed handling
+    // contacts of every circle are resolved in the order of Ids, not of the tree layout
+    m_pool.parallelFor(
+      size(),
+      [&](size_t begin, size_t end)
+      {
+          for (auto i = begin; i < end; ++i)
+          {
+              std::sort(m_contacts.begin() + m_contactOffsets[i],
+                        m_contacts.begin() + m_contactOffsets[i + 1],
+                        [](const Contact& contact1, const Contact& contact2)
+                        { return contact1.id < contact2.id; });
+          }
+      });
+}
 
-                  const Vector2d normal{ glm::normalize(circle2.position - circle1.position) };
-                  const Vector2d firstToSecond{ glm::normalize(circle2.position -
-                                                               circle1.position) };
+void CirclesSimulation::resolveContacts()
+{
+    m_pool.parallelFor(
+      size(),
+      [&](size_t begin, size_t end)
+      {
+          for (auto i = begin; i < end; ++i)
+          {
+              auto& circle1 = m_circles[i];
 
-                  const auto cosAngle1 = glm::dot(firstToSecond, circle1.movementDirection);
-                  if (cosAngle1 > 0)
-                  {
-                      const auto reflectedDir1 = reflect(normal, circle1.movementDirection);
-                      circle1.movementDirection = glm::normalize(reflectedDir1);
-                  }
+              // todo add masses/speed handling
 
-                  const auto cosAngle2 = glm::dot(-firstToSecond, circle2.movementDirection);
-                  if (cosAngle2 > 0)
+              // the circle is reflected if it moves towards the collided one. reflection doesn't
+              // depend on the sign of the normal, so both circles of a pair get the same one
+              for (auto contact = m_contactOffsets[i]; contact < m_contactOffsets[i + 1];
+                   ++contact)
+              {
+                  const auto& normal = m_contacts[contact].normal;
+                  if (glm::dot(normal, circle1.movementDirection) > 0)
                   {
-                      const auto reflectedDir2 = reflect(normal, circle2.movementDirection);
-                      circle2.movementDirection = glm::normalize(reflectedDir2);
+                      circle1.movementDirection =
+                        glm::normalize(reflect(normal, circle1.movementDirection));
                   }
               }
 
-              return true;
-          });
-
-        // box sides collision handling:
+              // box sides collision handling:
 
-        // left side
-        if (circle1.position.x - m_radius < m_bottomLeft.x)
-        {
-            circle1.position.x = m_bottomLeft.x + m_radius;
-            circle1.movementDirection = reflect(BoxLeftSideNormal, circle1.movementDirection);
-        }
+              // left side
+              if (circle1.position.x - m_radius < m_bottomLeft.x)
+              {
+                  circle1.position.x = m_bottomLeft.x + m_radius;
+                  circle1.movementDirection =
+                    reflect(BoxLeftSideNormal, circle1.movementDirection);
+              }
 
-        // bottom side
-        if (circle1.position.y - m_radius < m_bottomLeft.y)
-        {
-            circle1.position.y = m_bottomLeft.y + m_radius;
-            circle1.movementDirection = reflect(BoxBottomSideNormal, circle1.movementDirection);
-        }
+              // bottom side
+              if (circle1.position.y - m_radius < m_bottomLeft.y)
+              {
+                  circle1.position.y = m_bottomLeft.y + m_radius;
+                  circle1.movementDirection =
+                    reflect(BoxBottomSideNormal, circle1.movementDirection);
+              }
 
-        // right side
-        /* && glm::dot(circle1.movementDirection, BoxRightSideNormal) < 0 */
-        if (circle1.position.x + m_radius > m_topRight.x)
-        {
-            circle1.position.x = m_topRight.x - m_radius;
-            circle1.movementDirection = reflect(BoxRightSideNormal, circle1.movementDirection);
-        }
+              // right side
+              if (circle1.position.x + m_radius > m_topRight.x)
+              {
+                  circle1.position.x = m_topRight.x - m_radius;
+                  circle1.movementDirection =
+                    reflect(BoxRightSideNormal, circle1.movementDirection);
+              }
 
-        // top side
-        if (circle1.position.y + m_radius > m_topRight.y)
-        {
-            circle1.position.y = m_topRight.y - m_radius;
-            circle1.movementDirection = reflect(BoxTopSideNormal, circle1.movementDirection);
-        }
-    }
+              // top side
+              if (circle1.position.y + m_radius > m_topRight.y)
+              {
+                  circle1.position.y = m_topRight.y - m_radius;
+                  circle1.movementDirection =
+                    reflect(BoxTopSideNormal, circle1.movementDirection);
+              }
+          }
+      });
 }
 
 void CirclesSimulation::forEachCircle(const IterateCirclesCallback& callback)
@@ -221,9 +305,9 @@ void CirclesSimulation::forEachCircle(const IterateCirclesCallback& callback)
     }
 }
 
-const Quadtree& CirclesSimulation::getQuadtree() const
+std::shared_ptr<const Quadtree> CirclesSimulation::getQuadtree() const
 {
-    return m_quadtree;
+    return m_quadtrees.acquire();
 }
 
 }
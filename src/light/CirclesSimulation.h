@@ -1,8 +1,13 @@
 ﻿#pragma once
 
 #include <light/Quadtree.h>
+#include <light/QuadtreeSnapshots.h>
+#include <light/ThreadPool.h>
 
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
@@ -24,16 +29,30 @@ struct CircleData
 class CirclesSimulation
 {
 public:
+    /**
+     * @brief Places circles randomly without overlaps.
+     * @param threadsCount Count of threads running simulation steps, 0 means hardware
+     * concurrency. Results of steps don't depend on it.
+     * @param seed Seed of the placement. Steps are deterministic, so simulations with the same
+     * seed replay the same way. Random if not set.
+     */
     CirclesSimulation(const Point& bottomLeft,
                       const Point& topRight,
                       size_t circlesCount,
                       float circleRadius,
-                      float speed);
+                      float speed,
+                      size_t threadsCount = 0,
+                      std::optional<uint32_t> seed = std::nullopt);
 
     size_t size() const;
 
     /**
-     * @brief Simulate a simulation step with updating all circles positions.
+     * @brief Simulate a simulation step with updating all circles positions. The step runs in
+     * stages: integrate moves circles, broad phase rebuilds the quadtree and collects pairs of
+     * circles with overlapping boxes, narrow phase tests the pairs for collisions and resolve
+     * reflects movement direction of every circle from circles collided with it in the order of
+     * Ids, then from box sides. Stages run in parallel and write data of their own circles or
+     * pairs only, so results are bit-identical for any count of threads.
      * @param timeDelta Time delta in seconds passed since previous simulation step.
      */
     void simulateStep(float timeDelta);
@@ -43,13 +62,58 @@ public:
 
     void forEachCircle(const IterateCirclesCallback& callback);
 
-    const Quadtree& getQuadtree() const;
+    /**
+     * @brief Returns the quadtree of the last simulation step. It isn't modified by next steps,
+     * so it can be queried from any thread while they run.
+     */
+    std::shared_ptr<const Quadtree> getQuadtree() const;
 
 private:
+    // Pair of circles with overlapping boxes.
+    struct CandidatePair
+    {
+        Id id1;
+        Id id2;
+        bool isCollided;
+        // Direction from the first circle to the second one, set for collided pairs.
+        Vector2d normal;
+    };
+
+    // Circle collided with the circle the contact belongs to.
+    struct Contact
+    {
+        Id id;
+        // Direction from the circle the contact belongs to to the collided one.
+        Vector2d normal;
+    };
+
+    // Moves circles and updates their quadtree elements.
+    void integrate(float timeDelta);
+
+    // Rebuilds and publishes the quadtree, collects pairs of circles with overlapping boxes.
+    void findCandidatePairs();
+
+    // Tests candidate pairs for collisions.
+    void findCollisions();
+
+    // Distributes collided pairs to contacts of both circles, sorted by Ids for every circle.
+    void collectContacts();
+
+    // Reflects movement directions from contacts, then from box sides.
+    void resolveContacts();
+
     Point m_bottomLeft;
     Point m_topRight;
     float m_radius;
-    Quadtree m_quadtree;
+    // Quadtree is rebuilt in the back buffer and published every step.
+    QuadtreeSnapshots<Quadtree> m_quadtrees;
     std::vector<CircleData> m_circles;
+    // Quadtree elements of the circles, quadtree is rebuilt from them every step.
+    std::vector<QuadElement> m_circleElements;
+    std::vector<CandidatePair> m_candidatePairs;
+    // Contacts of every circle i are in [m_contactOffsets[i], m_contactOffsets[i + 1]).
+    std::vector<uint32_t> m_contactOffsets;
+    std::vector<Contact> m_contacts;
+    ThreadPool m_pool;
 };
 }
@@ -1,22 +1,45 @@
 ﻿#pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <vector>
+#include <memory>
+#include <new>
+#include <utility>
 
 namespace light
 {
 constexpr auto STACK_ELEMENTS_COUNT = 128;
 
 /// <summary>
-/// Provides an indexed vector with small stack allocation base.
-///  T must be trivially constructible and destructible.
+/// Provides an indexed vector with small stack allocation base of StackCapacity elements.
+///  Inline storage is left uninitialized until elements are added. Once it's exceeded, all
+///  elements are moved to a single heap block, so elements are always contiguous and indexing
+///  doesn't branch. The heap block is kept until destruction, clear() keeps capacity.
 /// </summary>
-template<typename T>
+template<typename T, uint32_t StackCapacity = STACK_ELEMENTS_COUNT>
 class FastArray
 {
 public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
     FastArray();
 
+    FastArray(const FastArray& other);
+
+    /// <summary>
+    /// Takes the heap block of other, or moves its inline elements one by one.
+    /// Other is left empty.
+    /// </summary>
+    FastArray(FastArray&& other) noexcept;
+
+    FastArray& operator=(const FastArray& other);
+
+    FastArray& operator=(FastArray&& other) noexcept;
+
+    ~FastArray();
+
     T& operator[](uint32_t index);
 
     const T& operator[](uint32_t index) const;
@@ -25,89 +48,285 @@ public:
 
     size_t size() const;
 
+    /// <summary>
+    /// Count of elements that fit without reallocation, at least StackCapacity.
+    /// </summary>
+    size_t capacity() const;
+
     void push_back(const T& value);
 
+    void push_back(T&& value);
+
+    /// <summary>
+    /// Constructs an element in place at the end and returns it.
+    /// </summary>
+    template<typename... Args>
+    T& emplace_back(Args&&... args);
+
+    /// <summary>
+    /// Removes the last element and returns it moved out.
+    /// </summary>
     T pop();
 
-    T peek() const;
+    const T& peek() const;
+
+    /// <summary>
+    /// Destroys all elements, storage is kept for reuse.
+    /// </summary>
+    void clear();
+
+    T* data();
+
+    const T* data() const;
+
+    iterator begin();
+
+    iterator end();
+
+    const_iterator begin() const;
+
+    const_iterator end() const;
 
 private:
-    uint32_t m_stackDataSize;
-    T m_stackData[STACK_ELEMENTS_COUNT];
-    std::vector<T> m_heapData;
+    T* getStackData();
+
+    // Moves elements to a heap block of twice the capacity and appends the value. The value is
+    // a copy made before growing, since arguments of emplace_back may refer to elements, and
+    // small values passed by value stay in registers instead of being spilled for the call.
+    T& growAndPushBack(T value);
+
+    // Destroys elements and releases the heap block, the array becomes empty and inline.
+    void reset();
+
+    // Moves elements of other, which must be empty and inline, taking its heap block if any.
+    void moveFrom(FastArray& other) noexcept;
+
+    // Bounds are kept as pointers, unlike counts they can't alias stores to elements, so they
+    // stay in registers in loops pushing and popping elements.
+    T* m_data;
+    T* m_end;
+    T* m_capacityEnd;
+    alignas(T) std::byte m_stackData[StackCapacity * sizeof(T)];
 };
 
-template<typename T>
-FastArray<T>::FastArray()
-  : m_stackDataSize{ 0 }
+template<typename T, uint32_t StackCapacity>
+FastArray<T, StackCapacity>::FastArray()
+  : m_data{ getStackData() }
+  , m_end{ m_data }
+  , m_capacityEnd{ m_data + StackCapacity }
 {
 }
 
-template<typename T>
-T& FastArray<T>::operator[](uint32_t index)
+template<typename T, uint32_t StackCapacity>
+FastArray<T, StackCapacity>::FastArray(const FastArray& other)
+  : FastArray()
 {
-    if (index >= STACK_ELEMENTS_COUNT)
+    *this = other;
+}
+
+template<typename T, uint32_t StackCapacity>
+FastArray<T, StackCapacity>::FastArray(FastArray&& other) noexcept
+  : FastArray()
+{
+    moveFrom(other);
+}
+
+template<typename T, uint32_t StackCapacity>
+FastArray<T, StackCapacity>& FastArray<T, StackCapacity>::operator=(const FastArray& other)
+{
+    if (this != &other)
     {
-        return m_heapData[index - STACK_ELEMENTS_COUNT];
+        clear();
+        for (const auto& value : other)
+        {
+            push_back(value);
+        }
     }
-    else
+    return *this;
+}
+
+template<typename T, uint32_t StackCapacity>
+FastArray<T, StackCapacity>& FastArray<T, StackCapacity>::operator=(FastArray&& other) noexcept
+{
+    if (this != &other)
     {
-        return m_stackData[index];
+        reset();
+        moveFrom(other);
     }
+    return *this;
 }
 
-template<typename T>
-const T& FastArray<T>::operator[](uint32_t index) const
+template<typename T, uint32_t StackCapacity>
+FastArray<T, StackCapacity>::~FastArray()
 {
-    return const_cast<FastArray*>(this)->operator[](index);
+    reset();
 }
 
-template<typename T>
-bool FastArray<T>::empty() const
+template<typename T, uint32_t StackCapacity>
+T& FastArray<T, StackCapacity>::operator[](uint32_t index)
 {
-    return size() == 0;
+    return m_data[index];
 }
 
-template<typename T>
-size_t FastArray<T>::size() const
+template<typename T, uint32_t StackCapacity>
+const T& FastArray<T, StackCapacity>::operator[](uint32_t index) const
 {
-    return m_stackDataSize + m_heapData.size();
+    return m_data[index];
 }
 
-template<typename T>
-void FastArray<T>::push_back(const T& value)
+template<typename T, uint32_t StackCapacity>
+bool FastArray<T, StackCapacity>::empty() const
 {
-    if (m_stackDataSize == STACK_ELEMENTS_COUNT)
-    {
-        m_heapData.push_back(value);
-    }
-    else
+    return m_end == m_data;
+}
+
+template<typename T, uint32_t StackCapacity>
+size_t FastArray<T, StackCapacity>::size() const
+{
+    return static_cast<size_t>(m_end - m_data);
+}
+
+template<typename T, uint32_t StackCapacity>
+size_t FastArray<T, StackCapacity>::capacity() const
+{
+    return static_cast<size_t>(m_capacityEnd - m_data);
+}
+
+template<typename T, uint32_t StackCapacity>
+void FastArray<T, StackCapacity>::push_back(const T& value)
+{
+    emplace_back(value);
+}
+
+template<typename T, uint32_t StackCapacity>
+void FastArray<T, StackCapacity>::push_back(T&& value)
+{
+    emplace_back(std::move(value));
+}
+
+template<typename T, uint32_t StackCapacity>
+template<typename... Args>
+T& FastArray<T, StackCapacity>::emplace_back(Args&&... args)
+{
+    if (m_end == m_capacityEnd)
     {
-        m_stackData[m_stackDataSize] = value;
-        ++m_stackDataSize;
+        return growAndPushBack(T(std::forward<Args>(args)...));
     }
+    return *std::construct_at(m_end++, std::forward<Args>(args)...);
+}
+
+template<typename T, uint32_t StackCapacity>
+T FastArray<T, StackCapacity>::pop()
+{
+    --m_end;
+    T value = std::move(*m_end);
+    std::destroy_at(m_end);
+    return value;
+}
+
+template<typename T, uint32_t StackCapacity>
+const T& FastArray<T, StackCapacity>::peek() const
+{
+    return *(m_end - 1);
+}
+
+template<typename T, uint32_t StackCapacity>
+void FastArray<T, StackCapacity>::clear()
+{
+    std::destroy(m_data, m_end);
+    m_end = m_data;
+}
+
+template<typename T, uint32_t StackCapacity>
+T* FastArray<T, StackCapacity>::data()
+{
+    return m_data;
+}
+
+template<typename T, uint32_t StackCapacity>
+const T* FastArray<T, StackCapacity>::data() const
+{
+    return m_data;
+}
+
+template<typename T, uint32_t StackCapacity>
+auto FastArray<T, StackCapacity>::begin() -> iterator
+{
+    return m_data;
+}
+
+template<typename T, uint32_t StackCapacity>
+auto FastArray<T, StackCapacity>::end() -> iterator
+{
+    return m_end;
 }
 
-template<typename T>
-T FastArray<T>::pop()
+template<typename T, uint32_t StackCapacity>
+auto FastArray<T, StackCapacity>::begin() const -> const_iterator
 {
-    const auto sz = size();
-    const auto value = (*this)[sz - 1];
-    if (sz > STACK_ELEMENTS_COUNT)
+    return m_data;
+}
+
+template<typename T, uint32_t StackCapacity>
+auto FastArray<T, StackCapacity>::end() const -> const_iterator
+{
+    return m_end;
+}
+
+template<typename T, uint32_t StackCapacity>
+T* FastArray<T, StackCapacity>::getStackData()
+{
+    return std::launder(reinterpret_cast<T*>(m_stackData));
+}
+
+template<typename T, uint32_t StackCapacity>
+T& FastArray<T, StackCapacity>::growAndPushBack(T value)
+{
+    const auto newCapacity = capacity() * 2;
+    std::allocator<T> allocator;
+    auto* data = allocator.allocate(newCapacity);
+    auto* end = std::uninitialized_move(m_data, m_end, data);
+    std::destroy(m_data, m_end);
+    if (m_data != getStackData())
     {
-        m_heapData.resize(m_heapData.size() - 1);
+        allocator.deallocate(m_data, capacity());
     }
-    else
+
+    m_data = data;
+    m_end = end;
+    m_capacityEnd = data + newCapacity;
+    return *std::construct_at(m_end++, std::move(value));
+}
+
+template<typename T, uint32_t StackCapacity>
+void FastArray<T, StackCapacity>::reset()
+{
+    clear();
+    if (m_data != getStackData())
     {
-        --m_stackDataSize;
+        std::allocator<T>().deallocate(m_data, capacity());
+        m_data = getStackData();
+        m_end = m_data;
+        m_capacityEnd = m_data + StackCapacity;
     }
-    return value;
 }
 
-template<typename T>
-T FastArray<T>::peek() const
+template<typename T, uint32_t StackCapacity>
+void FastArray<T, StackCapacity>::moveFrom(FastArray& other) noexcept
 {
-    return (*this)[size() - 1];
+    if (other.m_data != other.getStackData())
+    {
+        m_data = other.m_data;
+        m_end = other.m_end;
+        m_capacityEnd = other.m_capacityEnd;
+        other.m_data = other.getStackData();
+        other.m_end = other.m_data;
+        other.m_capacityEnd = other.m_data + StackCapacity;
+        return;
+    }
+
+    m_end = std::uninitialized_move(other.m_data, other.m_end, m_data);
+    other.clear();
 }
 
 }
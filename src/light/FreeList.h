@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <bit>
+#include <cassert>
 #include <cstdint>
 #include <limits>
 #include <vector>
@@ -12,6 +14,8 @@ constexpr auto NIL = std::numeric_limits<uint32_t>::max();
 /// <summary>
 /// Provides an indexed free list with constant-tim removals from anywhere in the list without
 /// invalidating indices. T must be trivially constructible and destructible.
+/// Live slots are marked in a bitmap, so live elements can be iterated and compacted and indices
+/// are validated in debug builds.
 /// </summary>
 /// <typeparam name="T"></typeparam>
 template<typename T>
@@ -37,13 +41,45 @@ public:
 
     const T& operator[](uint32_t index) const;
 
+    /// <summary>
+    /// Whether the slot holds an element, i.e. it's pushed and not erased since then.
+    /// </summary>
+    bool isLive(uint32_t index) const;
+
+    /// <summary>
+    /// Calls callback(index, element) for every live element in the order of indices. Words of
+    /// the bitmap are scanned with count trailing zeros, so runs of free slots cost a word per
+    /// 64 of them.
+    /// </summary>
+    template<typename Callback>
+    void forEachLive(Callback&& callback);
+
+    template<typename Callback>
+    void forEachLive(Callback&& callback) const;
+
+    /// <summary>
+    /// Moves live elements into a dense prefix keeping their order, drops free slots and shrinks
+    /// the storage. Calls remapCallback(oldIndex, newIndex) for every element that moved, before
+    /// any following element is moved, so references to elements can be fixed up in place.
+    /// </summary>
+    template<typename RemapCallback>
+    void compact(RemapCallback&& remapCallback);
+
 private:
+    static constexpr uint32_t BITS_PER_WORD = 64;
+
+    // Shared by const and non-const forEachLive.
+    template<typename Self, typename Callback>
+    static void visitLive(Self& self, Callback& callback);
+
     union FreeElement
     {
         uint32_t next;
         T data;
     };
     std::vector<FreeElement> m_data;
+    // Bit i % 64 of word i / 64 is set if slot i is live.
+    std::vector<uint64_t> m_liveBits;
     size_t m_size;
     uint32_t m_firstFree;
 };
@@ -62,7 +98,7 @@ FreeList<T>::FreeList(uint32_t capacity)
   , m_size{ 0 }
   , m_firstFree{ NIL }
 {
-    m_data.reserve(capacity);
+    reserve(capacity);
 }
 
 template<typename T>
@@ -75,13 +111,21 @@ uint32_t FreeList<T>::push_back(const T& value)
         FreeElement newElement;
         newElement.data = value;
         m_data.push_back(newElement);
-        return static_cast<uint32_t>(m_data.size() - 1);
+        const auto newElementIndex = static_cast<uint32_t>(m_data.size() - 1);
+        if (newElementIndex % BITS_PER_WORD == 0)
+        {
+            m_liveBits.push_back(0);
+        }
+        m_liveBits.back() |= uint64_t(1) << (newElementIndex % BITS_PER_WORD);
+        return newElementIndex;
     }
     else
     {
         const auto newElementIndex = m_firstFree;
         m_firstFree = m_data[m_firstFree].next;
         m_data[newElementIndex].data = value;
+        const auto liveBit = uint64_t(1) << (newElementIndex % BITS_PER_WORD);
+        m_liveBits[newElementIndex / BITS_PER_WORD] |= liveBit;
         return newElementIndex;
     }
 }
@@ -89,6 +133,9 @@ uint32_t FreeList<T>::push_back(const T& value)
 template<typename T>
 void FreeList<T>::erase(uint32_t index)
 {
+    // erasing a free slot would link it into the free chain twice
+    assert(index < m_data.size() && isLive(index));
+    m_liveBits[index / BITS_PER_WORD] &= ~(uint64_t(1) << (index % BITS_PER_WORD));
     m_data[index].next = m_firstFree;
     m_firstFree = index;
     --m_size;
@@ -99,6 +146,7 @@ void FreeList<T>::clear()
 {
     m_size = 0;
     m_data.clear();
+    m_liveBits.clear();
     m_firstFree = NIL;
 }
 
@@ -112,6 +160,7 @@ template<typename T>
 void FreeList<T>::reserve(size_t capacity)
 {
     m_data.reserve(capacity);
+    m_liveBits.reserve((capacity + BITS_PER_WORD - 1) / BITS_PER_WORD);
 }
 
 template<typename T>
@@ -123,13 +172,82 @@ size_t FreeList<T>::range() const
 template<typename T>
 T& FreeList<T>::operator[](uint32_t index)
 {
+    // free slots are readable, they hold the index of the next free slot
+    assert(index < m_data.size());
     return m_data[index].data;
 }
 
 template<typename T>
 const T& FreeList<T>::operator[](uint32_t index) const
 {
+    assert(index < m_data.size());
     return m_data[index].data;
 }
 
+template<typename T>
+bool FreeList<T>::isLive(uint32_t index) const
+{
+    return index < m_data.size() &&
+           (m_liveBits[index / BITS_PER_WORD] >> (index % BITS_PER_WORD) & 1) != 0;
+}
+
+template<typename T>
+template<typename Callback>
+void FreeList<T>::forEachLive(Callback&& callback)
+{
+    visitLive(*this, callback);
+}
+
+template<typename T>
+template<typename Callback>
+void FreeList<T>::forEachLive(Callback&& callback) const
+{
+    visitLive(*this, callback);
+}
+
+template<typename T>
+template<typename Self, typename Callback>
+void FreeList<T>::visitLive(Self& self, Callback& callback)
+{
+    for (uint32_t word = 0; word < self.m_liveBits.size(); ++word)
+    {
+        auto bits = self.m_liveBits[word];
+        while (bits != 0)
+        {
+            const auto index = word * BITS_PER_WORD + static_cast<uint32_t>(std::countr_zero(bits));
+            bits &= bits - 1;
+            callback(index, self.m_data[index].data);
+        }
+    }
+}
+
+template<typename T>
+template<typename RemapCallback>
+void FreeList<T>::compact(RemapCallback&& remapCallback)
+{
+    uint32_t newIndex = 0;
+    forEachLive(
+      [&](uint32_t index, T& element)
+      {
+          if (index != newIndex)
+          {
+              m_data[newIndex].data = element;
+              remapCallback(index, newIndex);
+          }
+          ++newIndex;
+      });
+
+    m_data.resize(m_size);
+    m_data.shrink_to_fit();
+    m_firstFree = NIL;
+
+    // live slots are the prefix now
+    m_liveBits.assign((m_size + BITS_PER_WORD - 1) / BITS_PER_WORD, ~uint64_t(0));
+    if (m_size % BITS_PER_WORD != 0)
+    {
+        m_liveBits.back() = (uint64_t(1) << (m_size % BITS_PER_WORD)) - 1;
+    }
+    m_liveBits.shrink_to_fit();
+}
+
 }
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#define LIGHT_LEAF_SCAN_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_LEAF_SCAN_SSE2
+#endif
+
+#if defined(LIGHT_LEAF_SCAN_AVX2) || defined(LIGHT_LEAF_SCAN_SSE2)
+#include <immintrin.h>
+#endif
+
+namespace light
+{
+
+// Count of elements tested by one call of the leaf scan kernel. Blocks of leaf elements are
+// padded to the multiple of it, so the kernel never reads outside of the block.
+constexpr uint32_t LEAF_SCAN_WIDTH = 8;
+
+/**
+ * @brief Tests LEAF_SCAN_WIDTH element bounds against the rectangle with the same comparisons
+ * as isRectanglesOverlap. Portable kernel for any scalar type, the loop has a constant trip
+ * count, so compilers vectorize it for doubles and integers the SIMD kernels aren't written for.
+ * @return Mask with bit i set if element i overlaps the rectangle.
+ */
+template<typename Scalar>
+inline uint32_t getOverlapMaskScalar(const Scalar* minX,
+                                     const Scalar* minY,
+                                     const Scalar* maxX,
+                                     const Scalar* maxY,
+                                     glm::vec<2, Scalar> rectBottomLeft,
+                                     glm::vec<2, Scalar> rectTopRight)
+{
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < LEAF_SCAN_WIDTH; ++i)
+    {
+        const bool isOverlap = maxX[i] > rectBottomLeft.x && maxY[i] > rectBottomLeft.y &&
+                               minX[i] < rectTopRight.x && minY[i] < rectTopRight.y;
+        mask |= uint32_t(isOverlap) << i;
+    }
+    return mask;
+}
+
+#if defined(LIGHT_LEAF_SCAN_SSE2)
+inline uint32_t getOverlapMaskSse2(const float* minX,
+                                   const float* minY,
+                                   const float* maxX,
+                                   const float* maxY,
+                                   glm::vec2 rectBottomLeft,
+                                   glm::vec2 rectTopRight)
+{
+    const auto rectMinX = _mm_set1_ps(rectBottomLeft.x);
+    const auto rectMinY = _mm_set1_ps(rectBottomLeft.y);
+    const auto rectMaxX = _mm_set1_ps(rectTopRight.x);
+    const auto rectMaxY = _mm_set1_ps(rectTopRight.y);
+
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < LEAF_SCAN_WIDTH; i += 4)
+    {
+        // ordered comparisons are false for NaN, the same as scalar ones
+        const auto isOverlap =
+          _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(maxX + i), rectMinX),
+                                _mm_cmpgt_ps(_mm_loadu_ps(maxY + i), rectMinY)),
+                     _mm_and_ps(_mm_cmplt_ps(_mm_loadu_ps(minX + i), rectMaxX),
+                                _mm_cmplt_ps(_mm_loadu_ps(minY + i), rectMaxY)));
+        mask |= uint32_t(_mm_movemask_ps(isOverlap)) << i;
+    }
+    return mask;
+}
+#endif
+
+#if defined(LIGHT_LEAF_SCAN_AVX2)
+inline uint32_t getOverlapMaskAvx2(const float* minX,
+                                   const float* minY,
+                                   const float* maxX,
+                                   const float* maxY,
+                                   glm::vec2 rectBottomLeft,
+                                   glm::vec2 rectTopRight)
+{
+    static_assert(LEAF_SCAN_WIDTH == 8);
+    const auto isOverlap = _mm256_and_ps(
+      _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(maxX), _mm256_set1_ps(rectBottomLeft.x), _CMP_GT_OQ),
+        _mm256_cmp_ps(_mm256_loadu_ps(maxY), _mm256_set1_ps(rectBottomLeft.y), _CMP_GT_OQ)),
+      _mm256_and_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(minX), _mm256_set1_ps(rectTopRight.x), _CMP_LT_OQ),
+        _mm256_cmp_ps(_mm256_loadu_ps(minY), _mm256_set1_ps(rectTopRight.y), _CMP_LT_OQ)));
+    return uint32_t(_mm256_movemask_ps(isOverlap));
+}
+#endif
+
+/**
+ * @brief Leaf scan kernel chosen at compile time: AVX2 if it's enabled (QUADTREE_AVX2 CMake
+ * option), SSE2 on x86 and scalar code otherwise. All of them give the same masks.
+ */
+inline uint32_t getOverlapMask(const float* minX,
+                               const float* minY,
+                               const float* maxX,
+                               const float* maxY,
+                               glm::vec2 rectBottomLeft,
+                               glm::vec2 rectTopRight)
+{
+#if defined(LIGHT_LEAF_SCAN_AVX2)
+    return getOverlapMaskAvx2(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight);
+#elif defined(LIGHT_LEAF_SCAN_SSE2)
+    return getOverlapMaskSse2(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight);
+#else
+    return getOverlapMaskScalar(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight);
+#endif
+}
+
+}
@@ -0,0 +1,216 @@
+﻿#include "LinearQuadtree.h"
+
+#include <algorithm>
+
+namespace light
+{
+
+namespace
+{
+
+// Digits of LSD radix sort of keys, 3 passes sort 32-bit keys.
+constexpr uint32_t RADIX_BITS = 11;
+constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+
+// Sorts key-index pairs by keys stored in the higher 32 bits, order of equal keys is kept.
+void radixSortByKeys(std::vector<uint64_t>& pairs)
+{
+    std::vector<uint64_t> sorted(pairs.size());
+    std::vector<size_t> offsets(RADIX_SIZE + 1);
+
+    for (uint32_t shift = 32; shift < 64; shift += RADIX_BITS)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const auto pair : pairs)
+        {
+            ++offsets[((pair >> shift) & (RADIX_SIZE - 1)) + 1];
+        }
+        // all keys have the same digit, the pass wouldn't change anything
+        if (std::find(offsets.begin(), offsets.end(), pairs.size()) != offsets.end())
+        {
+            continue;
+        }
+        for (size_t i = 1; i <= RADIX_SIZE; ++i)
+        {
+            offsets[i] += offsets[i - 1];
+        }
+        for (const auto pair : pairs)
+        {
+            sorted[offsets[(pair >> shift) & (RADIX_SIZE - 1)]++] = pair;
+        }
+        pairs.swap(sorted);
+    }
+}
+
+}
+
+LinearQuadtree::LinearQuadtree(Point areaBottomLeft, Point areaTopRight, int maxDepth)
+  : m_areaBottomLeft{ areaBottomLeft }
+  , m_areaTopRight{ areaTopRight }
+  , m_maxDepth{ static_cast<uint32_t>(std::clamp(maxDepth, 0, int(MAX_DEPTH))) }
+{
+    const auto cellsCount = float(1u << m_maxDepth);
+    m_cellScale = Point(cellsCount / (areaTopRight.x - areaBottomLeft.x),
+                        cellsCount / (areaTopRight.y - areaBottomLeft.y));
+}
+
+size_t LinearQuadtree::size() const
+{
+    return m_keys.size();
+}
+
+void LinearQuadtree::clear()
+{
+    m_keys.clear();
+    m_ids.clear();
+    m_minX.clear();
+    m_minY.clear();
+    m_maxX.clear();
+    m_maxY.clear();
+    m_quadStarts.clear();
+    m_indexDepth = 0;
+}
+
+void LinearQuadtree::build(std::span<const QuadElement> elements)
+{
+    clear();
+
+    // key of element in the higher half and its index in the lower one
+    std::vector<uint64_t> pairs;
+    pairs.reserve(elements.size());
+    for (uint32_t i = 0; i < elements.size(); ++i)
+    {
+        const auto& element = elements[i];
+        if (isValidRectangle(element.bottomLeft, element.topRight))
+        {
+            pairs.push_back((uint64_t(getKey(element.bottomLeft, element.topRight)) << 32) | i);
+        }
+    }
+
+    radixSortByKeys(pairs);
+
+    const auto count = pairs.size();
+    m_keys.resize(count);
+    m_ids.resize(count);
+    for (auto* bounds : { &m_minX, &m_minY, &m_maxX, &m_maxY })
+    {
+        bounds->resize(count + LEAF_SCAN_WIDTH);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto& element = elements[static_cast<uint32_t>(pairs[i])];
+        m_keys[i] = static_cast<uint32_t>(pairs[i] >> 32);
+        m_ids[i] = element.id;
+        m_minX[i] = element.bottomLeft.x;
+        m_minY[i] = element.bottomLeft.y;
+        m_maxX[i] = element.topRight.x;
+        m_maxY[i] = element.topRight.y;
+    }
+
+    // the deepest level with enough elements per quad, the index stays a fraction of arrays
+    while (m_indexDepth < m_maxDepth &&
+           (size_t(4) << (2 * m_indexDepth)) * INDEXED_QUAD_ELEMENTS <= count)
+    {
+        ++m_indexDepth;
+    }
+    const auto quadsCount = 1u << (2 * m_indexDepth);
+    const auto codeShift = 2 * (m_maxDepth - m_indexDepth);
+    m_quadStarts.resize(quadsCount + 1);
+    uint32_t first = 0;
+    for (uint32_t quad = 0; quad < quadsCount; ++quad)
+    {
+        while (first < count && (m_keys[first] >> DEPTH_BITS) < (quad << codeShift))
+        {
+            ++first;
+        }
+        m_quadStarts[quad] = first;
+    }
+    m_quadStarts[quadsCount] = static_cast<uint32_t>(count);
+}
+
+size_t LinearQuadtree::memoryUsage() const
+{
+    return m_keys.capacity() * sizeof(uint32_t) + m_ids.capacity() * sizeof(Id) +
+           (m_minX.capacity() + m_minY.capacity() + m_maxX.capacity() + m_maxY.capacity()) *
+             sizeof(float) +
+           m_quadStarts.capacity() * sizeof(uint32_t);
+}
+
+uint32_t LinearQuadtree::getCellX(float x) const
+{
+    // clamped before conversion, so it's defined for any coordinate. negated, so NaNs go to
+    // the first cell
+    const auto cell = (x - m_areaBottomLeft.x) * m_cellScale.x;
+    if (!(cell > 0))
+    {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min(cell, float((1u << m_maxDepth) - 1)));
+}
+
+uint32_t LinearQuadtree::getCellY(float y) const
+{
+    const auto cell = (y - m_areaBottomLeft.y) * m_cellScale.y;
+    if (!(cell > 0))
+    {
+        return 0;
+    }
+    return static_cast<uint32_t>(std::min(cell, float((1u << m_maxDepth) - 1)));
+}
+
+uint32_t LinearQuadtree::getKey(Point rectBottomLeft, Point rectTopRight) const
+{
+    const auto minX = getCellX(rectBottomLeft.x);
+    const auto minY = getCellY(rectBottomLeft.y);
+    const auto maxX = getCellX(rectTopRight.x);
+    const auto maxY = getCellY(rectTopRight.y);
+
+    const auto centerX = minX + (maxX - minX) / 2;
+    const auto centerY = minY + (maxY - minY) / 2;
+    const auto halfSize = std::max(maxX - centerX, maxY - centerY);
+
+    // the deepest quad with loose margin not smaller than half size, root takes everything
+    const auto levelsBelow =
+      halfSize == 0 ? 0u
+                    : std::min(static_cast<uint32_t>(std::bit_width(4 * halfSize - 1)), m_maxDepth);
+    const auto code = getCellCode(centerX, centerY) & ~((1u << (2 * levelsBelow)) - 1);
+    return (code << DEPTH_BITS) | (m_maxDepth - levelsBelow);
+}
+
+uint32_t LinearQuadtree::getLooseMargin(uint32_t depth) const
+{
+    return (1u << (m_maxDepth - depth)) / 4;
+}
+
+uint32_t LinearQuadtree::getCellCode(uint32_t cellX, uint32_t cellY) const
+{
+    // top quadrants precede bottom ones, so bits of y are inverted
+    const auto bottom = ~cellY & ((1u << m_maxDepth) - 1);
+    uint32_t code = 0;
+    for (uint32_t bit = 0; bit < m_maxDepth; ++bit)
+    {
+        code |= ((cellX >> bit) & 1u) << (2 * bit);
+        code |= ((bottom >> bit) & 1u) << (2 * bit + 1);
+    }
+    return code;
+}
+
+bool LinearQuadtree::isValidRectangle(Point rectBottomLeft, Point rectTopRight) const
+{
+    // if ill-formed rectangle
+    if (rectBottomLeft.x > rectTopRight.x || rectBottomLeft.y > rectTopRight.y)
+    {
+        return false;
+    }
+
+    // if rectangle is outside of work area
+    if (rectBottomLeft.x > m_areaTopRight.x || rectTopRight.x < m_areaBottomLeft.x ||
+        rectBottomLeft.y > m_areaTopRight.y || rectTopRight.y < m_areaBottomLeft.y)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+}
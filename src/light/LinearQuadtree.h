@@ -0,0 +1,293 @@
+﻿#pragma once
+
+#include <light/FastArray.h>
+#include <light/LeafScan.h>
+#include <light/Quadtree.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace light
+{
+
+/**
+ * @brief Pointer-free quadtree for read-mostly data. Every element is keyed by the Morton code
+ * of the quad containing its center at the deepest level with quads at least twice as big as
+ * the element, the same placement as in LooseQuadtree, and elements are kept sorted by keys in
+ * plain arrays, so elements of every quad and of its whole subtree are contiguous. There are no
+ * nodes: queries walk the implicit quads, find their ranges of elements by binary search and
+ * skip empty ones. Element takes its key, Id and bounds, compared to its copy, slots of all
+ * leaves overlapped and update bounds in Quadtree.
+ */
+class LinearQuadtree
+{
+public:
+    // Depth of quads keys are computed for, keys of all depths fit 32 bits.
+    static constexpr uint32_t MAX_DEPTH = 14;
+
+    /**
+     * @brief Constructs an empty LinearQuadtree for specified 2D area.
+     * @param areaBottomLeft Bottom left corner of work area.
+     * @param areaTopRight Top right corner of work area.
+     * @param maxDepth Max depth of quads elements are placed in, clamped to MAX_DEPTH.
+     */
+    LinearQuadtree(Point areaBottomLeft, Point areaTopRight, int maxDepth = 10);
+
+    size_t size() const;
+
+    void clear();
+
+    /**
+     * @brief Replaces content of the quadtree with specified elements. Keys are computed once
+     * and sorted with radix sort.
+     * @param elements Elements to store. Ill-formed rectangles and rectangles outside of work
+     * area are skipped, the same as in Quadtree.
+     */
+    void build(std::span<const QuadElement> elements);
+
+    /**
+     * @brief Bytes taken by arrays of the quadtree.
+     */
+    size_t memoryUsage() const;
+
+    using IterateObjectsCallback =
+      std::function<bool(const Id& id, Point bottomLeft, Point topRight)>;
+
+    /**
+     * @brief Calls callback once for every element overlapping specified area, the same
+     * elements Quadtree::forEachObjectInArea reports.
+     * @tparam Callback Any callable with signature of IterateObjectsCallback, it's inlined into
+     * the scan loop. Iteration stops when callback returns false.
+     */
+    template<typename Callback>
+    void forEachObjectInArea(Point areaBottomLeft, Point areaTopRight, Callback&& callback) const;
+
+    /**
+     * @brief Appends Ids of elements overlapping specified area to the container.
+     * @tparam Container Container of Ids with push_back, e.g. std::vector<Id>.
+     */
+    template<typename Container>
+    void findObjectsInArea(Point areaBottomLeft, Point areaTopRight, Container& ids) const;
+
+private:
+    // Bits of key storing depth of the quad, its Morton code padded to m_maxDepth levels is
+    // stored above them.
+    static constexpr uint32_t DEPTH_BITS = 4;
+
+    // Ranges of elements this short are scanned by queries without descending to subtrees.
+    static constexpr uint32_t SCAN_RANGE_SIZE = 4 * LEAF_SCAN_WIDTH;
+
+    // Elements per quad at m_indexDepth the depth is chosen for.
+    static constexpr size_t INDEXED_QUAD_ELEMENTS = 4;
+
+    // Implicit quad visited by queries. Cells are quads at m_maxDepth.
+    struct TraverseQuadData
+    {
+        // Morton code of the quad padded to m_maxDepth levels.
+        uint32_t code;
+        uint32_t depth;
+        // Cell at the bottom left corner of the quad.
+        uint32_t cellX;
+        uint32_t cellY;
+        // Range of elements stored in the quad and its subtree.
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // Cell containing the coordinate. Coordinates outside of work area are clamped to its
+    // border cells, and the mapping is monotonic, so rectangles overlapping each other always
+    // map to overlapping ranges of cells.
+    uint32_t getCellX(float x) const;
+
+    uint32_t getCellY(float y) const;
+
+    // Key of the quad rectangle is placed in.
+    uint32_t getKey(Point rectBottomLeft, Point rectTopRight) const;
+
+    // Count of cells elements of the quad and its subtree may stick out of it by. Rectangle is
+    // placed in the quad with its cells at most a quarter of the quad size away from its center
+    // cell, quads smaller than 4 cells get rectangles of a single cell only.
+    uint32_t getLooseMargin(uint32_t depth) const;
+
+    // Interleaves bits of cell coordinates into Morton code with quadrants numbered as in
+    // Quadtree: bit 0 of every level is set for the right half and bit 1 for the bottom one.
+    uint32_t getCellCode(uint32_t cellX, uint32_t cellY) const;
+
+    bool isValidRectangle(Point rectBottomLeft, Point rectTopRight) const;
+
+    // Calls callback for elements in the range overlapping the area. Returns false if callback
+    // stopped the iteration.
+    template<typename Callback>
+    bool scanRange(uint32_t begin,
+                   uint32_t end,
+                   Point areaBottomLeft,
+                   Point areaTopRight,
+                   Callback& callback) const;
+
+    // Keys of elements in ascending order, padded Morton code is compared first, so elements of
+    // a quad precede elements of its subtree.
+    std::vector<uint32_t> m_keys;
+    std::vector<Id> m_ids;
+    // Bounds of elements in the order of keys. Arrays are padded by LEAF_SCAN_WIDTH elements,
+    // so the scan kernel may start at any element.
+    std::vector<float> m_minX;
+    std::vector<float> m_minY;
+    std::vector<float> m_maxX;
+    std::vector<float> m_maxY;
+    // First element with padded Morton code not less than the code of every quad at
+    // m_indexDepth, followed by the count of elements.
+    std::vector<uint32_t> m_quadStarts;
+
+    Point m_areaBottomLeft;
+    Point m_areaTopRight;
+    // Count of cells per unit of length.
+    Point m_cellScale;
+    uint32_t m_maxDepth;
+    uint32_t m_indexDepth = 0;
+};
+
+template<typename Callback>
+bool LinearQuadtree::scanRange(uint32_t begin,
+                               uint32_t end,
+                               Point areaBottomLeft,
+                               Point areaTopRight,
+                               Callback& callback) const
+{
+    for (auto first = begin; first < end; first += LEAF_SCAN_WIDTH)
+    {
+        auto mask = getOverlapMask(m_minX.data() + first,
+                                   m_minY.data() + first,
+                                   m_maxX.data() + first,
+                                   m_maxY.data() + first,
+                                   areaBottomLeft,
+                                   areaTopRight);
+        if (end - first < LEAF_SCAN_WIDTH)
+        {
+            mask &= (1u << (end - first)) - 1;
+        }
+
+        while (mask != 0)
+        {
+            const auto i = first + static_cast<uint32_t>(std::countr_zero(mask));
+            mask &= mask - 1;
+            if (!callback(m_ids[i], Point(m_minX[i], m_minY[i]), Point(m_maxX[i], m_maxY[i])))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template<typename Callback>
+void LinearQuadtree::forEachObjectInArea(Point areaBottomLeft,
+                                         Point areaTopRight,
+                                         Callback&& callback) const
+{
+    if (m_keys.empty() || !isValidRectangle(areaBottomLeft, areaTopRight))
+    {
+        return;
+    }
+
+    // elements overlapping the area lie in quads with loose bounds overlapping its cells
+    const auto areaMinX = getCellX(areaBottomLeft.x);
+    const auto areaMinY = getCellY(areaBottomLeft.y);
+    const auto areaMaxX = getCellX(areaTopRight.x);
+    const auto areaMaxY = getCellY(areaTopRight.y);
+
+    FastArray<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, 0, 0, 0, 0, static_cast<uint32_t>(m_keys.size()) });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto quad = quadsToCheck.pop();
+        const auto quadSize = 1u << (m_maxDepth - quad.depth);
+
+        const auto margin = getLooseMargin(quad.depth);
+
+        // quad inside the area has no subtree to cut off and a short range is scanned faster
+        // than split, the whole range is scanned at once
+        if (quad.depth == m_maxDepth || quad.end - quad.begin <= SCAN_RANGE_SIZE ||
+            (areaMinX + margin <= quad.cellX && quad.cellX + quadSize - 1 + margin <= areaMaxX &&
+             areaMinY + margin <= quad.cellY && quad.cellY + quadSize - 1 + margin <= areaMaxY))
+        {
+            if (!scanRange(quad.begin, quad.end, areaBottomLeft, areaTopRight, callback))
+            {
+                return;
+            }
+            continue;
+        }
+
+        // elements of the quad itself have the smallest key of its range
+        const auto quadKey = (quad.code << DEPTH_BITS) | quad.depth;
+        auto childBegin = quad.begin;
+        while (childBegin < quad.end && m_keys[childBegin] == quadKey)
+        {
+            ++childBegin;
+        }
+        if (!scanRange(quad.begin, childBegin, areaBottomLeft, areaTopRight, callback))
+        {
+            return;
+        }
+
+        const auto childSize = quadSize / 2;
+        const auto childCodeSpan = childSize * childSize;
+        const auto childMargin = getLooseMargin(quad.depth + 1);
+        // whether the area overlaps loose bounds of the children on each side
+        const bool areaLeft = areaMinX < quad.cellX + childSize + childMargin;
+        const bool areaRight = areaMaxX + childMargin >= quad.cellX + childSize;
+        const bool areaBottom = areaMinY < quad.cellY + childSize + childMargin;
+        const bool areaTop = areaMaxY + childMargin >= quad.cellY + childSize;
+
+        // children ranges follow each other in the order of quadrants, so they are split by
+        // the first key of the next child, found in the index above m_indexDepth and by binary
+        // search below it
+        for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+        {
+            const auto childCode = quad.code + quadrant * childCodeSpan;
+            const auto nextCode = childCode + childCodeSpan;
+            const auto childEnd =
+              quadrant == 3 ? quad.end
+              : quad.depth < m_indexDepth
+                ? m_quadStarts[nextCode >> (2 * (m_maxDepth - m_indexDepth))]
+                : static_cast<uint32_t>(std::lower_bound(m_keys.begin() + childBegin,
+                                                         m_keys.begin() + quad.end,
+                                                         nextCode << DEPTH_BITS) -
+                                        m_keys.begin());
+
+            const bool isRight = quadrant & 1u;
+            const bool isBottom = quadrant & 2u;
+            if (childBegin != childEnd && (isRight ? areaRight : areaLeft) &&
+                (isBottom ? areaBottom : areaTop))
+            {
+                quadsToCheck.push_back({ childCode,
+                                         quad.depth + 1,
+                                         quad.cellX + (isRight ? childSize : 0),
+                                         quad.cellY + (isBottom ? 0 : childSize),
+                                         childBegin,
+                                         childEnd });
+            }
+            childBegin = childEnd;
+        }
+    }
+}
+
+template<typename Container>
+void LinearQuadtree::findObjectsInArea(Point areaBottomLeft,
+                                       Point areaTopRight,
+                                       Container& ids) const
+{
+    forEachObjectInArea(areaBottomLeft,
+                        areaTopRight,
+                        [&ids](const Id& id, Point, Point)
+                        {
+                            ids.push_back(id);
+                            return true;
+                        });
+}
+
+}
@@ -0,0 +1,404 @@
+﻿#include "LooseQuadtree.h"
+
+#include <algorithm>
+
+namespace light
+{
+
+namespace
+{
+
+// Smallest block of slots owned by a node, the same as in Quadtree.
+constexpr uint32_t MIN_NODE_CAPACITY = LEAF_SCAN_WIDTH;
+
+}
+
+LooseQuadtree::LooseQuadtree(Point areaBottomLeft,
+                             Point areaTopRight,
+                             float looseness,
+                             int maxElementsPerNode,
+                             int maxDepth)
+  : m_freeNode{ NIL }
+  , m_areaBottomLeft{ areaBottomLeft }
+  , m_areaTopRight{ areaTopRight }
+  , m_looseness{ std::max(looseness, 1.0f) }
+  , m_maxElementsPerNode{ maxElementsPerNode }
+  , m_maxDepth{ maxDepth }
+{
+    initRoot();
+}
+
+size_t LooseQuadtree::size() const
+{
+    return m_elementNodes.size();
+}
+
+void LooseQuadtree::clear()
+{
+    m_nodes.clear();
+    m_slots.bounds.clear();
+    m_slots.references.clear();
+    m_freeSlots.clear();
+    m_elementNodes.clear();
+    m_freeNode = NIL;
+    initRoot();
+}
+
+uint32_t LooseQuadtree::insert(Point rectBottomLeft, Point rectTopRight, Id id)
+{
+    if (!isValidRectangle(rectBottomLeft, rectTopRight))
+    {
+        return NIL;
+    }
+
+    const auto elementIndex = m_elementNodes.push_back(NIL);
+    appendToNode(placeRectangle(rectBottomLeft, rectTopRight),
+                 rectBottomLeft,
+                 rectTopRight,
+                 id,
+                 elementIndex);
+    return elementIndex;
+}
+
+void LooseQuadtree::remove(uint32_t index)
+{
+    const auto nodeIndex = m_elementNodes[index];
+    removeFromNode(nodeIndex, findSlot(m_nodes[nodeIndex], index));
+    m_elementNodes.erase(index);
+    mergeUp(nodeIndex);
+}
+
+bool LooseQuadtree::update(uint32_t index, Point newBottomLeft, Point newTopRight)
+{
+    if (!isValidRectangle(newBottomLeft, newTopRight))
+    {
+        return false;
+    }
+
+    const auto nodeIndex = m_elementNodes[index];
+    const auto& node = m_nodes[nodeIndex];
+    const auto offset = findSlot(node, index);
+    const auto id = m_slots.references[2 * size_t(node.firstSlot) + offset];
+
+    // fast path: element still fits into its node and doesn't fit into a child of it
+    if (isFitting(node, newBottomLeft, newTopRight) &&
+        (node.isLeaf() || getChildFor(node, newBottomLeft, newTopRight) == NIL))
+    {
+        writeSlot(node, offset, newBottomLeft, newTopRight, id, index);
+        return true;
+    }
+
+    removeFromNode(nodeIndex, offset);
+    appendToNode(placeRectangle(newBottomLeft, newTopRight), newBottomLeft, newTopRight, id, index);
+    // placing never turns branches into leaves, so the old node is still valid
+    mergeUp(nodeIndex);
+    return true;
+}
+
+bool LooseQuadtree::isFitting(const LooseQuadNode& node,
+                              Point rectBottomLeft,
+                              Point rectTopRight) const
+{
+    Point boundsMin;
+    Point boundsMax;
+    getLooseBounds(node, boundsMin, boundsMax);
+    return boundsMin.x <= rectBottomLeft.x && boundsMin.y <= rectBottomLeft.y &&
+           rectTopRight.x <= boundsMax.x && rectTopRight.y <= boundsMax.y;
+}
+
+uint32_t LooseQuadtree::getChildFor(const LooseQuadNode& branch,
+                                    Point rectBottomLeft,
+                                    Point rectTopRight) const
+{
+    const auto rectCenter = (rectBottomLeft + rectTopRight) * 0.5f;
+    const auto childIndex =
+      branch.firstChild + getQuadrant(rectCenter, branch.bottomLeft + branch.size * 0.5f);
+    return isFitting(m_nodes[childIndex], rectBottomLeft, rectTopRight) ? childIndex : NIL;
+}
+
+bool LooseQuadtree::isValidRectangle(Point rectBottomLeft, Point rectTopRight) const
+{
+    // if ill-formed rectangle
+    if (rectBottomLeft.x > rectTopRight.x || rectBottomLeft.y > rectTopRight.y)
+    {
+        return false;
+    }
+
+    // if rectangle is outside of work area
+    if (rectBottomLeft.x > m_areaTopRight.x || rectTopRight.x < m_areaBottomLeft.x ||
+        rectBottomLeft.y > m_areaTopRight.y || rectTopRight.y < m_areaBottomLeft.y)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void LooseQuadtree::initRoot()
+{
+    LooseQuadNode root;
+    root.firstChild = NIL;
+    root.parent = NIL;
+    root.firstSlot = NIL;
+    root.count = 0;
+    root.capacity = 0;
+    root.depth = 0;
+    root.bottomLeft = m_areaBottomLeft;
+    root.size = m_areaTopRight - m_areaBottomLeft;
+    m_nodes.push_back(root);
+}
+
+uint32_t LooseQuadtree::placeRectangle(Point rectBottomLeft, Point rectTopRight)
+{
+    uint32_t nodeIndex = 0;
+    while (true)
+    {
+        if (m_nodes[nodeIndex].isLeaf())
+        {
+            const auto& leaf = m_nodes[nodeIndex];
+            if (leaf.count < static_cast<uint32_t>(m_maxElementsPerNode) ||
+                leaf.depth == static_cast<uint32_t>(m_maxDepth))
+            {
+                return nodeIndex;
+            }
+            subdivide(nodeIndex);
+        }
+
+        const auto childIndex = getChildFor(m_nodes[nodeIndex], rectBottomLeft, rectTopRight);
+        if (childIndex == NIL)
+        {
+            return nodeIndex;
+        }
+        nodeIndex = childIndex;
+    }
+}
+
+void LooseQuadtree::subdivide(uint32_t leafIndex)
+{
+    uint32_t firstChild = m_freeNode;
+    if (firstChild == NIL)
+    {
+        firstChild = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.resize(m_nodes.size() + 4);
+    }
+    else
+    {
+        // reuse block of 4 nodes freed by merge
+        m_freeNode = m_nodes[firstChild].firstChild;
+    }
+
+    const auto leaf = m_nodes[leafIndex];
+    const auto subQuadSize = leaf.size * 0.5f;
+    for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+    {
+        auto& child = m_nodes[firstChild + quadrant];
+        child.firstChild = NIL;
+        child.parent = leafIndex;
+        child.firstSlot = NIL;
+        child.count = 0;
+        child.capacity = 0;
+        child.depth = leaf.depth + 1;
+        child.bottomLeft = leaf.bottomLeft + Point((quadrant & 1u) ? subQuadSize.x : 0,
+                                                   (quadrant & 2u) ? 0 : subQuadSize.y);
+        child.size = subQuadSize;
+    }
+    m_nodes[leafIndex].firstChild = firstChild;
+
+    // slots are read by index, as appending to children may reallocate them
+    for (uint32_t offset = 0; offset < m_nodes[leafIndex].count;)
+    {
+        const auto& node = m_nodes[leafIndex];
+        const auto* bounds = m_slots.bounds.data() + 4 * size_t(node.firstSlot) + offset;
+        const Point rectBottomLeft{ bounds[0], bounds[node.capacity] };
+        const Point rectTopRight{ bounds[2 * node.capacity], bounds[3 * node.capacity] };
+
+        const auto childIndex = getChildFor(node, rectBottomLeft, rectTopRight);
+        if (childIndex == NIL)
+        {
+            ++offset;
+            continue;
+        }
+
+        const auto* references = m_slots.references.data() + 2 * size_t(node.firstSlot) + offset;
+        const auto id = references[0];
+        const auto elementIndex = references[node.capacity];
+        removeFromNode(leafIndex, offset);
+        appendToNode(childIndex, rectBottomLeft, rectTopRight, id, elementIndex);
+    }
+}
+
+bool LooseQuadtree::tryMerge(uint32_t branchIndex)
+{
+    const auto firstChild = m_nodes[branchIndex].firstChild;
+
+    auto totalCount = m_nodes[branchIndex].count;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const auto& child = m_nodes[firstChild + i];
+        if (!child.isLeaf())
+        {
+            return false;
+        }
+        totalCount += child.count;
+    }
+
+    if (totalCount >= static_cast<uint32_t>(m_maxElementsPerNode))
+    {
+        return false;
+    }
+
+    // loose bounds of children lie inside loose bounds of the parent
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const auto child = m_nodes[firstChild + i];
+        for (uint32_t offset = 0; offset < child.count; ++offset)
+        {
+            const auto* bounds = m_slots.bounds.data() + 4 * size_t(child.firstSlot) + offset;
+            const auto* references =
+              m_slots.references.data() + 2 * size_t(child.firstSlot) + offset;
+            appendToNode(branchIndex,
+                         Point(bounds[0], bounds[child.capacity]),
+                         Point(bounds[2 * child.capacity], bounds[3 * child.capacity]),
+                         references[0],
+                         references[child.capacity]);
+        }
+
+        if (child.capacity != 0)
+        {
+            freeSlots(child.firstSlot, child.capacity);
+        }
+    }
+
+    m_nodes[branchIndex].firstChild = NIL;
+    m_nodes[firstChild].firstChild = m_freeNode;
+    m_freeNode = firstChild;
+    return true;
+}
+
+void LooseQuadtree::mergeUp(uint32_t nodeIndex)
+{
+    // element left a leaf, so its parent may merge, or it left a branch, which may merge itself
+    auto branchIndex = m_nodes[nodeIndex].isLeaf() ? m_nodes[nodeIndex].parent : nodeIndex;
+    while (branchIndex != NIL && tryMerge(branchIndex))
+    {
+        branchIndex = m_nodes[branchIndex].parent;
+    }
+}
+
+uint32_t LooseQuadtree::allocateSlots(uint32_t capacity)
+{
+    const auto sizeClass = static_cast<uint32_t>(std::countr_zero(capacity));
+    if (sizeClass < m_freeSlots.size() && m_freeSlots[sizeClass] != NIL)
+    {
+        const auto firstSlot = m_freeSlots[sizeClass];
+        m_freeSlots[sizeClass] = m_slots.references[2 * size_t(firstSlot)];
+        return firstSlot;
+    }
+
+    const auto firstSlot = static_cast<uint32_t>(m_slots.references.size() / 2);
+    m_slots.bounds.resize(m_slots.bounds.size() + 4 * size_t(capacity));
+    m_slots.references.resize(m_slots.references.size() + 2 * size_t(capacity));
+    return firstSlot;
+}
+
+void LooseQuadtree::freeSlots(uint32_t firstSlot, uint32_t capacity)
+{
+    const auto sizeClass = static_cast<uint32_t>(std::countr_zero(capacity));
+    if (m_freeSlots.size() <= sizeClass)
+    {
+        m_freeSlots.resize(sizeClass + 1, NIL);
+    }
+    m_slots.references[2 * size_t(firstSlot)] = m_freeSlots[sizeClass];
+    m_freeSlots[sizeClass] = firstSlot;
+}
+
+uint32_t LooseQuadtree::findSlot(const LooseQuadNode& node, uint32_t elementIndex) const
+{
+    const auto* elementIndices =
+      m_slots.references.data() + 2 * size_t(node.firstSlot) + node.capacity;
+    return static_cast<uint32_t>(
+      std::find(elementIndices, elementIndices + node.count, elementIndex) - elementIndices);
+}
+
+void LooseQuadtree::writeSlot(const LooseQuadNode& node,
+                              uint32_t offset,
+                              Point rectBottomLeft,
+                              Point rectTopRight,
+                              Id id,
+                              uint32_t elementIndex)
+{
+    auto* bounds = m_slots.bounds.data() + 4 * size_t(node.firstSlot) + offset;
+    bounds[0] = rectBottomLeft.x;
+    bounds[node.capacity] = rectBottomLeft.y;
+    bounds[2 * node.capacity] = rectTopRight.x;
+    bounds[3 * node.capacity] = rectTopRight.y;
+    auto* references = m_slots.references.data() + 2 * size_t(node.firstSlot) + offset;
+    references[0] = id;
+    references[node.capacity] = elementIndex;
+}
+
+void LooseQuadtree::appendToNode(uint32_t nodeIndex,
+                                 Point rectBottomLeft,
+                                 Point rectTopRight,
+                                 Id id,
+                                 uint32_t elementIndex)
+{
+    auto& node = m_nodes[nodeIndex];
+
+    if (node.count == node.capacity)
+    {
+        const auto oldNode = node;
+        node.capacity = std::max(std::bit_ceil(node.capacity + 1), MIN_NODE_CAPACITY);
+        node.firstSlot = allocateSlots(node.capacity);
+        for (uint32_t i = 0; i < node.count; ++i)
+        {
+            for (uint32_t j = 0; j < 4; ++j)
+            {
+                m_slots.bounds[4 * size_t(node.firstSlot) + j * node.capacity + i] =
+                  m_slots.bounds[4 * size_t(oldNode.firstSlot) + j * oldNode.capacity + i];
+            }
+            for (uint32_t j = 0; j < 2; ++j)
+            {
+                m_slots.references[2 * size_t(node.firstSlot) + j * node.capacity + i] =
+                  m_slots.references[2 * size_t(oldNode.firstSlot) + j * oldNode.capacity + i];
+            }
+        }
+        if (oldNode.capacity != 0)
+        {
+            freeSlots(oldNode.firstSlot, oldNode.capacity);
+        }
+    }
+
+    writeSlot(node, node.count, rectBottomLeft, rectTopRight, id, elementIndex);
+    ++node.count;
+    m_elementNodes[elementIndex] = nodeIndex;
+}
+
+void LooseQuadtree::removeFromNode(uint32_t nodeIndex, uint32_t offset)
+{
+    auto& node = m_nodes[nodeIndex];
+
+    --node.count;
+    if (offset != node.count)
+    {
+        auto* bounds = m_slots.bounds.data() + 4 * size_t(node.firstSlot);
+        auto* references = m_slots.references.data() + 2 * size_t(node.firstSlot);
+        for (uint32_t j = 0; j < 4; ++j)
+        {
+            bounds[j * node.capacity + offset] = bounds[j * node.capacity + node.count];
+        }
+        for (uint32_t j = 0; j < 2; ++j)
+        {
+            references[j * node.capacity + offset] = references[j * node.capacity + node.count];
+        }
+    }
+
+    if (node.count == 0)
+    {
+        freeSlots(node.firstSlot, node.capacity);
+        node.firstSlot = NIL;
+        node.capacity = 0;
+    }
+}
+
+}
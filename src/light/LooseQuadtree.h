@@ -0,0 +1,337 @@
+﻿#pragma once
+
+#include <light/FastArray.h>
+#include <light/FreeList.h>
+#include <light/LeafScan.h>
+#include <light/Quadtree.h>
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+
+namespace light
+{
+
+/**
+ * @brief Loose quadtree of rectangles. Bounds of every node are its quad scaled by the
+ * looseness factor around its center, and every element is stored once, in the deepest node
+ * whose loose bounds contain it, so branches store elements too. Element straddling centers of
+ * quads isn't copied into several leaves: remove and update touch a single node and memory is
+ * proportional to the count of elements. Queries test areas against loose bounds of nodes.
+ */
+class LooseQuadtree
+{
+public:
+    /**
+     * @brief Constructs an empty LooseQuadtree for specified 2D area.
+     * @param areaBottomLeft Bottom left corner of work area.
+     * @param areaTopRight Top right corner of work area.
+     * @param looseness Ratio of size of loose bounds of node to size of its quad, at least 1.
+     * With 2 every element not bigger than half of a quad fits into a node of its size.
+     * @param maxElementsPerNode Maximum amount of elements that can be stored in leaf before
+     * it will be splitted. Leaf won't be splitted anymore when maxDepth is reached.
+     * @param maxDepth Max depth of nested quad nodes.
+     */
+    LooseQuadtree(Point areaBottomLeft,
+                  Point areaTopRight,
+                  float looseness = 2,
+                  int maxElementsPerNode = 8,
+                  int maxDepth = 8);
+
+    size_t size() const;
+
+    void clear();
+
+    /**
+     * @brief Inserts rectangle element into the deepest node whose loose bounds contain it.
+     * @return Index of the inserted element which can be used to remove it later, or NIL if
+     * rectangle is ill-formed or lies outside of work area.
+     */
+    uint32_t insert(Point rectBottomLeft, Point rectTopRight, Id id);
+
+    /**
+     * @brief Removes element from its node. Leaves whose elements fit into their parent
+     * together with elements of the parent and their siblings are merged back into it.
+     * @param index Index of the element returned by insert.
+     */
+    void remove(uint32_t index);
+
+    /**
+     * @brief Moves element to new extents. If element still belongs to the same node, only its
+     * slot is rewritten, otherwise it's moved to another node.
+     * @param index Index of the element returned by insert.
+     * @return False if new rectangle is ill-formed or lies outside of work area. Element is
+     * left unchanged in such case.
+     */
+    bool update(uint32_t index, Point newBottomLeft, Point newTopRight);
+
+    using IterateObjectsCallback =
+      std::function<bool(const Id& id, Point bottomLeft, Point topRight)>;
+
+    /**
+     * @brief Calls callback once for every element overlapping specified area, with the same
+     * comparisons as isRectanglesOverlap.
+     * @tparam Callback Any callable with signature of IterateObjectsCallback, it's inlined into
+     * the node loop. Iteration stops when callback returns false.
+     */
+    template<typename Callback>
+    void forEachObjectInArea(Point areaBottomLeft,
+                             Point areaTopRight,
+                             Callback&& callback) const;
+
+    /**
+     * @brief Appends Ids of elements overlapping specified area to the container.
+     * @tparam Container Container of Ids with push_back, e.g. std::vector<Id>.
+     */
+    template<typename Container>
+    void findObjectsInArea(Point areaBottomLeft, Point areaTopRight, Container& ids) const;
+
+    using TraverseQuadCallback = std::function<void(const Point& bottomLeft, const Point& size)>;
+
+    /**
+     * @brief Function for traversing quads to visualize them, quads are passed without
+     * looseness.
+     * @tparam QuadsObserver Any callable with signature of TraverseQuadCallback.
+     */
+    template<typename QuadsObserver>
+    void traverseQuads(QuadsObserver&& quadsObserver) const;
+
+private:
+    struct LooseQuadNode
+    {
+        // First of 4 children, NIL if the node is a leaf.
+        uint32_t firstChild;
+        // NIL for root.
+        uint32_t parent;
+        // Elements of the node are stored in the block of capacity slots starting at firstSlot.
+        uint32_t firstSlot;
+        uint32_t count;
+        uint32_t capacity;
+        uint32_t depth;
+        // Quad of the node, before it's loosened.
+        Point bottomLeft;
+        Point size;
+
+        inline bool isLeaf() const { return firstChild == NIL; }
+    };
+
+    // Elements of nodes in structure of arrays form, laid out the same as in Quadtree: every
+    // node owns a block of capacity C starting at slot S, minX of its elements at
+    // [4 * S, 4 * S + C) of bounds followed by minY, maxX and maxY, Ids of the elements at
+    // [2 * S, 2 * S + C) of references followed by their indices. Free block stores the first
+    // slot of the next free block of the same capacity at 2 * S of references.
+    struct NodeSlots
+    {
+        std::vector<float> bounds;
+        std::vector<uint32_t> references;
+    };
+
+    // Quadrant of the quad with the center containing the point, numbered as in Quadtree.
+    static uint32_t getQuadrant(Point position, Point center);
+
+    // Loose bounds of the node, root is unbounded as elements may stick out of work area.
+    void getLooseBounds(const LooseQuadNode& node, Point& boundsMin, Point& boundsMax) const;
+
+    // Whether loose bounds of the node contain the rectangle.
+    bool isFitting(const LooseQuadNode& node, Point rectBottomLeft, Point rectTopRight) const;
+
+    // Child of the branch the rectangle goes to if it fits into it, the one containing its
+    // center.
+    uint32_t getChildFor(const LooseQuadNode& branch,
+                         Point rectBottomLeft,
+                         Point rectTopRight) const;
+
+    bool isValidRectangle(Point rectBottomLeft, Point rectTopRight) const;
+
+    void initRoot();
+
+    // Finds the node for the rectangle, subdividing full leaves on the way.
+    uint32_t placeRectangle(Point rectBottomLeft, Point rectTopRight);
+
+    // Turns the leaf into branch, moving elements fitting into children down.
+    void subdivide(uint32_t leafIndex);
+
+    // Turns branch back into leaf if all its children are leaves and they store less than
+    // maxElementsPerNode elements in total together with it. Freed children are pushed to the
+    // free nodes chain. Returns false if branch stays.
+    bool tryMerge(uint32_t branchIndex);
+
+    // Merges branches starting from the node after element is removed from it.
+    void mergeUp(uint32_t nodeIndex);
+
+    // Same as in Quadtree, blocks have power of two capacities.
+    uint32_t allocateSlots(uint32_t capacity);
+
+    void freeSlots(uint32_t firstSlot, uint32_t capacity);
+
+    // Offset of the element in the slots of the node.
+    uint32_t findSlot(const LooseQuadNode& node, uint32_t elementIndex) const;
+
+    void writeSlot(const LooseQuadNode& node,
+                   uint32_t offset,
+                   Point rectBottomLeft,
+                   Point rectTopRight,
+                   Id id,
+                   uint32_t elementIndex);
+
+    // Appends element to the node, moving its slots to a bigger block if it's full.
+    void appendToNode(uint32_t nodeIndex,
+                      Point rectBottomLeft,
+                      Point rectTopRight,
+                      Id id,
+                      uint32_t elementIndex);
+
+    // Removes element at the offset from the node, its last slot takes place of it.
+    void removeFromNode(uint32_t nodeIndex, uint32_t offset);
+
+    std::vector<LooseQuadNode> m_nodes;
+    NodeSlots m_slots;
+    // First slots of free blocks chains, block of k-th chain has 2^k slots.
+    std::vector<uint32_t> m_freeSlots;
+    // Node storing the element, indexed by element index.
+    FreeList<uint32_t> m_elementNodes;
+    // Index of the first node in the chain of freed blocks of 4 nodes. Free blocks are linked
+    // through firstChild of their first node.
+    uint32_t m_freeNode;
+
+    Point m_areaBottomLeft;
+    Point m_areaTopRight;
+    float m_looseness;
+    int m_maxElementsPerNode;
+    int m_maxDepth;
+};
+
+inline uint32_t LooseQuadtree::getQuadrant(Point position, Point center)
+{
+    return uint32_t(position.x >= center.x) | (uint32_t(position.y < center.y) << 1);
+}
+
+inline void LooseQuadtree::getLooseBounds(const LooseQuadNode& node,
+                                          Point& boundsMin,
+                                          Point& boundsMax) const
+{
+    if (node.parent == NIL)
+    {
+        constexpr auto unbounded = std::numeric_limits<float>::infinity();
+        boundsMin = Point(-unbounded, -unbounded);
+        boundsMax = Point(unbounded, unbounded);
+        return;
+    }
+
+    const auto margin = node.size * ((m_looseness - 1) * 0.5f);
+    boundsMin = node.bottomLeft - margin;
+    boundsMax = node.bottomLeft + node.size + margin;
+}
+
+template<typename Callback>
+void LooseQuadtree::forEachObjectInArea(Point areaBottomLeft,
+                                        Point areaTopRight,
+                                        Callback&& callback) const
+{
+    if (!isValidRectangle(areaBottomLeft, areaTopRight))
+    {
+        return;
+    }
+
+    FastArray<uint32_t> nodesToCheck;
+    nodesToCheck.push_back(0);
+
+    while (!nodesToCheck.empty())
+    {
+        const auto& node = m_nodes[nodesToCheck.pop()];
+
+        if (!node.isLeaf())
+        {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                Point boundsMin;
+                Point boundsMax;
+                getLooseBounds(m_nodes[node.firstChild + i], boundsMin, boundsMax);
+                if (isRectanglesOverlap(areaBottomLeft, areaTopRight, boundsMin, boundsMax))
+                {
+                    nodesToCheck.push_back(node.firstChild + i);
+                }
+            }
+        }
+
+        const auto count = node.count;
+        if (count == 0)
+        {
+            continue;
+        }
+
+        const auto capacity = node.capacity;
+        const auto* minX = m_slots.bounds.data() + 4 * size_t(node.firstSlot);
+        const auto* minY = minX + capacity;
+        const auto* maxX = minY + capacity;
+        const auto* maxY = maxX + capacity;
+        const auto* ids = m_slots.references.data() + 2 * size_t(node.firstSlot);
+
+        // capacity is a multiple of LEAF_SCAN_WIDTH, so the kernel stays inside the block
+        for (uint32_t first = 0; first < count; first += LEAF_SCAN_WIDTH)
+        {
+            auto mask = getOverlapMask(minX + first,
+                                       minY + first,
+                                       maxX + first,
+                                       maxY + first,
+                                       areaBottomLeft,
+                                       areaTopRight);
+            if (count - first < LEAF_SCAN_WIDTH)
+            {
+                mask &= (1u << (count - first)) - 1;
+            }
+
+            while (mask != 0)
+            {
+                const auto i = first + static_cast<uint32_t>(std::countr_zero(mask));
+                mask &= mask - 1;
+                if (!callback(ids[i], Point(minX[i], minY[i]), Point(maxX[i], maxY[i])))
+                {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+template<typename Container>
+void LooseQuadtree::findObjectsInArea(Point areaBottomLeft,
+                                      Point areaTopRight,
+                                      Container& ids) const
+{
+    forEachObjectInArea(areaBottomLeft,
+                        areaTopRight,
+                        [&ids](const Id& id, Point, Point)
+                        {
+                            ids.push_back(id);
+                            return true;
+                        });
+}
+
+template<typename QuadsObserver>
+void LooseQuadtree::traverseQuads(QuadsObserver&& quadsObserver) const
+{
+    std::queue<uint32_t> nodes;
+    nodes.push(0);
+
+    while (!nodes.empty())
+    {
+        const auto& node = m_nodes[nodes.front()];
+        nodes.pop();
+
+        quadsObserver(node.bottomLeft, node.size);
+
+        if (!node.isLeaf())
+        {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                nodes.push(node.firstChild + i);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,305 @@
+﻿#include "PointQuadtree.h"
+
+#include <algorithm>
+
+namespace light
+{
+
+namespace
+{
+
+// Smallest block of slots owned by a leaf, the same as in Quadtree.
+constexpr uint32_t MIN_LEAF_CAPACITY = LEAF_SCAN_WIDTH;
+
+}
+
+PointQuadtree::PointQuadtree(Point areaBottomLeft,
+                             Point areaTopRight,
+                             int maxElementsPerNode,
+                             int maxDepth)
+  : m_freeNode{ NIL }
+  , m_areaBottomLeft{ areaBottomLeft }
+  , m_areaTopRight{ areaTopRight }
+  , m_maxElementsPerNode{ maxElementsPerNode }
+  , m_maxDepth{ maxDepth }
+{
+    initRoot();
+}
+
+size_t PointQuadtree::size() const
+{
+    return m_pointLeaves.size();
+}
+
+void PointQuadtree::clear()
+{
+    m_quadNodes.clear();
+    m_slots.positions.clear();
+    m_slots.references.clear();
+    m_freeSlots.clear();
+    m_pointLeaves.clear();
+    m_freeNode = NIL;
+    initRoot();
+}
+
+uint32_t PointQuadtree::insert(Point position, Id id)
+{
+    // negated, so NaNs are rejected too
+    if (!(position.x >= m_areaBottomLeft.x && position.y >= m_areaBottomLeft.y &&
+          position.x <= m_areaTopRight.x && position.y <= m_areaTopRight.y))
+    {
+        return NIL;
+    }
+
+    const auto pointIndex = m_pointLeaves.push_back(NIL);
+
+    uint32_t quadIndex = 0;
+    int depth = 0;
+    auto bottomLeft = m_areaBottomLeft;
+    auto size = m_areaTopRight - m_areaBottomLeft;
+    while (true)
+    {
+        const auto& quad = m_quadNodes[quadIndex];
+        if (quad.isLeaf())
+        {
+            if (quad.count < static_cast<uint32_t>(m_maxElementsPerNode) || depth == m_maxDepth)
+            {
+                appendToLeaf(quadIndex, position, id, pointIndex);
+                return pointIndex;
+            }
+            subdivide(quadIndex, bottomLeft, size);
+        }
+
+        size *= 0.5f;
+        const auto quadrant = getQuadrant(position, bottomLeft + size);
+        bottomLeft = getQuadrantBottomLeft(bottomLeft, size, quadrant);
+        quadIndex = m_quadNodes[quadIndex].firstChild + quadrant;
+        ++depth;
+    }
+}
+
+void PointQuadtree::remove(uint32_t index)
+{
+    const auto leafIndex = m_pointLeaves[index];
+    auto& leaf = m_quadNodes[leafIndex];
+    auto* x = m_slots.positions.data() + 2 * size_t(leaf.firstChild);
+    auto* y = x + leaf.capacity;
+    auto* ids = m_slots.references.data() + 2 * size_t(leaf.firstChild);
+    auto* pointIndices = ids + leaf.capacity;
+
+    const auto offset = static_cast<uint32_t>(
+      std::find(pointIndices, pointIndices + leaf.count, index) - pointIndices);
+    const Point position{ x[offset], y[offset] };
+
+    // the last point takes place of the removed one
+    --leaf.count;
+    x[offset] = x[leaf.count];
+    y[offset] = y[leaf.count];
+    ids[offset] = ids[leaf.count];
+    pointIndices[offset] = pointIndices[leaf.count];
+    if (leaf.count == 0)
+    {
+        freeSlots(leaf.firstChild, leaf.capacity);
+        leaf.firstChild = NIL;
+        leaf.capacity = 0;
+    }
+    m_pointLeaves.erase(index);
+
+    // branches on the way to the leaf are merged from the deepest one, parent of a branch which
+    // stays can't be merged either
+    FastArray<uint32_t> branches;
+    uint32_t quadIndex = 0;
+    auto bottomLeft = m_areaBottomLeft;
+    auto size = m_areaTopRight - m_areaBottomLeft;
+    while (quadIndex != leafIndex)
+    {
+        branches.push_back(quadIndex);
+        size *= 0.5f;
+        const auto quadrant = getQuadrant(position, bottomLeft + size);
+        bottomLeft = getQuadrantBottomLeft(bottomLeft, size, quadrant);
+        quadIndex = m_quadNodes[quadIndex].firstChild + quadrant;
+    }
+
+    while (!branches.empty() && tryMerge(branches.pop()))
+    {
+    }
+}
+
+void PointQuadtree::initRoot()
+{
+    QuadNode root;
+    root.count = 0;
+    root.firstChild = NIL;
+    root.capacity = 0;
+    m_quadNodes.push_back(root);
+}
+
+void PointQuadtree::subdivide(uint32_t leafIndex, Point bottomLeft, Point size)
+{
+    const auto leaf = m_quadNodes[leafIndex];
+
+    QuadNode emptyLeaf;
+    emptyLeaf.count = 0;
+    emptyLeaf.firstChild = NIL;
+    emptyLeaf.capacity = 0;
+
+    uint32_t firstChild = m_freeNode;
+    if (firstChild == NIL)
+    {
+        firstChild = m_quadNodes.push_back(emptyLeaf);
+        m_quadNodes.push_back(emptyLeaf);
+        m_quadNodes.push_back(emptyLeaf);
+        m_quadNodes.push_back(emptyLeaf);
+    }
+    else
+    {
+        // reuse block of 4 nodes freed by merge
+        m_freeNode = m_quadNodes[firstChild].firstChild;
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            m_quadNodes[firstChild + i] = emptyLeaf;
+        }
+    }
+
+    auto& branch = m_quadNodes[leafIndex];
+    branch.firstChild = firstChild;
+    branch.count = NIL;
+    branch.capacity = 0;
+
+    // slots are read by index, as appending to children may reallocate them
+    const auto center = bottomLeft + size * 0.5f;
+    const auto positionsBegin = 2 * size_t(leaf.firstChild);
+    for (uint32_t i = 0; i < leaf.count; ++i)
+    {
+        const Point position{ m_slots.positions[positionsBegin + i],
+                              m_slots.positions[positionsBegin + leaf.capacity + i] };
+        appendToLeaf(firstChild + getQuadrant(position, center),
+                     position,
+                     m_slots.references[positionsBegin + i],
+                     m_slots.references[positionsBegin + leaf.capacity + i]);
+    }
+    if (leaf.capacity != 0)
+    {
+        freeSlots(leaf.firstChild, leaf.capacity);
+    }
+}
+
+uint32_t PointQuadtree::allocateSlots(uint32_t capacity)
+{
+    const auto sizeClass = static_cast<uint32_t>(std::countr_zero(capacity));
+    if (sizeClass < m_freeSlots.size() && m_freeSlots[sizeClass] != NIL)
+    {
+        const auto firstSlot = m_freeSlots[sizeClass];
+        m_freeSlots[sizeClass] = m_slots.references[2 * size_t(firstSlot)];
+        return firstSlot;
+    }
+
+    const auto firstSlot = static_cast<uint32_t>(m_slots.references.size() / 2);
+    m_slots.positions.resize(m_slots.positions.size() + 2 * size_t(capacity));
+    m_slots.references.resize(m_slots.references.size() + 2 * size_t(capacity));
+    return firstSlot;
+}
+
+void PointQuadtree::freeSlots(uint32_t firstSlot, uint32_t capacity)
+{
+    const auto sizeClass = static_cast<uint32_t>(std::countr_zero(capacity));
+    if (m_freeSlots.size() <= sizeClass)
+    {
+        m_freeSlots.resize(sizeClass + 1, NIL);
+    }
+    m_slots.references[2 * size_t(firstSlot)] = m_freeSlots[sizeClass];
+    m_freeSlots[sizeClass] = firstSlot;
+}
+
+void PointQuadtree::appendToLeaf(uint32_t leafIndex, Point position, Id id, uint32_t pointIndex)
+{
+    auto& leaf = m_quadNodes[leafIndex];
+
+    if (leaf.count == leaf.capacity)
+    {
+        const auto oldLeaf = leaf;
+        leaf.capacity = std::max(std::bit_ceil(leaf.capacity + 1), MIN_LEAF_CAPACITY);
+        leaf.firstChild = allocateSlots(leaf.capacity);
+        const auto from = 2 * size_t(oldLeaf.firstChild);
+        const auto to = 2 * size_t(leaf.firstChild);
+        for (uint32_t i = 0; i < leaf.count; ++i)
+        {
+            m_slots.positions[to + i] = m_slots.positions[from + i];
+            m_slots.positions[to + leaf.capacity + i] =
+              m_slots.positions[from + oldLeaf.capacity + i];
+            m_slots.references[to + i] = m_slots.references[from + i];
+            m_slots.references[to + leaf.capacity + i] =
+              m_slots.references[from + oldLeaf.capacity + i];
+        }
+        if (oldLeaf.capacity != 0)
+        {
+            freeSlots(oldLeaf.firstChild, oldLeaf.capacity);
+        }
+    }
+
+    const auto slot = 2 * size_t(leaf.firstChild) + leaf.count;
+    m_slots.positions[slot] = position.x;
+    m_slots.positions[slot + leaf.capacity] = position.y;
+    m_slots.references[slot] = id;
+    m_slots.references[slot + leaf.capacity] = pointIndex;
+    ++leaf.count;
+
+    m_pointLeaves[pointIndex] = leafIndex;
+}
+
+bool PointQuadtree::tryMerge(uint32_t branchIndex)
+{
+    const auto firstChild = m_quadNodes[branchIndex].firstChild;
+
+    uint32_t totalCount = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const auto& child = m_quadNodes[firstChild + i];
+        if (child.isBranch())
+        {
+            return false;
+        }
+        totalCount += child.count;
+    }
+
+    if (totalCount >= static_cast<uint32_t>(m_maxElementsPerNode))
+    {
+        return false;
+    }
+
+    QuadNode merged;
+    merged.count = 0;
+    merged.capacity = totalCount == 0 ? 0 : std::max(std::bit_ceil(totalCount), MIN_LEAF_CAPACITY);
+    merged.firstChild = totalCount == 0 ? NIL : allocateSlots(merged.capacity);
+
+    const auto to = 2 * size_t(merged.firstChild);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const auto child = m_quadNodes[firstChild + i];
+        const auto from = 2 * size_t(child.firstChild);
+        for (uint32_t offset = 0; offset < child.count; ++offset)
+        {
+            const auto pointIndex = m_slots.references[from + child.capacity + offset];
+            m_slots.positions[to + merged.count] = m_slots.positions[from + offset];
+            m_slots.positions[to + merged.capacity + merged.count] =
+              m_slots.positions[from + child.capacity + offset];
+            m_slots.references[to + merged.count] = m_slots.references[from + offset];
+            m_slots.references[to + merged.capacity + merged.count] = pointIndex;
+            m_pointLeaves[pointIndex] = branchIndex;
+            ++merged.count;
+        }
+
+        if (child.capacity != 0)
+        {
+            freeSlots(child.firstChild, child.capacity);
+        }
+    }
+
+    m_quadNodes[branchIndex] = merged;
+
+    m_quadNodes[firstChild].firstChild = m_freeNode;
+    m_freeNode = firstChild;
+    return true;
+}
+
+}
@@ -0,0 +1,263 @@
+﻿#pragma once
+
+#include <light/FastArray.h>
+#include <light/FreeList.h>
+#include <light/LeafScan.h>
+#include <light/Quadtree.h>
+
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace light
+{
+
+/**
+ * @brief Quadtree specialized for points. Every point is stored in exactly one leaf, chosen with
+ * a single quadrant computation per level, so queries never meet copies of the same point.
+ * Point takes a leaf slot of its position, Id and index and the index of its leaf, compared to
+ * rectangle bounds, slots of all leaves overlapped and update bounds in Quadtree.
+ */
+class PointQuadtree
+{
+public:
+    /**
+     * @brief Constructs an empty PointQuadtree for specified 2D area.
+     * @param areaBottomLeft Bottom left corner of work area.
+     * @param areaTopRight Top right corner of work area.
+     * @param maxElementsPerNode Maximum amount of points that can be stored in quad node before
+     * it will be splitted. Quad won't be splitted anymore when maxDepth is reached.
+     * @param maxDepth Max depth of nested quad nodes.
+     */
+    PointQuadtree(Point areaBottomLeft,
+                  Point areaTopRight,
+                  int maxElementsPerNode = 8,
+                  int maxDepth = 8);
+
+    size_t size() const;
+
+    void clear();
+
+    /**
+     * @brief Inserts point into the quadtree.
+     * @return Index of the inserted point which can be used to remove it later, or NIL if point
+     * lies outside of work area.
+     */
+    uint32_t insert(Point position, Id id);
+
+    /**
+     * @brief Removes point from its leaf. Sibling leaves whose combined count drops below
+     * maxElementsPerNode are merged back into their parent.
+     * @param index Index of the point returned by insert.
+     */
+    void remove(uint32_t index);
+
+    using IteratePointsCallback = std::function<bool(const Id& id, Point position)>;
+
+    /**
+     * @brief Calls callback once for every point inside specified area. Points lying on sides
+     * of the area are not reported, the same as degenerate rectangles in Quadtree.
+     * @tparam Callback Any callable with signature of IteratePointsCallback, it's inlined into
+     * the leaf loop. Iteration stops when callback returns false.
+     */
+    template<typename Callback>
+    void forEachPointInArea(Point areaBottomLeft, Point areaTopRight, Callback&& callback) const;
+
+    /**
+     * @brief Appends Ids of points inside specified area to the container.
+     * @tparam Container Container of Ids with push_back, e.g. std::vector<Id>.
+     */
+    template<typename Container>
+    void findPointsInArea(Point areaBottomLeft, Point areaTopRight, Container& ids) const;
+
+    using TraverseQuadCallback = std::function<void(const Point& bottomLeft, const Point& size)>;
+
+    /**
+     * @brief Function for traversing quads to visualize them.
+     * @tparam QuadsObserver Any callable with signature of TraverseQuadCallback.
+     */
+    template<typename QuadsObserver>
+    void traverseQuads(QuadsObserver&& quadsObserver) const;
+
+private:
+    struct TraverseQuadData
+    {
+        uint32_t quadIndex;
+        Point bottomLeft;
+        Point size;
+    };
+
+    // Points of leaves in structure of arrays form. Every leaf owns a block of capacity C
+    // starting at slot S: x of its points at [2 * S, 2 * S + C) of positions and y at
+    // [2 * S + C, 2 * S + 2 * C), Ids of the points at [2 * S, 2 * S + C) of references and
+    // indices of the points after them. Free block stores the first slot of the next free block
+    // of the same capacity at 2 * S of references.
+    struct LeafSlots
+    {
+        std::vector<float> positions;
+        std::vector<uint32_t> references;
+    };
+
+    // Quadrant of the quad with the center containing the point, numbered as in Quadtree: bit 0
+    // is set for the right half and bit 1 for the bottom one. Points lying on a center line
+    // belong to the right (top) quadrants.
+    static uint32_t getQuadrant(Point position, Point center);
+
+    static Point getQuadrantBottomLeft(Point quadBottomLeft, Point subQuadSize, uint32_t quadrant);
+
+    void initRoot();
+
+    // Turns the leaf into branch, moving its points to the new children.
+    void subdivide(uint32_t leafIndex, Point bottomLeft, Point size);
+
+    // Same as in Quadtree, blocks have power of two capacities.
+    uint32_t allocateSlots(uint32_t capacity);
+
+    void freeSlots(uint32_t firstSlot, uint32_t capacity);
+
+    // Appends point to the leaf, moving its slots to a bigger block if it's full.
+    void appendToLeaf(uint32_t leafIndex, Point position, Id id, uint32_t pointIndex);
+
+    // Turns branch back into leaf if all its children are leaves and they store less than
+    // maxElementsPerNode points in total. Freed children are pushed to the free nodes chain.
+    // Returns false if branch stays.
+    bool tryMerge(uint32_t branchIndex);
+
+    FreeList<QuadNode> m_quadNodes;
+    LeafSlots m_slots;
+    // First slots of free blocks chains, block of k-th chain has 2^k slots.
+    std::vector<uint32_t> m_freeSlots;
+    // Leaf storing the point, indexed by point index.
+    FreeList<uint32_t> m_pointLeaves;
+    // Index of the first node in the chain of freed blocks of 4 nodes. Free blocks are linked
+    // through firstChild of their first node.
+    uint32_t m_freeNode;
+
+    Point m_areaBottomLeft;
+    Point m_areaTopRight;
+    int m_maxElementsPerNode;
+    int m_maxDepth;
+};
+
+inline uint32_t PointQuadtree::getQuadrant(Point position, Point center)
+{
+    return uint32_t(position.x >= center.x) | (uint32_t(position.y < center.y) << 1);
+}
+
+inline Point PointQuadtree::getQuadrantBottomLeft(Point quadBottomLeft,
+                                                  Point subQuadSize,
+                                                  uint32_t quadrant)
+{
+    return quadBottomLeft + Point((quadrant & 1u) ? subQuadSize.x : 0,
+                                  (quadrant & 2u) ? 0 : subQuadSize.y);
+}
+
+template<typename Callback>
+void PointQuadtree::forEachPointInArea(Point areaBottomLeft,
+                                       Point areaTopRight,
+                                       Callback&& callback) const
+{
+    FastArray<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quadsToCheck.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        if (quad.isBranch())
+        {
+            // a child is visited if the area contains points of its half-open region
+            const auto subQuadSize = size * 0.5f;
+            const auto center = bottomLeft + subQuadSize;
+            const bool isLeft = areaBottomLeft.x < center.x;
+            const bool isRight = areaTopRight.x > center.x;
+            const bool isTop = areaTopRight.y > center.y;
+            const bool isBottom = areaBottomLeft.y < center.y;
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                if (((quadrant & 1u) ? isRight : isLeft) && ((quadrant & 2u) ? isBottom : isTop))
+                {
+                    quadsToCheck.push_back(
+                      { quad.firstChild + quadrant,
+                        getQuadrantBottomLeft(bottomLeft, subQuadSize, quadrant),
+                        subQuadSize });
+                }
+            }
+            continue;
+        }
+
+        const auto count = quad.count;
+        const auto capacity = quad.capacity;
+        const auto* x = m_slots.positions.data() + 2 * size_t(quad.firstChild);
+        const auto* y = x + capacity;
+        const auto* ids = m_slots.references.data() + 2 * size_t(quad.firstChild);
+
+        // point is a degenerate rectangle for the kernel, capacity is a multiple of
+        // LEAF_SCAN_WIDTH, so it stays inside the block
+        for (uint32_t first = 0; first < count; first += LEAF_SCAN_WIDTH)
+        {
+            auto mask = getOverlapMask(
+              x + first, y + first, x + first, y + first, areaBottomLeft, areaTopRight);
+            if (count - first < LEAF_SCAN_WIDTH)
+            {
+                mask &= (1u << (count - first)) - 1;
+            }
+
+            while (mask != 0)
+            {
+                const auto i = first + static_cast<uint32_t>(std::countr_zero(mask));
+                mask &= mask - 1;
+                if (!callback(ids[i], Point(x[i], y[i])))
+                {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+template<typename Container>
+void PointQuadtree::findPointsInArea(Point areaBottomLeft,
+                                     Point areaTopRight,
+                                     Container& ids) const
+{
+    forEachPointInArea(areaBottomLeft,
+                       areaTopRight,
+                       [&ids](const Id& id, Point)
+                       {
+                           ids.push_back(id);
+                           return true;
+                       });
+}
+
+template<typename QuadsObserver>
+void PointQuadtree::traverseQuads(QuadsObserver&& quadsObserver) const
+{
+    std::queue<TraverseQuadData> quads;
+    quads.push({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quads.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quads.front();
+        quads.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        quadsObserver(bottomLeft, size);
+
+        if (quad.isBranch())
+        {
+            const auto subQuadSize = size * 0.5f;
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                quads.push({ quad.firstChild + quadrant,
+                             getQuadrantBottomLeft(bottomLeft, subQuadSize, quadrant),
+                             subQuadSize });
+            }
+        }
+    }
+}
+
+}
@@ -2,45 +2,56 @@
 
 #include <light/FastArray.h>
 #include <light/FreeList.h>
+#include <light/LeafScan.h>
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <cstdint>
+#include <bit>
+#include <cmath>
 #include <functional>
+#include <limits>
 #include <queue>
+#include <span>
 #include <stack>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace light
 {
 using Point = glm::vec2;
 using Id = uint32_t;
 
+class ThreadPool;
+class QuadtreeWriter;
+
+// Value of LeafCapacity and MaxDepth parameters of BasicQuadtree which are specified at runtime,
+// in constructor.
+constexpr uint32_t DYNAMIC_EXTENT = 0;
+
 // Representation of actual value we want to store.
-struct QuadElement
+template<typename Scalar, typename Payload>
+struct BasicQuadElement
 {
     // Outer Id of the element.
-    Id id;
+    Payload id;
 
     // Extents of the current element.
-    Point bottomLeft;
-    Point topRight;
+    glm::vec<2, Scalar> bottomLeft;
+    glm::vec<2, Scalar> topRight;
 };
 
-// Represents a reference to QuadElement.
-struct QuadElementNode
-{
-    // Points to the next QuadElementNode in the leaf node.
-    // A value of -1 indicates the end of the list.
-    uint32_t next;
+using QuadElement = BasicQuadElement<float, Id>;
 
-    // Stores the index of the QuadElement.
-    uint32_t quadElementIndex;
-};
+// Leaf of element stored in several leaves, see BasicQuadtree::m_elementLeaves.
+constexpr auto MULTIPLE_LEAVES = NIL - 1;
 
 struct QuadNode
 {
     // Points to the first child (QuadNode) if this node is a branch or the first
-    // element (QuadElementNode) if this node is a leaf.
+    // element slot if this node is a leaf.
     // This is index of .
     uint32_t firstChild;
 
@@ -48,71 +59,1928 @@ struct QuadNode
     // not a leaf.
     uint32_t count;
 
+    // Number of element slots owned by the leaf, starting at firstChild.
+    uint32_t capacity;
+
     inline bool isBranch() const { return count == NIL; }
 
     inline bool isLeaf() const { return !isBranch(); }
 };
 
-bool isRectanglesOverlap(light::Point rectBottomLeft1,
-                         light::Point rectTopRight1,
-                         light::Point rectBottomLeft2,
-                         light::Point rectTopRight2);
+inline bool isRectanglesOverlap(light::Point rectBottomLeft1,
+                                light::Point rectTopRight1,
+                                light::Point rectBottomLeft2,
+                                light::Point rectTopRight2)
+{
+    return rectTopRight2.x > rectBottomLeft1.x && rectTopRight2.y > rectBottomLeft1.y &&
+           rectBottomLeft2.x < rectTopRight1.x && rectBottomLeft2.y < rectTopRight1.y;
+}
+
+// Axis aligned rectangle.
+template<typename Scalar>
+struct BasicAABB
+{
+    glm::vec<2, Scalar> bottomLeft;
+    glm::vec<2, Scalar> topRight;
+};
+
+using AABB = BasicAABB<float>;
 
-class Quadtree
+// Results of batched area queries in compressed sparse row form: Ids of elements found in the
+// i-th area are stored at [offsets[i], offsets[i + 1]) of ids.
+template<typename Payload, typename QueryContext>
+struct BasicQueryBatchResults
+{
+    std::vector<uint32_t> offsets;
+    std::vector<Payload> ids;
+
+    // Scratch of the batch kept between batches to reuse its memory: Ids found and traversal
+    // stack used by every thread of the pool, and the thread which queried every chunk of areas
+    // with the position of the chunk Ids in its buffer.
+    std::vector<std::vector<Payload>> threadIds;
+    std::vector<QueryContext> threadContexts;
+    std::vector<std::pair<uint32_t, size_t>> chunkSources;
+};
+
+// Counters of the work done by a query, they are accumulated over the queries they are passed to.
+struct QueryStats
+{
+    // Reports of elements skipped because they were already reported from another leaf.
+    uint64_t suppressedDuplicates = 0;
+    // Branches and leaves taken from the traversal stack.
+    uint64_t nodesVisited = 0;
+};
+
+/**
+ * @brief Quadtree of rectangles with storage and limits configured at compile time.
+ * @tparam Scalar Type of coordinates: float, double or an integer type for fixed point
+ * coordinates. Quads of integer trees are halved rounding down, so they are exact if sides of
+ * work area are divisible by 2^maxDepth. Distances and ray parameters are computed in Real.
+ * @tparam LeafCapacity maxElementsPerNode known at compile time, or DYNAMIC_EXTENT to specify
+ * it in constructor. Scans of leaves not bigger than known capacity have a constant trip count.
+ * @tparam MaxDepth maxDepth known at compile time, or DYNAMIC_EXTENT to specify it in
+ * constructor. Traversal stacks of trees with known depth are sized exactly from it and never
+ * allocate.
+ * @tparam Payload Trivially copyable Id of elements reported by queries.
+ */
+template<typename Scalar = float,
+         uint32_t LeafCapacity = DYNAMIC_EXTENT,
+         uint32_t MaxDepth = DYNAMIC_EXTENT,
+         typename Payload = Id>
+class BasicQuadtree
 {
 public:
+    using Point = glm::vec<2, Scalar>;
+    // Type of distances and ray parameters, floating point even for integer coordinates.
+    using Real = std::conditional_t<std::is_floating_point_v<Scalar>, Scalar, double>;
+    using RealPoint = glm::vec<2, Real>;
+    using QuadElement = BasicQuadElement<Scalar, Payload>;
+    using AABB = BasicAABB<Scalar>;
+    class QueryContext;
+    using QueryBatchResults = BasicQueryBatchResults<Payload, QueryContext>;
+
     /**
      * @brief Constructs an empty Quadtree for specified 2D area.
      * @param areaBottomLeft Bottom left corner of work area.
      * @param areaTopRight Top right corner of work area.
      * @param maxElementsPerNode Maximum amount of elements that can be stored in quad node before
-     * it will be splitted. Quad won't be splitted anymore when maxDepth is reached.
-     * @param maxDepth Max depth of nested quad nodes.
+     * it will be splitted. Quad won't be splitted anymore when maxDepth is reached. Ignored if
+     * LeafCapacity is specified.
+     * @param maxDepth Max depth of nested quad nodes. Ignored if MaxDepth is specified.
+     * @param keepNodeBounds Whether every node keeps bounds of elements stored below it, so
+     * area queries skip nodes whose content misses the area even if their quads overlap it.
+     * Bounds are refitted by build and remove, insert and update only grow them.
      */
-    Quadtree(Point areaBottomLeft,
-             Point areaTopRight,
-             int maxElementsPerNode = 8,
-             int maxDepth = 8);
+    BasicQuadtree(Point areaBottomLeft,
+                  Point areaTopRight,
+                  int maxElementsPerNode = 8,
+                  int maxDepth = 8,
+                  bool keepNodeBounds = false);
 
     size_t size() const;
 
+    /**
+     * @brief Approximate bytes taken by storage of the quadtree. Lists of elements and nodes
+     * are counted by their ranges.
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * @brief Presizes storage for inserting specified count of elements one by one, so inserts
+     * don't pay for repeated growth of arrays. Counts of nodes and slots are estimated for
+     * elements uniformly distributed over work area, build() sizes them exactly by itself.
+     */
     void reserve(size_t capacity);
 
     void clear();
 
-    bool insert(Point rectBottomLeft, Point rectTopRight, Id id);
+    /**
+     * @brief Rewrites nodes and leaf slots in depth-first order, dropping free blocks left by
+     * removals and merges and trimming leaf blocks the same as build() does. After churn queries
+     * walk memory of a subtree mostly sequentially again. Element indices stay valid.
+     */
+    void compact();
+
+    using RemapElementCallback = std::function<void(uint32_t oldIndex, uint32_t newIndex)>;
+
+    /**
+     * @brief Compacts nodes and slots as compact() does and moves elements into a dense prefix
+     * of their list, so indices of removed elements are reused and the list shrinks.
+     * @tparam RemapCallback Any callable with signature of RemapElementCallback.
+     * @param remapElement Called for every element whose index changed, the old index must be
+     * replaced by the new one for later remove and update.
+     */
+    template<typename RemapCallback>
+    void compact(RemapCallback&& remapElement);
+
+    /**
+     * @brief Replaces content of the quadtree with specified elements. Elements are sorted by
+     * Morton code of their centers once and distributed over quads top-down, so no leaf is
+     * ever splitted and reinserted.
+     * @param elements Elements to store. Ill-formed rectangles and rectangles outside of work
+     * area are skipped, others get indices in the order they are specified in.
+     */
+    void build(std::span<const QuadElement> elements);
+
+    /**
+     * @brief Parallel version of build producing the same tree. Quads are split serially down
+     * to the depth having several times more quads than there are threads in the pool, then
+     * subtrees below it are built on the threads into storages of their own and stitched into
+     * the tree.
+     */
+    void build(std::span<const QuadElement> elements, ThreadPool& pool);
 
+    /**
+     * @brief Inserts rectangle element into the quadtree.
+     * @return Index of the inserted element which can be used to remove it later, or NIL if
+     * rectangle is ill-formed or lies outside of work area. 0 is a valid index, so the result is
+     * compared with NIL rather than converted to bool.
+     */
+    [[nodiscard]] uint32_t insert(Point rectBottomLeft, Point rectTopRight, Payload id);
+
+    /**
+     * @brief Removes element from all leaves it is stored in. Sibling leaves whose combined
+     * elements count drops under maxElementsPerNode are merged back into their parent.
+     * @param index Index of the element returned by insert. Indices of no stored element, like
+     * NIL or index of removed element, are ignored.
+     */
     void remove(uint32_t index);
 
+    /**
+     * @brief Moves element to new extents. If element stays in the same leaves, only its stored
+     * extents are rewritten, otherwise it's relocated to the leaves overlapped by new extents.
+     * @param index Index of the element returned by insert.
+     * @return False if new rectangle is ill-formed or lies outside of work area, or if index
+     * isn't of a stored element. Element is left unchanged in such case.
+     */
+    bool update(uint32_t index, Point newBottomLeft, Point newTopRight);
+
     using IterateObjectsCallback =
-      std::function<bool(const Id& id, Point bottomLeft, Point topRight)>;
+      std::function<bool(const Payload& id, Point bottomLeft, Point topRight)>;
+
+    /**
+     * @brief Calls callback once for every element overlapping specified area. Element stored
+     * in several leaves is reported only from the leaf containing the bottom left corner of its
+     * intersection with the area, so queries don't keep any visited state and can run
+     * concurrently.
+     * @tparam Callback Any callable with signature of IterateObjectsCallback, it's inlined into
+     * the leaf loop. Iteration stops when callback returns false.
+     * @param stats Optional counters the query adds its work to.
+     */
+    template<typename Callback>
+    void forEachObjectInArea(Point areaBottomLeft,
+                             Point areaTopRight,
+                             Callback&& callback,
+                             QueryStats* stats = nullptr) const;
+
+    /**
+     * @brief Appends Ids of elements overlapping specified area to the container, every Id is
+     * appended once.
+     * @tparam Container Container of Ids with push_back, e.g. std::vector<Id>.
+     */
+    template<typename Container>
+    void findObjectsInArea(Point areaBottomLeft,
+                           Point areaTopRight,
+                           Container& ids,
+                           QueryStats* stats = nullptr) const;
 
+    /**
+     * @brief forEachObjectInArea running on the traversal stack of the context, which keeps its
+     * storage between queries, so repeated queries never allocate whatever the max depth.
+     */
+    template<typename Callback>
     void forEachObjectInArea(Point areaBottomLeft,
                              Point areaTopRight,
-                             const IterateObjectsCallback& callback) const;
+                             Callback&& callback,
+                             QueryContext& context,
+                             QueryStats* stats = nullptr) const;
+
+    /**
+     * @brief findObjectsInArea running on the traversal stack of the context, see
+     * forEachObjectInArea.
+     */
+    template<typename Container>
+    void findObjectsInArea(Point areaBottomLeft,
+                           Point areaTopRight,
+                           Container& ids,
+                           QueryContext& context,
+                           QueryStats* stats = nullptr) const;
+
+    /**
+     * @brief Calls callback once for every element overlapping the circle: with distance from
+     * the center to its rectangle less than radius. Quads are pruned by their distance to the
+     * center, quads lying inside the circle are reported with their subtrees without testing
+     * elements. Element stored in several leaves is reported only from the leaf containing the
+     * point of its rectangle nearest to the center.
+     * @tparam Callback Any callable with signature of IterateObjectsCallback. Iteration stops
+     * when callback returns false.
+     */
+    template<typename Callback>
+    void forEachObjectInCircle(Point center,
+                               Real radius,
+                               Callback&& callback,
+                               QueryStats* stats = nullptr) const;
+
+    /**
+     * @brief Calls callback once for every element overlapping interior of the convex polygon.
+     * Quads and elements are tested by separating axes, which are the coordinate axes and
+     * normals of polygon edges. Quads lying inside the polygon are reported with their subtrees
+     * without testing elements. Element stored in several leaves is reported only from the leaf
+     * containing the lowest (then leftmost) point of its intersection with the polygon.
+     * @param polygon Vertices of convex polygon in either winding order. Polygons with less than
+     * 3 vertices or with zero area find nothing.
+     */
+    template<typename Callback>
+    void forEachObjectInPolygon(std::span<const Point> polygon,
+                                Callback&& callback,
+                                QueryStats* stats = nullptr) const;
+
+    /**
+     * @brief Finds elements overlapping every area on threads of the pool. Areas are handed out
+     * to threads in chunks as they finish previous ones, every thread reuses its traversal stack
+     * and output buffer kept in results for all areas it queries in this and next batches.
+     * Quadtree must not be modified meanwhile.
+     * @param results Ids of every area in the same order findObjectsInArea appends them.
+     */
+    void queryBatch(std::span<const AABB> areas,
+                    QueryBatchResults& results,
+                    ThreadPool& pool) const;
+
+    /**
+     * @brief Finds up to k elements nearest to the point, distance to element is the distance to
+     * its rectangle. Quads are visited best-first in the order of distance to them, search stops
+     * once k-th best distance found is not greater than distance to the nearest quad left.
+     * @param ids Ids of found elements are appended to it, the nearest first.
+     * @param maxDistance Elements farther than it are not found.
+     */
+    void nearest(Point point,
+                 size_t k,
+                 std::vector<Payload>& ids,
+                 Real maxDistance = std::numeric_limits<Real>::infinity()) const;
+
+    using RaycastCallback = std::function<bool(const Payload& id, Real t)>;
+
+    /**
+     * @brief Calls callback for every element hit by the ray segment origin + t * direction,
+     * t in [0, maxT], in the order of t at which the ray enters elements. Element touched by
+     * the ray is hit, element containing the origin is hit at t = 0. Only quads the ray crosses
+     * are visited, front to back, and hits are reported as soon as no quad left can contain a
+     * nearer one, so the query returning false on the first hit visits only quads up to it.
+     * @tparam Callback Any callable with signature of RaycastCallback. Iteration stops when
+     * callback returns false.
+     * @param direction Direction of the ray, it doesn't have to be normalized.
+     */
+    template<typename Callback>
+    void raycast(RealPoint origin, RealPoint direction, Real maxT, Callback&& callback) const;
+
+    using IterateOverlappingPairsCallback =
+      std::function<bool(const Payload& id1, const Payload& id2)>;
+
+    /**
+     * @brief Calls callback once for every unordered pair of overlapping elements. Tree is
+     * walked once and elements of every leaf are tested against each other. Pair of elements
+     * stored in several common leaves is reported only from the leaf containing the bottom left
+     * corner of their intersection.
+     * @tparam Callback Any callable with signature of IterateOverlappingPairsCallback. Iteration
+     * stops when callback returns false.
+     */
+    template<typename Callback>
+    void forEachOverlappingPair(Callback&& callback) const;
 
     using TraverseQuadCallback = std::function<void(const Point& bottomLeft, const Point& size)>;
 
     /**
      * @brief Function for traversing quads to visualize them.
-     * @tparam QuadsObserver
+     * @tparam QuadsObserver Any callable with signature of TraverseQuadCallback.
      * @param quadsObserver
      */
-    void traverseQuads(const TraverseQuadCallback& quadsObserver) const;
+    template<typename QuadsObserver>
+    void traverseQuads(QuadsObserver&& quadsObserver) const;
 
 private:
+    // Writes images of the tree's storage for saveQuadtree, see QuadtreeIO.h.
+    friend class QuadtreeWriter;
+
+    // The least and the greatest values of Scalar, infinities if it has them.
+    static constexpr Scalar MIN_SCALAR = std::numeric_limits<Scalar>::has_infinity
+                                           ? -std::numeric_limits<Scalar>::infinity()
+                                           : std::numeric_limits<Scalar>::lowest();
+    static constexpr Scalar MAX_SCALAR = std::numeric_limits<Scalar>::has_infinity
+                                           ? std::numeric_limits<Scalar>::infinity()
+                                           : std::numeric_limits<Scalar>::max();
+    // Build key of element which can't be placed by its Morton code.
+    static constexpr auto IRREGULAR_KEY = std::numeric_limits<uint64_t>::max();
+    // Smallest block of slots owned by a leaf, full blocks are replaced by power of two ones.
+    // Capacities of all blocks are multiples of LEAF_SCAN_WIDTH.
+    static constexpr uint32_t MIN_LEAF_CAPACITY = LEAF_SCAN_WIDTH;
+    // Count of areas queryBatch hands out to a thread at once.
+    static constexpr size_t QUERY_BATCH_CHUNK_SIZE = 64;
+    // Depth first traversal pops a branch and pushes at most 4 of its children, so it holds at
+    // most 3 siblings of the quads on the way to the deepest branch and 4 children of it.
+    static constexpr uint32_t TRAVERSAL_STACK_SIZE =
+      MaxDepth == DYNAMIC_EXTENT ? STACK_ELEMENTS_COUNT : 3 * MaxDepth + 1;
+
+    // Stack of depth first traversals of the tree, never allocates if MaxDepth is known.
+    template<typename T>
+    using TraversalStack = FastArray<T, TRAVERSAL_STACK_SIZE>;
+
+    // Stack on storage big enough for any depth first traversal of the tree, so pushes don't
+    // check for overflow.
+    template<typename T>
+    struct BoundedStack
+    {
+        T* data;
+        uint32_t size;
+
+        inline void push_back(const T& value) { data[size++] = value; }
+
+        inline T pop() { return data[--size]; }
+
+        inline bool empty() const { return size == 0; }
+    };
+
+    struct TraverseQuadData
+    {
+        uint32_t quadIndex;
+        Point bottomLeft;
+        Point size;
+    };
+
+    // Quad queued by nearest and raycast searches.
+    struct BoundedQuadData
+    {
+        // Distance to the quad the search visits quads in the order of: squared distance from
+        // the point for nearest and ray parameter at which the ray enters bounds for raycast.
+        Real distance;
+        TraverseQuadData quad;
+        // Bounds of elements stored in the quad. Sides of quad lying on borders of work area
+        // don't bound them, as elements may stick out of it.
+        RealPoint boundsMin;
+        RealPoint boundsMax;
+    };
+
+    // Ray segment origin + t * direction, t in [0, maxT].
+    struct Ray
+    {
+        RealPoint origin;
+        RealPoint direction;
+        RealPoint inverseDirection;
+        Real maxT;
+    };
+
+    // Shapes of shape queries. Quads are passed to them with bounds of BoundedQuadData, so quads
+    // on borders of work area are unbounded. Methods are called per quad and element, they are
+    // declared inline to be inlined into queries despite the explicit instantiation.
+    struct CircleShape
+    {
+        // Owner point is a clamp, queries compute it for every element without branching.
+        static constexpr bool IS_OWNER_POINT_CHEAP = true;
+
+        RealPoint center;
+        Real squaredRadius;
+
+        // Whether the quad may contain a point of the circle. Owner point of every element
+        // overlapping the circle is inside it, so its quad passes.
+        inline bool isOverlappingQuad(RealPoint quadMin, RealPoint quadMax) const;
+
+        // Whether the closed quad lies in the interior of the circle.
+        inline bool isContainingQuad(RealPoint quadMin, RealPoint quadMax) const;
+
+        inline bool isOverlappingElement(RealPoint rectMin, RealPoint rectMax) const;
+
+        // Point of the element reported from the leaf containing it, the nearest to the center.
+        inline RealPoint getOwnerPoint(RealPoint rectMin, RealPoint rectMax) const;
+    };
+
+    // Edge of convex polygon as a half-plane of points p with dot(normal, p) < offset.
+    struct PolygonEdge
+    {
+        RealPoint normal;
+        Real offset;
+        // Owner point is clipped out of the polygon with rounding, quads are tested against the
+        // half-plane moved outwards by its error bound, so they never miss it.
+        Real tolerance;
+    };
+
+    struct PolygonShape
+    {
+        static constexpr bool IS_OWNER_POINT_CHEAP = false;
+
+        std::span<const RealPoint> vertices;
+        std::span<const PolygonEdge> edges;
+        RealPoint boundsMin;
+        RealPoint boundsMax;
+
+        inline bool isOverlappingQuad(RealPoint quadMin, RealPoint quadMax) const;
+
+        inline bool isContainingQuad(RealPoint quadMin, RealPoint quadMax) const;
+
+        // Rectangle is already known to overlap bounds of the polygon.
+        inline bool isOverlappingElement(RealPoint rectMin, RealPoint rectMax) const;
+
+        // Lowest, then leftmost vertex of the polygon clipped by the element.
+        inline RealPoint getOwnerPoint(RealPoint rectMin, RealPoint rectMax) const;
+    };
+
+    // Ranges within which corners of element can move without changing the set of leaves
+    // it is stored in.
+    struct UpdateBounds
+    {
+        Point bottomLeftMin;
+        Point bottomLeftMax;
+        Point topRightMin;
+        Point topRightMax;
+    };
+
+    static constexpr UpdateBounds EMPTY_UPDATE_BOUNDS{ Point(MAX_SCALAR, MAX_SCALAR),
+                                                       Point(MIN_SCALAR, MIN_SCALAR),
+                                                       Point(MAX_SCALAR, MAX_SCALAR),
+                                                       Point(MIN_SCALAR, MIN_SCALAR) };
+
+    // Bounds of node without elements, they don't overlap anything.
+    static constexpr AABB EMPTY_NODE_BOUNDS{ Point(MAX_SCALAR, MAX_SCALAR),
+                                             Point(MIN_SCALAR, MIN_SCALAR) };
+
+    // Elements of leaves in structure of arrays form. Every leaf owns a block of capacity
+    // slots starting at its firstChild, so its scan is a linear sweep over bounds instead of
+    // walking a linked list. Arrays of a block are kept next to each other, so the leaf data
+    // shares cache lines.
+    struct LeafSlots
+    {
+        // Block starting at slot S stores minX of elements at [4 * S, 4 * S + capacity),
+        // followed by minY, maxX and maxY arrays.
+        std::vector<Scalar> bounds;
+        // Block starting at slot S stores Ids of elements at [S, S + capacity).
+        std::vector<Payload> ids;
+        // Block starting at slot S stores indices of elements at [S, S + capacity). Free block
+        // stores the first slot of the next free block of the same capacity at S.
+        std::vector<uint32_t> elementIndices;
+    };
+
+    struct InsertData
+    {
+        uint32_t elementIndex;
+        uint32_t quadIndex;
+        uint32_t depth;
+        Point bottomLeftBound;
+        Point size;
+    };
+
+    struct BuildData
+    {
+        uint32_t quadIndex;
+        uint32_t depth;
+        Point bottomLeft;
+        Point size;
+        // Range of sorted elements whose centers lie in this quad.
+        uint32_t ownBegin;
+        uint32_t ownEnd;
+        // Range of extra elements in build buffer. These overlap the quad, but their centers lie
+        // outside of it.
+        uint32_t extraBegin;
+        uint32_t extraEnd;
+        // Size of build buffer when this quad was pushed. Everything above belongs to the
+        // already built subtrees and can be dropped.
+        uint32_t bufferSize;
+    };
+
+    // Element prepared for build.
+    struct BuildElement
+    {
+        // Morton code of the element center, two bits per level in the order of quadrants.
+        uint32_t code;
+        uint32_t elementIndex;
+        Payload id;
+        Point bottomLeft;
+        Point topRight;
+    };
+
+    // Elements sorted for build and limits of the tree they are distributed over.
+    struct BuildInput
+    {
+        std::span<const BuildElement> elements;
+        std::span<const uint16_t> straddleLevels;
+        uint32_t codeLevels;
+        uint32_t maxElementsPerNode;
+        uint32_t maxDepth;
+    };
+
+    // Storage quads are built into, leaves get consecutive blocks of slots appended to it.
+    struct BuildOutput
+    {
+        FreeList<QuadNode>& nodes;
+        LeafSlots& slots;
+        // Leaves of elements in the form of m_elementLeaves, not filled if null.
+        std::vector<uint32_t>* elementLeaves;
+    };
+
+    // Quads left to be built as separate subtrees.
+    struct DeferredQuads
+    {
+        uint32_t depth;
+        std::vector<BuildData> quads;
+        // Extra elements of deferred quads, their extra ranges point here.
+        std::vector<uint32_t> extras;
+    };
+
+    // Subtree built by parallel build on its own before it's stitched into the tree.
+    struct BuildSubtree
+    {
+        FreeList<QuadNode> nodes;
+        LeafSlots slots;
+        // Position of nodes following the root and of slots of the subtree in the tree.
+        uint32_t nodesOffset;
+        uint32_t slotsOffset;
+    };
+
+    // maxElementsPerNode and maxDepth, constants if they are known at compile time.
+    uint32_t getMaxElementsPerNode() const;
+
+    uint32_t getMaxDepth() const;
+
+    // Size of children of the quad.
+    static Point getSubQuadSize(Point size);
+
+    // Center of rectangle, computed without overflow for integer coordinates.
+    static Point getCenter(Point rectBottomLeft, Point rectTopRight);
+
+    // Bit i is set if rectangle overlaps quadrant #(i + 1), the same conditions as in insert.
+    static uint32_t getQuadrantsMask(Point rectBottomLeft, Point rectTopRight, Point center);
+
+    // Leaf scan kernel for Scalar, see getOverlapMask.
+    static uint32_t getSlotsOverlapMask(const Scalar* minX,
+                                        const Scalar* minY,
+                                        const Scalar* maxX,
+                                        const Scalar* maxY,
+                                        Point rectBottomLeft,
+                                        Point rectTopRight);
+
+    // Calls function with the first slot and the overlap mask of every LEAF_SCAN_WIDTH slots of
+    // the leaf having overlapping elements, until function returns false. Returns false if the
+    // scan was stopped.
+    template<typename Function>
+    static bool scanLeaf(const Scalar* minX,
+                         const Scalar* minY,
+                         const Scalar* maxX,
+                         const Scalar* maxY,
+                         uint32_t count,
+                         Point rectBottomLeft,
+                         Point rectTopRight,
+                         Function&& function);
+
     void initRoot();
 
+    // Implementation of build, quads below the split depth are built in parallel if there is
+    // a pool.
+    void buildTree(std::span<const QuadElement> elements, ThreadPool* pool);
+
+    // Sorts keys by their higher 32 bits with LSD radix sort, order of equal keys is kept.
+    static void radixSortByHigherHalf(std::vector<uint64_t>& keys);
+
+    // Builds quads top-down starting from root whose extra elements are stored in buffer. If
+    // deferred is specified, quads at its depth are passed to it instead of being built.
+    static void buildQuads(const BuildInput& input,
+                           const BuildData& root,
+                           std::vector<uint32_t>& buffer,
+                           BuildOutput& output,
+                           DeferredQuads* deferred);
+
+    // Inserts already stored element into the leaves it overlaps, subdividing them if needed.
+    void insertElement(uint32_t elementIndex);
+
     bool isValidRectangle(Point rectBottomLeft, Point rectTopRight) const;
 
+    // Implementation of forEachObjectInArea with the traversal stack supplied by caller, it's
+    // expected to be empty.
+    template<typename Callback, typename Stack>
+    void queryArea(Point rectBottomLeft,
+                   Point rectTopRight,
+                   Callback&& callback,
+                   QueryStats* stats,
+                   Stack& quadsToCheck) const;
+
+    // Implementation of shape queries. Elements are tested against the shape's bounding box by
+    // the scan kernel first. Element stored in several leaves is reported from the leaf which
+    // contains the owner point given by the shape, see isOwnerLeaf.
+    template<typename Shape, typename Callback>
+    void queryShape(const Shape& shape,
+                    Point boundsBottomLeft,
+                    Point boundsTopRight,
+                    Callback& callback,
+                    QueryStats* stats) const;
+
+    // Whether element reported from the leaf with point of its closed rectangle is reported
+    // from this leaf. Leaves are half-open as quads in insert, but the point on the right (top)
+    // side of the element belongs to the leaf on the left (bottom) of it, so the leaf always
+    // overlaps the element and stores it.
+    static inline bool isOwnerLeaf(RealPoint point,
+                                   RealPoint rectMin,
+                                   RealPoint rectMax,
+                                   const BoundedQuadData& leaf);
+
+    // Empty stack on storage of the context, grown once to the bound of traversals of the tree.
+    BoundedStack<TraverseQuadData> getTraversalStack(QueryContext& context) const;
+
+    // Lower bound of the bottom left corner of intersections reported from the leaf. Every
+    // intersection lies to the left of (below) all centers it's inserted to the left (bottom)
+    // of, so the leaf contains the corner if it isn't to the left of (below) the leaf. Sides
+    // lying on borders of work area don't bound the corner, as elements may stick out of it.
+    Point getLeafCornerBound(Point leafBottomLeft) const;
+
+    // Root quad, unbounded on all sides.
+    BoundedQuadData getRootQuad() const;
+
+    // Child quad of the branch in the quadrant, with the same numbering as in insert. Distance
+    // is left for the caller.
+    static BoundedQuadData getChildQuad(const BoundedQuadData& parent,
+                                        uint32_t firstChild,
+                                        uint32_t quadrant);
+
+    // Ray parameters at which the ray enters and exits the rectangle, clipped to [0, maxT].
+    // Enter is greater than exit if the ray misses it. Axes the ray is parallel to are tested
+    // separately, so rays lying on a side of a quad don't produce NaNs.
+    static std::pair<Real, Real> getRayInterval(const Ray& ray,
+                                                RealPoint rectBottomLeft,
+                                                RealPoint rectTopRight);
+
+    // Collects indices of leaves overlapped by rectangle. Visited branches are collected too,
+    // parents always precede their children.
+    void collectLeaves(Point rectBottomLeft,
+                       Point rectTopRight,
+                       FastArray<uint32_t>& leaves,
+                       FastArray<uint32_t>& branches) const;
+
+    // Checks whether both rectangles are stored in exactly the same leaves.
+    bool isInSameLeaves(Point rectBottomLeft1,
+                        Point rectTopRight1,
+                        Point rectBottomLeft2,
+                        Point rectTopRight2) const;
+
+    // Computes update bounds of rectangle from the centers of branches it is compared with.
+    UpdateBounds computeUpdateBounds(Point rectBottomLeft, Point rectTopRight) const;
+
+    // Invalidates cached update bounds of element, so the next update takes the slow path.
+    void resetUpdateBounds(uint32_t elementIndex);
+
+    static void expandBounds(AABB& bounds, Point rectBottomLeft, Point rectTopRight);
+
+    // True if node bounds aren't kept or bounds of the node overlap rectangle.
+    bool isOverlappingNodeBounds(uint32_t nodeIndex,
+                                 Point rectBottomLeft,
+                                 Point rectTopRight) const;
+
+    // Recomputes bounds of the node from its slots if it's a leaf or from bounds of its children
+    // if it's a branch.
+    void refitNodeBounds(uint32_t nodeIndex);
+
+    // Recomputes bounds of all nodes after build, children of built nodes follow their parents.
+    void refitAllNodeBounds();
+
+    // Grows bounds of the nodes element is stored under to its current extents.
+    void growNodeBounds(uint32_t elementIndex);
+
+    // Takes block of slots from free blocks if capacity is a power of two, otherwise appends
+    // a new one.
+    uint32_t allocateSlots(uint32_t capacity);
+
+    void freeSlots(uint32_t firstSlot, uint32_t capacity);
+
+    // Index of the element stored in the slot of the leaf.
+    uint32_t getSlotElement(const QuadNode& leaf, uint32_t offset) const;
+
+    // Copies bounds and Id of element into the slot of the leaf.
+    void writeSlot(const QuadNode& leaf, uint32_t offset, uint32_t elementIndex);
+
+    void copySlot(const QuadNode& fromLeaf,
+                  uint32_t fromOffset,
+                  const QuadNode& toLeaf,
+                  uint32_t toOffset);
+
+    // Copies all slots of the leaf to the start of another block, a row of bounds at a time.
+    void copySlots(const QuadNode& fromLeaf, const QuadNode& toLeaf);
+
+    // Appends element to the leaf, moving its slots to a bigger block if it's full.
+    void appendToLeaf(uint32_t leafIndex, uint32_t elementIndex);
+
+    // Removes element from the leaf, its last slot takes place of the removed one.
+    void removeFromLeaf(uint32_t leafIndex, uint32_t elementIndex);
+
+    // Rewrites bounds of element in all slots it is stored in.
+    void rewriteElementSlots(uint32_t elementIndex);
+
+    // Turns branch back into leaf if all its children are leaves and they store less than
+    // maxElementsPerNode elements in total. Freed children are pushed to the free nodes chain.
+    void tryMerge(uint32_t branchIndex);
+
     FreeList<QuadElement> m_elements;
-    FreeList<QuadElementNode> m_elementNodes;
     FreeList<QuadNode> m_quadNodes;
+    LeafSlots m_slots;
+    // First slots of free blocks chains, block of k-th chain has at least 2^k slots.
+    std::vector<uint32_t> m_freeSlots;
+    // Leaf storing the element if it's stored in a single leaf, NIL if it's not stored in any
+    // leaf and MULTIPLE_LEAVES if it's stored (or may be stored) in several leaves. Indexed by
+    // element index.
+    std::vector<uint32_t> m_elementLeaves;
+    // Index of the first node in the chain of freed blocks of 4 nodes. Free blocks are linked
+    // through firstChild of their first node.
     uint32_t m_freeNode;
+    // Update bounds of elements cached by update, indexed by element index.
+    std::vector<UpdateBounds> m_elementUpdateBounds;
+    // Bounds of elements stored under every node, indexed by node index. Empty if node bounds
+    // aren't kept.
+    std::vector<AABB> m_nodeBounds;
+    bool m_keepNodeBounds;
+    // Stack of insert kept between calls, so its storage is allocated once. Empty between them.
+    std::vector<InsertData> m_insertStack;
+
     Point m_areaBottomLeft;
     Point m_areaTopRight;
     int m_maxElementsPerNode;
     int m_maxDepth;
 };
 
+/**
+ * @brief Scratch memory of area queries reused between them. Its traversal stack is sized from
+ * max depth of the tree on the first query, so queries neither allocate nor check the stack for
+ * overflow afterwards. Context is used by one query at a time, e.g. one context per thread, with
+ * any quadtree of the same type.
+ */
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+class BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::QueryContext
+{
+private:
+    friend class BasicQuadtree;
+
+    std::vector<TraverseQuadData> m_quadsToCheck;
+};
+
+/**
+ * @brief Quadtree of float rectangles with Ids of type Id, its limits are specified in
+ * constructor.
+ */
+using Quadtree = BasicQuadtree<>;
+
+using QueryBatchResults = Quadtree::QueryBatchResults;
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getMaxElementsPerNode() const
+{
+    if constexpr (LeafCapacity != DYNAMIC_EXTENT)
+    {
+        return LeafCapacity;
+    }
+    else
+    {
+        return static_cast<uint32_t>(m_maxElementsPerNode);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getMaxDepth() const
+{
+    if constexpr (MaxDepth != DYNAMIC_EXTENT)
+    {
+        return MaxDepth;
+    }
+    else
+    {
+        return static_cast<uint32_t>(m_maxDepth);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getSubQuadSize(Point size) -> Point
+{
+    // exact for floating point, dividing by two is the same as multiplying by one half
+    return size / Scalar(2);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getCenter(
+  Point rectBottomLeft, Point rectTopRight) -> Point
+{
+    if constexpr (std::is_floating_point_v<Scalar>)
+    {
+        return (rectBottomLeft + rectTopRight) / Scalar(2);
+    }
+    else
+    {
+        return rectBottomLeft + (rectTopRight - rectBottomLeft) / Scalar(2);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getQuadrantsMask(
+  Point rectBottomLeft, Point rectTopRight, Point center)
+{
+    // computed without branches, outcomes of comparisons are hardly predictable
+    const uint32_t isLeft = rectBottomLeft.x < center.x;
+    const uint32_t isRight = rectTopRight.x > center.x;
+    const uint32_t isBottom = rectBottomLeft.y < center.y;
+    const uint32_t isTop = rectTopRight.y > center.y;
+    return (isLeft & isTop) | ((isRight & isTop) << 1) | ((isLeft & isBottom) << 2) |
+           ((isRight & isBottom) << 3);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getSlotsOverlapMask(
+  const Scalar* minX,
+  const Scalar* minY,
+  const Scalar* maxX,
+  const Scalar* maxY,
+  Point rectBottomLeft,
+  Point rectTopRight)
+{
+    // SIMD kernels are written for floats, other scalars use the portable one
+    if constexpr (std::is_same_v<Scalar, float>)
+    {
+        return getOverlapMask(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight);
+    }
+    else
+    {
+        return getOverlapMaskScalar(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Function>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::scanLeaf(
+  const Scalar* minX,
+  const Scalar* minY,
+  const Scalar* maxX,
+  const Scalar* maxY,
+  uint32_t count,
+  Point rectBottomLeft,
+  Point rectTopRight,
+  Function&& function)
+{
+    // capacity is a multiple of LEAF_SCAN_WIDTH, so the kernel stays inside the block
+    const auto scanSlots = [&](uint32_t first)
+    {
+        auto mask = getSlotsOverlapMask(
+          minX + first, minY + first, maxX + first, maxY + first, rectBottomLeft, rectTopRight);
+        if (count - first < LEAF_SCAN_WIDTH)
+        {
+            mask &= (1u << (count - first)) - 1;
+        }
+        return mask == 0 || function(first, mask);
+    };
+
+    uint32_t first = 0;
+    if constexpr (LeafCapacity != DYNAMIC_EXTENT)
+    {
+        // only leaves at max depth store more than LeafCapacity elements, so the loop over
+        // others has a constant trip count and is unrolled
+        for (; first < LeafCapacity; first += LEAF_SCAN_WIDTH)
+        {
+            if (first >= count)
+            {
+                return true;
+            }
+            if (!scanSlots(first))
+            {
+                return false;
+            }
+        }
+    }
+
+    for (; first < count; first += LEAF_SCAN_WIDTH)
+    {
+        if (!scanSlots(first))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getLeafCornerBound(
+  Point leafBottomLeft) const -> Point
+{
+    return { leafBottomLeft.x == m_areaBottomLeft.x ? MIN_SCALAR : leafBottomLeft.x,
+             leafBottomLeft.y == m_areaBottomLeft.y ? MIN_SCALAR : leafBottomLeft.y };
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getRootQuad() const -> BoundedQuadData
+{
+    constexpr auto unbounded = std::numeric_limits<Real>::infinity();
+    return { 0,
+             { 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft },
+             RealPoint(-unbounded, -unbounded),
+             RealPoint(unbounded, unbounded) };
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getChildQuad(
+  const BoundedQuadData& parent, uint32_t firstChild, uint32_t quadrant) -> BoundedQuadData
+{
+    const bool isRight = quadrant == 1 || quadrant == 3;
+    const bool isTop = quadrant < 2;
+    const auto subQuadSize = getSubQuadSize(parent.quad.size);
+    const auto center = parent.quad.bottomLeft + subQuadSize;
+
+    BoundedQuadData child;
+    child.quad.quadIndex = firstChild + quadrant;
+    child.quad.bottomLeft = Point(isRight ? center.x : parent.quad.bottomLeft.x,
+                                  isTop ? center.y : parent.quad.bottomLeft.y);
+    child.quad.size = subQuadSize;
+    child.boundsMin = RealPoint(isRight ? Real(center.x) : parent.boundsMin.x,
+                                isTop ? Real(center.y) : parent.boundsMin.y);
+    child.boundsMax = RealPoint(isRight ? parent.boundsMax.x : Real(center.x),
+                                isTop ? parent.boundsMax.y : Real(center.y));
+    return child;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getRayInterval(
+  const Ray& ray, RealPoint rectBottomLeft, RealPoint rectTopRight) -> std::pair<Real, Real>
+{
+    constexpr auto infinity = std::numeric_limits<Real>::infinity();
+    auto tEnter = Real(0);
+    auto tExit = ray.maxT;
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        if (ray.direction[axis] == 0)
+        {
+            if (ray.origin[axis] < rectBottomLeft[axis] || ray.origin[axis] > rectTopRight[axis])
+            {
+                return { infinity, -infinity };
+            }
+            continue;
+        }
+
+        auto tMin = (rectBottomLeft[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+        auto tMax = (rectTopRight[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+        if (ray.direction[axis] < 0)
+        {
+            std::swap(tMin, tMax);
+        }
+        tEnter = std::max(tEnter, tMin);
+        tExit = std::min(tExit, tMax);
+    }
+    return { tEnter, tExit };
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::forEachObjectInArea(
+  Point rectBottomLeft, Point rectTopRight, Callback&& callback, QueryStats* stats) const
+{
+    TraversalStack<TraverseQuadData> quadsToCheck;
+    queryArea(rectBottomLeft, rectTopRight, std::forward<Callback>(callback), stats, quadsToCheck);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::forEachObjectInArea(
+  Point rectBottomLeft,
+  Point rectTopRight,
+  Callback&& callback,
+  QueryContext& context,
+  QueryStats* stats) const
+{
+    auto quadsToCheck = getTraversalStack(context);
+    queryArea(rectBottomLeft, rectTopRight, std::forward<Callback>(callback), stats, quadsToCheck);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getTraversalStack(
+  QueryContext& context) const -> BoundedStack<TraverseQuadData>
+{
+    const auto stackSize = 3 * size_t(getMaxDepth()) + 1;
+    if (context.m_quadsToCheck.size() < stackSize)
+    {
+        context.m_quadsToCheck.resize(stackSize);
+    }
+    return { context.m_quadsToCheck.data(), 0 };
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback, typename Stack>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::queryArea(
+  Point rectBottomLeft,
+  Point rectTopRight,
+  Callback&& callback,
+  QueryStats* stats,
+  Stack& quadsToCheck) const
+{
+    if (!isValidRectangle(rectBottomLeft, rectTopRight))
+    {
+        return;
+    }
+
+    if (isOverlappingNodeBounds(0, rectBottomLeft, rectTopRight))
+    {
+        quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+    }
+
+    while (!quadsToCheck.empty())
+    {
+        const auto currentTraverseData = quadsToCheck.pop();
+        const auto& currentParentQuad = m_quadNodes[currentTraverseData.quadIndex];
+        if (stats)
+        {
+            ++stats->nodesVisited;
+        }
+
+        if (currentParentQuad.isLeaf())
+        {
+            // iterate over values, they are stored contiguously
+            const auto count = currentParentQuad.count;
+            if (count == 0)
+            {
+                continue;
+            }
+
+            const auto capacity = currentParentQuad.capacity;
+            const auto* minX = m_slots.bounds.data() + 4 * size_t(currentParentQuad.firstChild);
+            const auto* minY = minX + capacity;
+            const auto* maxX = minY + capacity;
+            const auto* maxY = maxX + capacity;
+            const auto* ids = m_slots.ids.data() + currentParentQuad.firstChild;
+            // element sticking out of the leaf to the left (bottom) may be reported from
+            // another leaf, see getLeafCornerBound
+            const auto cornerBound = getLeafCornerBound(currentTraverseData.bottomLeft);
+
+            const bool isFinished = scanLeaf(
+              minX,
+              minY,
+              maxX,
+              maxY,
+              count,
+              rectBottomLeft,
+              rectTopRight,
+              [&](uint32_t first, uint32_t mask)
+              {
+                  while (mask != 0)
+                  {
+                      const auto i = first + static_cast<uint32_t>(std::countr_zero(mask));
+                      mask &= mask - 1;
+                      if (std::max(minX[i], rectBottomLeft.x) < cornerBound.x ||
+                          std::max(minY[i], rectBottomLeft.y) < cornerBound.y)
+                      {
+                          if (stats)
+                          {
+                              ++stats->suppressedDuplicates;
+                          }
+                          continue;
+                      }
+                      if (!callback(ids[i], Point(minX[i], minY[i]), Point(maxX[i], maxY[i])))
+                      {
+                          return false;
+                      }
+                  }
+                  return true;
+              });
+            if (!isFinished)
+            {
+                return;
+            }
+        }
+        else
+        {
+            // it's a branch, add to stack quads that overlaps with target area and whose
+            // content does
+
+            const auto currentQuadFirstChild = currentParentQuad.firstChild;
+            const auto subQuadSize = getSubQuadSize(currentTraverseData.size);
+            const auto currentCenter = currentTraverseData.bottomLeft + subQuadSize;
+            const auto currentBottomLeft = currentTraverseData.bottomLeft;
+            const auto isContentOverlapping = [&](uint32_t quadrant)
+            {
+                return isOverlappingNodeBounds(
+                  currentQuadFirstChild + quadrant, rectBottomLeft, rectTopRight);
+            };
+
+            // area of zero width (height) lying on the center goes to the right (top) child,
+            // which contains the corner of its intersections, see getLeafCornerBound
+            const bool isLeft = rectBottomLeft.x < currentCenter.x;
+            const bool isRight =
+              rectTopRight.x > currentCenter.x || rectBottomLeft.x == currentCenter.x;
+            const bool isBottom = rectBottomLeft.y < currentCenter.y;
+            const bool isTop =
+              rectTopRight.y > currentCenter.y || rectBottomLeft.y == currentCenter.y;
+
+            TraverseQuadData subQuadData;
+            subQuadData.size = subQuadSize;
+
+            if (isLeft && isTop && isContentOverlapping(0))
+            {
+                // quadrant #1
+                const auto quad1BottomLeft = currentBottomLeft + Point(0, subQuadSize.y);
+                subQuadData.bottomLeft = quad1BottomLeft;
+                subQuadData.quadIndex = currentQuadFirstChild + 0;
+                quadsToCheck.push_back(subQuadData);
+            }
+            if (isRight && isTop && isContentOverlapping(1))
+            {
+                // quadrant #2;
+                subQuadData.bottomLeft = currentCenter;
+                subQuadData.quadIndex = currentQuadFirstChild + 1;
+                quadsToCheck.push_back(subQuadData);
+            }
+            if (isLeft && isBottom && isContentOverlapping(2))
+            {
+                // quadrant #3
+                subQuadData.bottomLeft = currentBottomLeft;
+                subQuadData.quadIndex = currentQuadFirstChild + 2;
+                quadsToCheck.push_back(subQuadData);
+            }
+            if (isRight && isBottom && isContentOverlapping(3))
+            {
+                // quadrant #4
+                const auto quad4BottomLeft = currentBottomLeft + Point(subQuadSize.x, 0);
+                subQuadData.bottomLeft = quad4BottomLeft;
+                subQuadData.quadIndex = currentQuadFirstChild + 3;
+                quadsToCheck.push_back(subQuadData);
+            }
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Container>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::findObjectsInArea(
+  Point areaBottomLeft, Point areaTopRight, Container& ids, QueryStats* stats) const
+{
+    forEachObjectInArea(
+      areaBottomLeft,
+      areaTopRight,
+      [&ids](const Payload& id, Point, Point)
+      {
+          ids.push_back(id);
+          return true;
+      },
+      stats);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Container>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::findObjectsInArea(
+  Point areaBottomLeft,
+  Point areaTopRight,
+  Container& ids,
+  QueryContext& context,
+  QueryStats* stats) const
+{
+    forEachObjectInArea(
+      areaBottomLeft,
+      areaTopRight,
+      [&ids](const Payload& id, Point, Point)
+      {
+          ids.push_back(id);
+          return true;
+      },
+      context,
+      stats);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::forEachObjectInCircle(
+  Point center, Real radius, Callback&& callback, QueryStats* stats) const
+{
+    const RealPoint realCenter(center);
+    if (!std::isfinite(realCenter.x) || !std::isfinite(realCenter.y) || !std::isfinite(radius) ||
+        !(radius > 0))
+    {
+        return;
+    }
+
+    // bounding box rounded outwards for integer coordinates
+    auto boundsBottomLeft = realCenter - RealPoint(radius, radius);
+    auto boundsTopRight = realCenter + RealPoint(radius, radius);
+    if constexpr (!std::is_floating_point_v<Scalar>)
+    {
+        boundsBottomLeft =
+          RealPoint(std::floor(boundsBottomLeft.x), std::floor(boundsBottomLeft.y));
+        boundsTopRight = RealPoint(std::ceil(boundsTopRight.x), std::ceil(boundsTopRight.y));
+    }
+    const auto toScalar = [](RealPoint point)
+    {
+        const auto min = Real(std::numeric_limits<Scalar>::lowest());
+        const auto max = Real(std::numeric_limits<Scalar>::max());
+        return Point(std::clamp(point.x, min, max), std::clamp(point.y, min, max));
+    };
+
+    const CircleShape circle{ realCenter, radius * radius };
+    queryShape(circle, toScalar(boundsBottomLeft), toScalar(boundsTopRight), callback, stats);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::forEachObjectInPolygon(
+  std::span<const Point> polygon, Callback&& callback, QueryStats* stats) const
+{
+    if (polygon.size() < 3)
+    {
+        return;
+    }
+
+    FastArray<RealPoint, 16> vertices;
+    Point boundsBottomLeft = polygon[0];
+    Point boundsTopRight = polygon[0];
+    Real magnitude = 0;
+    Real doubledArea = 0;
+    for (size_t i = 0; i < polygon.size(); ++i)
+    {
+        const RealPoint vertex(polygon[i]);
+        if (!std::isfinite(vertex.x) || !std::isfinite(vertex.y))
+        {
+            return;
+        }
+        vertices.push_back(vertex);
+        boundsBottomLeft = glm::min(boundsBottomLeft, polygon[i]);
+        boundsTopRight = glm::max(boundsTopRight, polygon[i]);
+        magnitude = std::max({ magnitude, std::abs(vertex.x), std::abs(vertex.y) });
+
+        const RealPoint next(polygon[(i + 1) % polygon.size()]);
+        doubledArea += vertex.x * next.y - next.x * vertex.y;
+    }
+    if (doubledArea == 0)
+    {
+        return;
+    }
+
+    // outward normals are on the right of edges of counterclockwise polygon
+    const Real orientation = doubledArea > 0 ? 1 : -1;
+    FastArray<PolygonEdge, 16> edges;
+    for (uint32_t i = 0; i < vertices.size(); ++i)
+    {
+        const auto edge = vertices[(i + 1) % vertices.size()] - vertices[i];
+        const auto normal = RealPoint(edge.y, -edge.x) * orientation;
+        const auto tolerance = 16 * std::numeric_limits<Real>::epsilon() * magnitude *
+                               (std::abs(normal.x) + std::abs(normal.y));
+        edges.push_back({ normal, glm::dot(normal, vertices[i]), tolerance });
+    }
+
+    const PolygonShape shape{ { vertices.data(), vertices.size() },
+                              { edges.data(), edges.size() },
+                              RealPoint(boundsBottomLeft),
+                              RealPoint(boundsTopRight) };
+    queryShape(shape, boundsBottomLeft, boundsTopRight, callback, stats);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Shape, typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::queryShape(const Shape& shape,
+                                                                      Point boundsBottomLeft,
+                                                                      Point boundsTopRight,
+                                                                      Callback& callback,
+                                                                      QueryStats* stats) const
+{
+    struct ShapeQuadData
+    {
+        BoundedQuadData data;
+        // Whether the quad lies inside the shape, so all elements stored below it overlap it.
+        bool isInside;
+    };
+
+    TraversalStack<ShapeQuadData> quadsToCheck;
+    if (isOverlappingNodeBounds(0, boundsBottomLeft, boundsTopRight))
+    {
+        quadsToCheck.push_back({ getRootQuad(), false });
+    }
+
+    while (!quadsToCheck.empty())
+    {
+        const auto [data, isInside] = quadsToCheck.pop();
+        const auto& quad = m_quadNodes[data.quad.quadIndex];
+        if (stats)
+        {
+            ++stats->nodesVisited;
+        }
+
+        if (quad.isBranch())
+        {
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                if (!isOverlappingNodeBounds(
+                      quad.firstChild + quadrant, boundsBottomLeft, boundsTopRight))
+                {
+                    continue;
+                }
+                const auto child = getChildQuad(data, quad.firstChild, quadrant);
+                // children of quad inside the shape are inside too
+                if (isInside)
+                {
+                    quadsToCheck.push_back({ child, true });
+                }
+                else if (shape.isOverlappingQuad(child.boundsMin, child.boundsMax))
+                {
+                    quadsToCheck.push_back(
+                      { child, shape.isContainingQuad(child.boundsMin, child.boundsMax) });
+                }
+            }
+            continue;
+        }
+
+        const auto count = quad.count;
+        const auto capacity = quad.capacity;
+        const auto* minX = m_slots.bounds.data() + 4 * size_t(quad.firstChild);
+        const auto* minY = minX + capacity;
+        const auto* maxX = minY + capacity;
+        const auto* maxY = maxX + capacity;
+        const auto* ids = m_slots.ids.data() + quad.firstChild;
+
+        // element overlapping the shape is reported if the leaf is its owner. Element lying in
+        // the leaf isn't stored in any other one, so the leaf is its owner, that's only checked
+        // to skip owner points that are expensive
+        const auto isOwner = [&](RealPoint rectMin, RealPoint rectMax)
+        {
+            if constexpr (Shape::IS_OWNER_POINT_CHEAP)
+            {
+                return isOwnerLeaf(shape.getOwnerPoint(rectMin, rectMax), rectMin, rectMax, data);
+            }
+            else
+            {
+                const bool isInLeaf =
+                  rectMin.x >= data.boundsMin.x && rectMin.y >= data.boundsMin.y &&
+                  rectMax.x <= data.boundsMax.x && rectMax.y <= data.boundsMax.y;
+                return isInLeaf ||
+                       isOwnerLeaf(shape.getOwnerPoint(rectMin, rectMax), rectMin, rectMax, data);
+            }
+        };
+        const auto report = [&](uint32_t i, bool isOverlapping, bool isOwned)
+        {
+            if (stats)
+            {
+                stats->suppressedDuplicates += isOverlapping & !isOwned;
+            }
+            return !(isOverlapping & isOwned) ||
+                   bool(callback(ids[i], Point(minX[i], minY[i]), Point(maxX[i], maxY[i])));
+        };
+
+        if (isInside)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (!report(
+                      i, true, isOwner(RealPoint(minX[i], minY[i]), RealPoint(maxX[i], maxY[i]))))
+                {
+                    return;
+                }
+            }
+            continue;
+        }
+
+        const bool isFinished = scanLeaf(
+          minX,
+          minY,
+          maxX,
+          maxY,
+          count,
+          boundsBottomLeft,
+          boundsTopRight,
+          [&](uint32_t first, uint32_t mask)
+          {
+              while (mask != 0)
+              {
+                  const auto i = first + static_cast<uint32_t>(std::countr_zero(mask));
+                  mask &= mask - 1;
+                  const RealPoint rectMin(minX[i], minY[i]);
+                  const RealPoint rectMax(maxX[i], maxY[i]);
+                  // elements spanning several leaves make duplicates as common as reported
+                  // elements and as random, a cheap owner point is combined with the overlap
+                  // test without branches, an expensive one is computed for overlapping
+                  // elements only
+                  const bool isOverlapping = shape.isOverlappingElement(rectMin, rectMax);
+                  const bool isOwned = Shape::IS_OWNER_POINT_CHEAP
+                                         ? isOwner(rectMin, rectMax)
+                                         : isOverlapping && isOwner(rectMin, rectMax);
+                  if (!report(i, isOverlapping, isOwned))
+                  {
+                      return false;
+                  }
+              }
+              return true;
+          });
+        if (!isFinished)
+        {
+            return;
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::isOwnerLeaf(
+  RealPoint point, RealPoint rectMin, RealPoint rectMax, const BoundedQuadData& leaf)
+{
+    // evaluated without branches, the outcome is as random as the order of elements
+    bool isInLeaf = true;
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        // the element extends from the point towards the leaf it's reported from
+        const bool isTowardsMin =
+          (point[axis] == rectMax[axis]) & (rectMin[axis] < rectMax[axis]);
+        const bool isAboveMin = (leaf.boundsMin[axis] < point[axis]) |
+                                (!isTowardsMin & (leaf.boundsMin[axis] == point[axis]));
+        const bool isBelowMax = (point[axis] < leaf.boundsMax[axis]) |
+                                (isTowardsMin & (point[axis] == leaf.boundsMax[axis]));
+        isInLeaf = isInLeaf & isAboveMin & isBelowMax;
+    }
+    return isInLeaf;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::CircleShape::isOverlappingQuad(
+  RealPoint quadMin, RealPoint quadMax) const
+{
+    return isOverlappingElement(quadMin, quadMax);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::CircleShape::isContainingQuad(
+  RealPoint quadMin, RealPoint quadMax) const
+{
+    // the farthest corner of the quad is inside, unbounded quads never are
+    const auto offset = glm::max(center - quadMin, quadMax - center);
+    return glm::dot(offset, offset) < squaredRadius;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::CircleShape::isOverlappingElement(
+  RealPoint rectMin, RealPoint rectMax) const
+{
+    const auto offset = getOwnerPoint(rectMin, rectMax) - center;
+    return glm::dot(offset, offset) < squaredRadius;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::CircleShape::getOwnerPoint(
+  RealPoint rectMin, RealPoint rectMax) const -> RealPoint
+{
+    return glm::clamp(center, rectMin, rectMax);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::PolygonShape::isOverlappingQuad(
+  RealPoint quadMin, RealPoint quadMax) const
+{
+    if (quadMax.x < boundsMin.x || quadMax.y < boundsMin.y || quadMin.x > boundsMax.x ||
+        quadMin.y > boundsMax.y)
+    {
+        return false;
+    }
+
+    // the corner farthest along the normal is tested, axes parallel to unbounded sides of the
+    // quad are skipped, so they don't produce NaNs
+    for (const auto& edge : edges)
+    {
+        const auto x = edge.normal.x > 0   ? edge.normal.x * quadMin.x
+                       : edge.normal.x < 0 ? edge.normal.x * quadMax.x
+                                           : Real(0);
+        const auto y = edge.normal.y > 0   ? edge.normal.y * quadMin.y
+                       : edge.normal.y < 0 ? edge.normal.y * quadMax.y
+                                           : Real(0);
+        if (x + y > edge.offset + edge.tolerance)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::PolygonShape::isContainingQuad(
+  RealPoint quadMin, RealPoint quadMax) const
+{
+    for (const auto& edge : edges)
+    {
+        const auto x = edge.normal.x > 0   ? edge.normal.x * quadMax.x
+                       : edge.normal.x < 0 ? edge.normal.x * quadMin.x
+                                           : Real(0);
+        const auto y = edge.normal.y > 0   ? edge.normal.y * quadMax.y
+                       : edge.normal.y < 0 ? edge.normal.y * quadMin.y
+                                           : Real(0);
+        if (!(x + y < edge.offset))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::PolygonShape::isOverlappingElement(
+  RealPoint rectMin, RealPoint rectMax) const
+{
+    for (const auto& edge : edges)
+    {
+        const auto corner = RealPoint(edge.normal.x > 0 ? rectMin.x : rectMax.x,
+                                      edge.normal.y > 0 ? rectMin.y : rectMax.y);
+        if (!(glm::dot(edge.normal, corner) < edge.offset))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::PolygonShape::getOwnerPoint(
+  RealPoint rectMin, RealPoint rectMax) const -> RealPoint
+{
+    // Sutherland-Hodgman clipping by sides of the rectangle, points on a side get its
+    // coordinate exactly
+    FastArray<RealPoint, 16> clipped;
+    FastArray<RealPoint, 16> input;
+    for (const auto& vertex : vertices)
+    {
+        clipped.push_back(vertex);
+    }
+    for (int side = 0; side < 4 && !clipped.empty(); ++side)
+    {
+        const int axis = side % 2;
+        const bool isMinSide = side < 2;
+        const auto bound = isMinSide ? rectMin[axis] : rectMax[axis];
+        const auto isInside = [&](const RealPoint& point)
+        { return isMinSide ? point[axis] >= bound : point[axis] <= bound; };
+
+        std::swap(input, clipped);
+        clipped.clear();
+        for (uint32_t i = 0; i < input.size(); ++i)
+        {
+            const auto& current = input[i];
+            const auto& next = input[(i + 1) % input.size()];
+            if (isInside(current))
+            {
+                clipped.push_back(current);
+            }
+            if (isInside(current) != isInside(next))
+            {
+                const auto t = (bound - current[axis]) / (next[axis] - current[axis]);
+                auto crossing = current + (next - current) * t;
+                crossing[axis] = bound;
+                clipped.push_back(crossing);
+            }
+        }
+    }
+
+    // intersection is a sliver lost to rounding, any point of the element keeps owner unique
+    if (clipped.empty())
+    {
+        return rectMin;
+    }
+    auto lowest = clipped[0];
+    for (const auto& vertex : clipped)
+    {
+        if (vertex.y < lowest.y || (vertex.y == lowest.y && vertex.x < lowest.x))
+        {
+            lowest = vertex;
+        }
+    }
+    return glm::clamp(lowest, rectMin, rectMax);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::raycast(
+  RealPoint origin, RealPoint direction, Real maxT, Callback&& callback) const
+{
+    if (!std::isfinite(origin.x) || !std::isfinite(origin.y) || !std::isfinite(direction.x) ||
+        !std::isfinite(direction.y) || direction == RealPoint(0, 0) || !(maxT >= 0))
+    {
+        return;
+    }
+
+    const Ray ray{ origin, direction, RealPoint(1, 1) / direction, maxT };
+
+    struct Hit
+    {
+        Real t;
+        uint32_t elementIndex;
+        Payload id;
+    };
+    const auto isFarther = [](const Hit& first, const Hit& second) { return first.t > second.t; };
+
+    // hits found so far in min-heap by t, they are reported once all quads left to visit are
+    // entered farther than them
+    std::vector<Hit> hits;
+
+    struct StackEntry
+    {
+        BoundedQuadData data;
+        // The smallest distance of this quad and quads below it in the stack. Children are
+        // pushed front to back, but a ray lying on a center line enters both children on its
+        // sides at the same t, and they are visited one after another.
+        Real minDistance;
+    };
+    TraversalStack<StackEntry> quadsToCheck;
+    const auto root = getRootQuad();
+    quadsToCheck.push_back({ root, root.distance });
+
+    // quadrant number has the right side in bit 0 and the bottom side in bit 1, mirroring it
+    // along the ray direction gives the order the ray crosses children in
+    const uint32_t mirror = (direction.x < 0 ? 1u : 0u) | (direction.y > 0 ? 2u : 0u);
+
+    while (!quadsToCheck.empty())
+    {
+        const auto data = quadsToCheck.pop().data;
+
+        const auto minDistance = quadsToCheck.empty()
+                                   ? data.distance
+                                   : std::min(data.distance, quadsToCheck.peek().minDistance);
+        while (!hits.empty() && hits.front().t < minDistance)
+        {
+            std::pop_heap(hits.begin(), hits.end(), isFarther);
+            const auto hit = hits.back();
+            hits.pop_back();
+            if (!callback(hit.id, hit.t))
+            {
+                return;
+            }
+        }
+
+        const auto& quad = m_quadNodes[data.quad.quadIndex];
+        if (quad.isBranch())
+        {
+            // push in reverse order, so the child crossed first is popped first
+            for (uint32_t order = 4; order-- > 0;)
+            {
+                auto child = getChildQuad(data, quad.firstChild, order ^ mirror);
+                const auto [tEnter, tExit] = getRayInterval(ray, child.boundsMin, child.boundsMax);
+                if (tEnter <= tExit)
+                {
+                    child.distance = tEnter;
+                    const auto childMinDistance =
+                      quadsToCheck.empty()
+                        ? tEnter
+                        : std::min(tEnter, quadsToCheck.peek().minDistance);
+                    quadsToCheck.push_back({ child, childMinDistance });
+                }
+            }
+            continue;
+        }
+
+        const auto capacity = quad.capacity;
+        const auto* minX = m_slots.bounds.data() + 4 * size_t(quad.firstChild);
+        const auto* minY = minX + capacity;
+        const auto* maxX = minY + capacity;
+        const auto* maxY = maxX + capacity;
+        const auto* ids = m_slots.ids.data() + quad.firstChild;
+        const auto* elementIndices = m_slots.elementIndices.data() + quad.firstChild;
+
+        for (uint32_t i = 0; i < quad.count; ++i)
+        {
+            const auto [tEnter, tExit] =
+              getRayInterval(ray, RealPoint(minX[i], minY[i]), RealPoint(maxX[i], maxY[i]));
+            if (tEnter > tExit)
+            {
+                continue;
+            }
+
+            // element stored in several leaves is hit in the leaf containing its entry point,
+            // it's skipped in leaves entered after it, and in leaves entered at the same t it's
+            // still among the hits
+            const auto elementIndex = elementIndices[i];
+            if (m_elementLeaves[elementIndex] == MULTIPLE_LEAVES &&
+                (tEnter < data.distance ||
+                 std::any_of(hits.begin(),
+                             hits.end(),
+                             [elementIndex](const Hit& hit)
+                             { return hit.elementIndex == elementIndex; })))
+            {
+                continue;
+            }
+
+            hits.push_back({ tEnter, elementIndex, ids[i] });
+            std::push_heap(hits.begin(), hits.end(), isFarther);
+        }
+    }
+
+    while (!hits.empty())
+    {
+        std::pop_heap(hits.begin(), hits.end(), isFarther);
+        const auto hit = hits.back();
+        hits.pop_back();
+        if (!callback(hit.id, hit.t))
+        {
+            return;
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename Callback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::forEachOverlappingPair(
+  Callback&& callback) const
+{
+    TraversalStack<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quadsToCheck.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        if (quad.isBranch())
+        {
+            const auto subQuadSize = getSubQuadSize(size);
+            const auto center = bottomLeft + subQuadSize;
+            quadsToCheck.push_back(
+              { quad.firstChild + 0, bottomLeft + Point(0, subQuadSize.y), subQuadSize });
+            quadsToCheck.push_back({ quad.firstChild + 1, center, subQuadSize });
+            quadsToCheck.push_back({ quad.firstChild + 2, bottomLeft, subQuadSize });
+            quadsToCheck.push_back(
+              { quad.firstChild + 3, bottomLeft + Point(subQuadSize.x, 0), subQuadSize });
+            continue;
+        }
+
+        const auto count = quad.count;
+        if (count < 2)
+        {
+            continue;
+        }
+
+        // both elements of a pair are stored in every leaf their intersection is inserted to,
+        // the pair is reported from the one containing the corner of the intersection
+        const auto cornerBound = getLeafCornerBound(bottomLeft);
+
+        const auto capacity = quad.capacity;
+        const auto* minX = m_slots.bounds.data() + 4 * size_t(quad.firstChild);
+        const auto* minY = minX + capacity;
+        const auto* maxX = minY + capacity;
+        const auto* maxY = maxX + capacity;
+        const auto* ids = m_slots.ids.data() + quad.firstChild;
+
+        for (uint32_t i = 0; i + 1 < count; ++i)
+        {
+            const Point rectBottomLeft{ minX[i], minY[i] };
+            const Point rectTopRight{ maxX[i], maxY[i] };
+
+            // only elements after i are tested, so every pair of the leaf is tested once
+            for (uint32_t first = (i + 1) & ~(LEAF_SCAN_WIDTH - 1); first < count;
+                 first += LEAF_SCAN_WIDTH)
+            {
+                auto mask = getSlotsOverlapMask(minX + first,
+                                                minY + first,
+                                                maxX + first,
+                                                maxY + first,
+                                                rectBottomLeft,
+                                                rectTopRight);
+                if (first <= i)
+                {
+                    mask &= ~((2u << (i - first)) - 1);
+                }
+                if (count - first < LEAF_SCAN_WIDTH)
+                {
+                    mask &= (1u << (count - first)) - 1;
+                }
+
+                while (mask != 0)
+                {
+                    const auto j = first + static_cast<uint32_t>(std::countr_zero(mask));
+                    mask &= mask - 1;
+                    if (std::max(minX[i], minX[j]) < cornerBound.x ||
+                        std::max(minY[i], minY[j]) < cornerBound.y)
+                    {
+                        continue;
+                    }
+                    if (!callback(ids[i], ids[j]))
+                    {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename QuadsObserver>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::traverseQuads(
+  QuadsObserver&& quadsObserver) const
+{
+    std::queue<TraverseQuadData> quads;
+    auto rootSize = m_areaTopRight - m_areaBottomLeft;
+    quads.push({ 0, m_areaBottomLeft, rootSize });
+
+    while (!quads.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quads.front();
+        quads.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        quadsObserver(bottomLeft, size);
+
+        const auto newSize = getSubQuadSize(size);
+
+        if (quad.isBranch())
+        {
+            quads.push({ quad.firstChild + 0, bottomLeft + Point(0, newSize.y), newSize });
+            quads.push({ quad.firstChild + 1, bottomLeft + newSize, newSize });
+            quads.push({ quad.firstChild + 2, bottomLeft, newSize });
+            quads.push({ quad.firstChild + 3, bottomLeft + Point(newSize.x, 0), newSize });
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+template<typename RemapCallback>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::compact(RemapCallback&& remapElement)
+{
+    compact();
+
+    // arrays indexed by element index follow elements, an element only moves to a lower index
+    std::vector<uint32_t> newIndices(m_elements.range(), NIL);
+    m_elements.compact(
+      [&](uint32_t oldIndex, uint32_t newIndex)
+      {
+          newIndices[oldIndex] = newIndex;
+          m_elementLeaves[newIndex] = m_elementLeaves[oldIndex];
+          if (newIndex < m_elementUpdateBounds.size())
+          {
+              m_elementUpdateBounds[newIndex] = oldIndex < m_elementUpdateBounds.size()
+                                                  ? m_elementUpdateBounds[oldIndex]
+                                                  : EMPTY_UPDATE_BOUNDS;
+          }
+          remapElement(oldIndex, newIndex);
+      });
+    m_elementLeaves.resize(m_elements.range());
+    m_elementLeaves.shrink_to_fit();
+    m_elementUpdateBounds.resize(std::min(m_elementUpdateBounds.size(), m_elements.range()));
+    m_elementUpdateBounds.shrink_to_fit();
+
+    // all nodes are reachable after compaction
+    for (uint32_t nodeIndex = 0; nodeIndex < m_quadNodes.range(); ++nodeIndex)
+    {
+        const auto& node = m_quadNodes[nodeIndex];
+        if (node.isBranch() || node.count == 0)
+        {
+            continue;
+        }
+        auto* elementIndices = m_slots.elementIndices.data() + node.firstChild;
+        for (uint32_t i = 0; i < node.count; ++i)
+        {
+            if (newIndices[elementIndices[i]] != NIL)
+            {
+                elementIndices[i] = newIndices[elementIndices[i]];
+            }
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::isOverlappingNodeBounds(
+  uint32_t nodeIndex, Point rectBottomLeft, Point rectTopRight) const
+{
+    if (!m_keepNodeBounds)
+    {
+        return true;
+    }
+
+    // the same comparisons as in isRectanglesOverlap, rectangle overlapping an element
+    // overlaps bounds containing it
+    const auto& bounds = m_nodeBounds[nodeIndex];
+    return bounds.topRight.x > rectBottomLeft.x && bounds.topRight.y > rectBottomLeft.y &&
+           bounds.bottomLeft.x < rectTopRight.x && bounds.bottomLeft.y < rectTopRight.y;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::isValidRectangle(
+  Point rectBottomLeft, Point rectTopRight) const
+{
+    // if ill-formed rectangle
+    if (rectBottomLeft.x > rectTopRight.x || rectBottomLeft.y > rectTopRight.y)
+    {
+        return false;
+    }
+
+    // if rectangle is outside of work area
+    if (rectBottomLeft.x > m_areaTopRight.x || rectTopRight.x < m_areaBottomLeft.x ||
+        rectBottomLeft.y > m_areaTopRight.y || rectTopRight.y < m_areaBottomLeft.y)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Default quadtree is compiled once, in Quadtree.cpp. Members which are not inlined into queries
+// are defined in Quadtree.inl, code using other configurations includes it to instantiate them.
+extern template class BasicQuadtree<>;
+
 }
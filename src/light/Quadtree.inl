@@ -0,0 +1,1811 @@
+﻿#pragma once
+
+#include <light/Quadtree.h>
+#include <light/ThreadPool.h>
+
+#include <atomic>
+
+// Members of BasicQuadtree which are not inlined into queries, see the end of Quadtree.h.
+
+namespace light
+{
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::BasicQuadtree(
+  Point areaBottomLeft,
+  Point areaTopRight,
+  int maxElementsPerNode,
+  int maxDepth,
+  bool keepNodeBounds)
+  : m_freeNode{ NIL }
+  , m_keepNodeBounds{ keepNodeBounds }
+  , m_areaBottomLeft{ areaBottomLeft }
+  , m_areaTopRight{ areaTopRight }
+  , m_maxElementsPerNode{ LeafCapacity == DYNAMIC_EXTENT ? maxElementsPerNode
+                                                         : static_cast<int>(LeafCapacity) }
+  , m_maxDepth{ MaxDepth == DYNAMIC_EXTENT ? maxDepth : static_cast<int>(MaxDepth) }
+{
+    initRoot();
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+size_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::size() const
+{
+    return m_elements.size();
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+size_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::memoryUsage() const
+{
+    return m_elements.range() * sizeof(QuadElement) + m_quadNodes.range() * sizeof(QuadNode) +
+           m_slots.bounds.capacity() * sizeof(Scalar) + m_slots.ids.capacity() * sizeof(Payload) +
+           (m_slots.elementIndices.capacity() + m_freeSlots.capacity() +
+            m_elementLeaves.capacity()) *
+             sizeof(uint32_t) +
+           m_elementUpdateBounds.capacity() * sizeof(UpdateBounds) +
+           m_nodeBounds.capacity() * sizeof(AABB);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::reserve(size_t capacity)
+{
+    m_elements.reserve(capacity);
+    m_elementLeaves.reserve(capacity);
+
+    // suppose uniform element distribution per area, leaves are split once they overflow, so
+    // they are about half full. full tree has a third more nodes than leaves
+    const auto maxElementsPerNode = std::max(getMaxElementsPerNode(), 1u);
+    const auto maxLeavesCount = size_t(1) << (2 * std::min(getMaxDepth(), 15u));
+    const auto estimatedLeavesCount = std::min(2 * capacity / maxElementsPerNode, maxLeavesCount);
+    const auto estimatedNodesCount = estimatedLeavesCount * 4 / 3 + 1;
+    m_quadNodes.reserve(estimatedNodesCount);
+    if (m_keepNodeBounds)
+    {
+        m_nodeBounds.reserve(estimatedNodesCount);
+    }
+
+    // elements straddling leaf borders take several slots and blocks are rounded up, so slots
+    // are estimated to be twice as many as elements
+    const auto estimatedSlotsCount = 2 * capacity;
+    m_slots.bounds.reserve(4 * estimatedSlotsCount);
+    m_slots.ids.reserve(estimatedSlotsCount);
+    m_slots.elementIndices.reserve(estimatedSlotsCount);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::compact()
+{
+    // free node blocks are all the nodes not reachable from the root
+    auto freeNodesCount = size_t(0);
+    for (auto freeNode = m_freeNode; freeNode != NIL; freeNode = m_quadNodes[freeNode].firstChild)
+    {
+        freeNodesCount += 4;
+    }
+
+    FreeList<QuadNode> nodes;
+    nodes.reserve(m_quadNodes.range() - freeNodesCount);
+    LeafSlots slots;
+    std::vector<AABB> nodeBounds;
+    // new index of every reachable node, indexed by its old index
+    std::vector<uint32_t> newIndices(m_quadNodes.range(), NIL);
+
+    nodes.push_back(m_quadNodes[0]);
+    newIndices[0] = 0;
+
+    // nodes are popped in depth-first order, every branch appends block of its children and
+    // every leaf appends its slots when popped, so subtrees occupy contiguous ranges
+    FastArray<uint32_t> nodesToMove;
+    nodesToMove.push_back(0);
+    while (!nodesToMove.empty())
+    {
+        const auto oldIndex = nodesToMove.pop();
+        const auto& oldNode = m_quadNodes[oldIndex];
+        auto& node = nodes[newIndices[oldIndex]];
+
+        if (oldNode.isBranch())
+        {
+            node.firstChild = static_cast<uint32_t>(nodes.range());
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                newIndices[oldNode.firstChild + quadrant] =
+                  nodes.push_back(m_quadNodes[oldNode.firstChild + quadrant]);
+            }
+            // the first child is popped first
+            for (uint32_t quadrant = 4; quadrant-- > 0;)
+            {
+                nodesToMove.push_back(oldNode.firstChild + quadrant);
+            }
+            continue;
+        }
+
+        if (oldNode.count == 0)
+        {
+            node.firstChild = NIL;
+            node.capacity = 0;
+            continue;
+        }
+
+        node.capacity =
+          (oldNode.count + LEAF_SCAN_WIDTH - 1) / LEAF_SCAN_WIDTH * LEAF_SCAN_WIDTH;
+        node.firstChild = static_cast<uint32_t>(slots.elementIndices.size());
+        slots.bounds.resize(slots.bounds.size() + 4 * size_t(node.capacity));
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            const auto* from = m_slots.bounds.data() + 4 * size_t(oldNode.firstChild) +
+                               i * size_t(oldNode.capacity);
+            std::copy(from,
+                      from + oldNode.count,
+                      slots.bounds.begin() + 4 * size_t(node.firstChild) +
+                        i * size_t(node.capacity));
+        }
+        const auto firstSlot = m_slots.ids.begin() + oldNode.firstChild;
+        slots.ids.insert(slots.ids.end(), firstSlot, firstSlot + oldNode.count);
+        slots.ids.resize(slots.ids.size() + node.capacity - oldNode.count);
+        const auto firstElementIndex = m_slots.elementIndices.begin() + oldNode.firstChild;
+        slots.elementIndices.insert(
+          slots.elementIndices.end(), firstElementIndex, firstElementIndex + oldNode.count);
+        slots.elementIndices.resize(slots.elementIndices.size() + node.capacity - oldNode.count);
+    }
+
+    for (auto& elementLeaf : m_elementLeaves)
+    {
+        if (elementLeaf < MULTIPLE_LEAVES)
+        {
+            elementLeaf = newIndices[elementLeaf];
+        }
+    }
+
+    if (m_keepNodeBounds)
+    {
+        nodeBounds.resize(nodes.range());
+        for (uint32_t oldIndex = 0; oldIndex < newIndices.size(); ++oldIndex)
+        {
+            if (newIndices[oldIndex] != NIL)
+            {
+                nodeBounds[newIndices[oldIndex]] = m_nodeBounds[oldIndex];
+            }
+        }
+    }
+
+    slots.bounds.shrink_to_fit();
+    slots.ids.shrink_to_fit();
+    slots.elementIndices.shrink_to_fit();
+
+    m_quadNodes = std::move(nodes);
+    m_slots = std::move(slots);
+    m_nodeBounds = std::move(nodeBounds);
+    m_freeNode = NIL;
+    m_freeSlots.clear();
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::clear()
+{
+    m_elements.clear();
+    m_quadNodes.clear();
+    m_freeNode = NIL;
+    m_slots.bounds.clear();
+    m_slots.ids.clear();
+    m_slots.elementIndices.clear();
+    m_freeSlots.clear();
+    m_elementLeaves.clear();
+    m_elementUpdateBounds.clear();
+    m_nodeBounds.clear();
+    initRoot();
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::build(
+  std::span<const QuadElement> elements)
+{
+    buildTree(elements, nullptr);
+    refitAllNodeBounds();
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::build(
+  std::span<const QuadElement> elements, ThreadPool& pool)
+{
+    buildTree(elements, &pool);
+    refitAllNodeBounds();
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::radixSortByHigherHalf(
+  std::vector<uint64_t>& keys)
+{
+    std::vector<uint64_t> sorted(keys.size());
+
+    for (uint32_t shift = 32; shift < 64; shift += 8)
+    {
+        size_t offsets[257] = {};
+        for (const auto key : keys)
+        {
+            ++offsets[((key >> shift) & 0xff) + 1];
+        }
+        for (size_t i = 1; i < 257; ++i)
+        {
+            offsets[i] += offsets[i - 1];
+        }
+        for (const auto key : keys)
+        {
+            sorted[offsets[(key >> shift) & 0xff]++] = key;
+        }
+        keys.swap(sorted);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::buildQuads(
+  const BuildInput& input,
+  const BuildData& root,
+  std::vector<uint32_t>& buffer,
+  BuildOutput& output,
+  DeferredQuads* deferred)
+{
+    QuadNode emptyLeaf;
+    emptyLeaf.count = 0;
+    emptyLeaf.firstChild = NIL;
+    emptyLeaf.capacity = 0;
+
+    FastArray<uint32_t> straddlers;
+    FastArray<BuildData> quadsToBuild;
+    quadsToBuild.push_back(root);
+
+    while (!quadsToBuild.empty())
+    {
+        auto data = quadsToBuild.pop();
+        buffer.resize(data.bufferSize);
+
+        if (deferred && data.depth == deferred->depth)
+        {
+            const auto extrasBegin = static_cast<uint32_t>(deferred->extras.size());
+            deferred->extras.insert(deferred->extras.end(),
+                                    buffer.begin() + data.extraBegin,
+                                    buffer.begin() + data.extraEnd);
+            data.extraBegin = extrasBegin;
+            data.extraEnd = static_cast<uint32_t>(deferred->extras.size());
+            deferred->quads.push_back(data);
+            continue;
+        }
+
+        const auto ownCount = data.ownEnd - data.ownBegin;
+        const auto count = ownCount + data.extraEnd - data.extraBegin;
+
+        if (count <= input.maxElementsPerNode || data.depth == input.maxDepth)
+        {
+            auto& leaf = output.nodes[data.quadIndex];
+            leaf.count = count;
+            if (count == 0)
+            {
+                continue;
+            }
+
+            // there are no free blocks before build, so leaves get consecutive blocks of exact
+            // size rounded up for leaf scan
+            auto& slots = output.slots;
+            leaf.capacity = (count + LEAF_SCAN_WIDTH - 1) / LEAF_SCAN_WIDTH * LEAF_SCAN_WIDTH;
+            leaf.firstChild = static_cast<uint32_t>(slots.elementIndices.size());
+            slots.bounds.resize(slots.bounds.size() + 4 * size_t(leaf.capacity));
+            slots.ids.resize(slots.ids.size() + leaf.capacity);
+            slots.elementIndices.resize(slots.elementIndices.size() + leaf.capacity);
+
+            auto* minX = slots.bounds.data() + 4 * size_t(leaf.firstChild);
+            auto* minY = minX + leaf.capacity;
+            auto* maxX = minY + leaf.capacity;
+            auto* maxY = maxX + leaf.capacity;
+            auto* ids = slots.ids.data() + leaf.firstChild;
+            auto* elementIndices = slots.elementIndices.data() + leaf.firstChild;
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const auto position =
+                  i < ownCount ? data.ownBegin + i : buffer[data.extraBegin + i - ownCount];
+                const auto& element = input.elements[position];
+
+                minX[i] = element.bottomLeft.x;
+                minY[i] = element.bottomLeft.y;
+                maxX[i] = element.topRight.x;
+                maxY[i] = element.topRight.y;
+                ids[i] = element.id;
+                elementIndices[i] = element.elementIndex;
+
+                if (output.elementLeaves)
+                {
+                    auto& elementLeaf = (*output.elementLeaves)[element.elementIndex];
+                    elementLeaf = elementLeaf == NIL ? data.quadIndex : MULTIPLE_LEAVES;
+                }
+            }
+            continue;
+        }
+
+        const auto subQuadSize = getSubQuadSize(data.size);
+        const auto center = data.bottomLeft + subQuadSize;
+
+        // own elements are split between quadrants by the code, there are no codes below
+        // codeLevels, so all own elements are passed to children as extra ones
+        uint32_t ownBegins[5];
+        if (data.depth < input.codeLevels)
+        {
+            const auto shift = 2 * (input.codeLevels - 1 - data.depth);
+            ownBegins[0] = data.ownBegin;
+            for (uint32_t quadrant = 1; quadrant < 4; ++quadrant)
+            {
+                ownBegins[quadrant] = static_cast<uint32_t>(
+                  std::partition_point(input.elements.begin() + ownBegins[quadrant - 1],
+                                       input.elements.begin() + data.ownEnd,
+                                       [&](const BuildElement& element)
+                                       { return ((element.code >> shift) & 3u) < quadrant; }) -
+                  input.elements.begin());
+            }
+            ownBegins[4] = data.ownEnd;
+        }
+        else
+        {
+            std::fill(ownBegins, ownBegins + 5, data.ownEnd);
+        }
+
+        // elements overlapping several quadrants are copied into each of them
+        if (data.depth < input.codeLevels)
+        {
+            for (auto i = data.ownBegin; i < data.ownEnd; ++i)
+            {
+                if ((input.straddleLevels[i] >> data.depth) & 1u)
+                {
+                    straddlers.push_back(i);
+                }
+            }
+        }
+        else
+        {
+            for (auto i = data.ownBegin; i < data.ownEnd; ++i)
+            {
+                straddlers.push_back(i);
+            }
+        }
+        for (auto i = data.extraBegin; i < data.extraEnd; ++i)
+        {
+            straddlers.push_back(buffer[i]);
+        }
+
+        uint32_t extraCounts[4] = {};
+        for (size_t i = 0; i < straddlers.size(); ++i)
+        {
+            const auto position = straddlers[i];
+            const auto& element = input.elements[position];
+            const auto mask = getQuadrantsMask(element.bottomLeft, element.topRight, center);
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                const bool isOwn = ownBegins[quadrant] <= position &&
+                                   position < ownBegins[quadrant + 1];
+                extraCounts[quadrant] += ((mask >> quadrant) & 1u) && !isOwn;
+            }
+        }
+
+        uint32_t extraBegins[4];
+        extraBegins[0] = static_cast<uint32_t>(buffer.size());
+        for (uint32_t quadrant = 1; quadrant < 4; ++quadrant)
+        {
+            extraBegins[quadrant] = extraBegins[quadrant - 1] + extraCounts[quadrant - 1];
+        }
+        const auto newBufferSize = extraBegins[3] + extraCounts[3];
+        buffer.resize(newBufferSize);
+
+        uint32_t extraEnds[4];
+        std::copy(extraBegins, extraBegins + 4, extraEnds);
+        while (!straddlers.empty())
+        {
+            const auto position = straddlers.pop();
+            const auto& element = input.elements[position];
+            const auto mask = getQuadrantsMask(element.bottomLeft, element.topRight, center);
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                const bool isOwn = ownBegins[quadrant] <= position &&
+                                   position < ownBegins[quadrant + 1];
+                if (((mask >> quadrant) & 1u) && !isOwn)
+                {
+                    buffer[extraEnds[quadrant]++] = position;
+                }
+            }
+        }
+
+        const auto firstChild = static_cast<uint32_t>(output.nodes.size());
+        output.nodes[data.quadIndex].firstChild = firstChild;
+        output.nodes[data.quadIndex].count = NIL;
+        output.nodes.push_back(emptyLeaf);
+        output.nodes.push_back(emptyLeaf);
+        output.nodes.push_back(emptyLeaf);
+        output.nodes.push_back(emptyLeaf);
+
+        const Point quadrantBottomLefts[4] = { data.bottomLeft + Point(0, subQuadSize.y),
+                                               center,
+                                               data.bottomLeft,
+                                               data.bottomLeft + Point(subQuadSize.x, 0) };
+
+        // push in reverse order, so quadrant #1 is built first
+        for (uint32_t quadrant = 4; quadrant-- > 0;)
+        {
+            quadsToBuild.push_back({ firstChild + quadrant,
+                                     data.depth + 1,
+                                     quadrantBottomLefts[quadrant],
+                                     subQuadSize,
+                                     ownBegins[quadrant],
+                                     ownBegins[quadrant + 1],
+                                     extraBegins[quadrant],
+                                     extraBegins[quadrant] + extraCounts[quadrant],
+                                     newBufferSize });
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::buildTree(
+  std::span<const QuadElement> elements, ThreadPool* pool)
+{
+    clear();
+    m_elements.reserve(elements.size());
+
+    // calls function for ranges of [0, count), on threads of the pool if there is one
+    const auto forEachRange =
+      [pool](size_t count, const std::function<void(size_t begin, size_t end)>& function)
+    {
+        if (pool)
+        {
+            pool->parallelFor(count, function);
+        }
+        else
+        {
+            function(0, count);
+        }
+    };
+
+    for (const auto& element : elements)
+    {
+        if (isValidRectangle(element.bottomLeft, element.topRight))
+        {
+            m_elements.push_back(element);
+        }
+    }
+    // elements are pushed to the cleared list, so their indices are consecutive
+    const auto elementsCount = static_cast<uint32_t>(m_elements.size());
+
+    // Morton codes are computed with the same centers insert compares with, so the quadrant
+    // of the center is exact on every level. two bits per level fit up to 16 levels.
+    constexpr uint32_t MAX_CODE_LEVELS = 16;
+    const auto codeLevels = std::min(getMaxDepth(), MAX_CODE_LEVELS);
+    const auto areaSize = m_areaTopRight - m_areaBottomLeft;
+
+    // code of element in the higher half and its index in the lower one. elements which don't
+    // overlap the quadrant of their center (degenerate rectangles lying on a center line) can't
+    // be placed by the code, they get IRREGULAR_KEY and are distributed as extra elements
+    std::vector<uint64_t> elementKeys(elementsCount);
+    // bit i is set if element overlaps several quadrants of its quad at depth i
+    std::vector<uint16_t> straddleLevels(elementsCount);
+
+    forEachRange(
+      elementsCount,
+      [&](size_t begin, size_t end)
+      {
+          for (auto elementIndex = static_cast<uint32_t>(begin); elementIndex < end;
+               ++elementIndex)
+          {
+              const auto& element = m_elements[elementIndex];
+              const auto elementCenter = getCenter(element.bottomLeft, element.topRight);
+              auto bottomLeft = m_areaBottomLeft;
+              auto size = areaSize;
+              uint32_t code = 0;
+              uint32_t isRegular = 1;
+              uint32_t elementStraddleLevels = 0;
+
+              for (uint32_t level = 0; level < codeLevels; ++level)
+              {
+                  size = getSubQuadSize(size);
+                  const auto center = bottomLeft + size;
+                  const bool isRight = elementCenter.x >= center.x;
+                  const bool isTop = elementCenter.y >= center.y;
+                  const auto quadrant = (isTop ? 0u : 2u) + (isRight ? 1u : 0u);
+                  const auto mask =
+                    getQuadrantsMask(element.bottomLeft, element.topRight, center);
+                  isRegular &= mask >> quadrant;
+                  elementStraddleLevels |= uint32_t((mask & (mask - 1)) != 0) << level;
+
+                  code = (code << 2) | quadrant;
+                  bottomLeft.x = isRight ? center.x : bottomLeft.x;
+                  bottomLeft.y = isTop ? center.y : bottomLeft.y;
+              }
+
+              straddleLevels[elementIndex] = static_cast<uint16_t>(elementStraddleLevels);
+              elementKeys[elementIndex] =
+                isRegular ? (uint64_t(code) << 32) | elementIndex : IRREGULAR_KEY;
+          }
+      });
+
+    std::vector<uint64_t> keys;
+    keys.reserve(elementsCount);
+    std::vector<uint32_t> irregularElements;
+    for (uint32_t elementIndex = 0; elementIndex < elementsCount; ++elementIndex)
+    {
+        if (elementKeys[elementIndex] != IRREGULAR_KEY)
+        {
+            keys.push_back(elementKeys[elementIndex]);
+        }
+        else
+        {
+            irregularElements.push_back(elementIndex);
+        }
+    }
+
+    radixSortByHigherHalf(keys);
+
+    // elements are copied in sorted order, so quads read them sequentially instead of
+    // jumping over m_elements
+    std::vector<BuildElement> sortedElements(keys.size() + irregularElements.size());
+    std::vector<uint16_t> sortedStraddleLevels(keys.size());
+    forEachRange(keys.size(),
+                 [&](size_t begin, size_t end)
+                 {
+                     for (auto i = begin; i < end; ++i)
+                     {
+                         const auto elementIndex = static_cast<uint32_t>(keys[i]);
+                         const auto& element = m_elements[elementIndex];
+                         sortedElements[i] = { uint32_t(keys[i] >> 32),
+                                               elementIndex,
+                                               element.id,
+                                               element.bottomLeft,
+                                               element.topRight };
+                         sortedStraddleLevels[i] = straddleLevels[elementIndex];
+                     }
+                 });
+    for (size_t i = 0; i < irregularElements.size(); ++i)
+    {
+        const auto elementIndex = irregularElements[i];
+        const auto& element = m_elements[elementIndex];
+        sortedElements[keys.size() + i] = {
+            0, elementIndex, element.id, element.bottomLeft, element.topRight
+        };
+    }
+    m_elementLeaves.assign(m_elements.range(), NIL);
+
+    // build buffer stores positions of extra elements in sortedElements
+    const auto regularCount = static_cast<uint32_t>(keys.size());
+    const auto totalCount = static_cast<uint32_t>(sortedElements.size());
+    std::vector<uint32_t> buffer;
+    for (auto i = regularCount; i < totalCount; ++i)
+    {
+        buffer.push_back(i);
+    }
+
+    const BuildInput input{
+        sortedElements, sortedStraddleLevels, codeLevels, getMaxElementsPerNode(), getMaxDepth()
+    };
+    const BuildData root{ 0,
+                          0,
+                          m_areaBottomLeft,
+                          areaSize,
+                          0,
+                          regularCount,
+                          0,
+                          totalCount - regularCount,
+                          totalCount - regularCount };
+    BuildOutput output{ m_quadNodes, m_slots, &m_elementLeaves };
+
+    // quads are split serially down to the depth having several times more quads than there
+    // are threads, so threads stay busy when subtrees differ in size
+    uint32_t splitDepth = 1;
+    while (pool && (1u << (2 * splitDepth)) < 8 * pool->size())
+    {
+        ++splitDepth;
+    }
+
+    if (!pool || pool->size() == 1 || splitDepth >= input.maxDepth)
+    {
+        buildQuads(input, root, buffer, output, nullptr);
+        return;
+    }
+
+    DeferredQuads deferred;
+    deferred.depth = splitDepth;
+    buildQuads(input, root, buffer, output, &deferred);
+
+    // every subtree is built into its own storage with its root at node 0
+    std::vector<BuildSubtree> subtrees(deferred.quads.size());
+    std::atomic<size_t> nextSubtree{ 0 };
+    pool->run(
+      [&](size_t)
+      {
+          std::vector<uint32_t> subtreeBuffer;
+          for (auto i = nextSubtree++; i < subtrees.size(); i = nextSubtree++)
+          {
+              auto& subtree = subtrees[i];
+              auto subtreeRoot = deferred.quads[i];
+              subtreeBuffer.assign(deferred.extras.begin() + subtreeRoot.extraBegin,
+                                   deferred.extras.begin() + subtreeRoot.extraEnd);
+              subtreeRoot.quadIndex = subtree.nodes.push_back(m_quadNodes[subtreeRoot.quadIndex]);
+              subtreeRoot.extraBegin = 0;
+              subtreeRoot.extraEnd = static_cast<uint32_t>(subtreeBuffer.size());
+              subtreeRoot.bufferSize = subtreeRoot.extraEnd;
+
+              BuildOutput subtreeOutput{ subtree.nodes, subtree.slots, nullptr };
+              buildQuads(input, subtreeRoot, subtreeBuffer, subtreeOutput, nullptr);
+          }
+      });
+
+    // nodes of subtrees except their roots and their slots are appended to the tree
+    auto nodesCount = static_cast<uint32_t>(m_quadNodes.range());
+    auto slotsCount = static_cast<uint32_t>(m_slots.elementIndices.size());
+    for (auto& subtree : subtrees)
+    {
+        subtree.nodesOffset = nodesCount;
+        subtree.slotsOffset = slotsCount;
+        nodesCount += static_cast<uint32_t>(subtree.nodes.range()) - 1;
+        slotsCount += static_cast<uint32_t>(subtree.slots.elementIndices.size());
+    }
+    // placeholders, every one of them is overwritten by a node of subtree
+    const auto placeholder = m_quadNodes[0];
+    m_quadNodes.reserve(nodesCount);
+    while (m_quadNodes.range() < nodesCount)
+    {
+        m_quadNodes.push_back(placeholder);
+    }
+    m_slots.bounds.resize(4 * size_t(slotsCount));
+    m_slots.ids.resize(slotsCount);
+    m_slots.elementIndices.resize(slotsCount);
+
+    nextSubtree = 0;
+    pool->run(
+      [&](size_t)
+      {
+          for (auto i = nextSubtree++; i < subtrees.size(); i = nextSubtree++)
+          {
+              const auto& subtree = subtrees[i];
+              const auto toTreeNode = [&](uint32_t subtreeNode)
+              {
+                  return subtreeNode == 0 ? deferred.quads[i].quadIndex
+                                          : subtree.nodesOffset + subtreeNode - 1;
+              };
+
+              for (uint32_t subtreeNode = 0; subtreeNode < subtree.nodes.range(); ++subtreeNode)
+              {
+                  auto node = subtree.nodes[subtreeNode];
+                  const auto nodeIndex = toTreeNode(subtreeNode);
+                  if (node.isBranch())
+                  {
+                      node.firstChild = toTreeNode(node.firstChild);
+                  }
+                  else if (node.count != 0)
+                  {
+                      // element may be stored in leaves of several subtrees built meanwhile
+                      const auto* elementIndices =
+                        subtree.slots.elementIndices.data() + node.firstChild;
+                      for (uint32_t slot = 0; slot < node.count; ++slot)
+                      {
+                          std::atomic_ref elementLeaf{ m_elementLeaves[elementIndices[slot]] };
+                          auto expected = NIL;
+                          if (!elementLeaf.compare_exchange_strong(expected, nodeIndex))
+                          {
+                              elementLeaf.store(MULTIPLE_LEAVES);
+                          }
+                      }
+
+                      node.firstChild += subtree.slotsOffset;
+                  }
+                  m_quadNodes[nodeIndex] = node;
+              }
+
+              std::copy(subtree.slots.bounds.begin(),
+                        subtree.slots.bounds.end(),
+                        m_slots.bounds.begin() + 4 * size_t(subtree.slotsOffset));
+              std::copy(subtree.slots.ids.begin(),
+                        subtree.slots.ids.end(),
+                        m_slots.ids.begin() + subtree.slotsOffset);
+              std::copy(subtree.slots.elementIndices.begin(),
+                        subtree.slots.elementIndices.end(),
+                        m_slots.elementIndices.begin() + subtree.slotsOffset);
+          }
+      });
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::insert(
+  Point rectBottomLeft, Point rectTopRight, Payload id)
+{
+    if (!isValidRectangle(rectBottomLeft, rectTopRight))
+    {
+        return NIL;
+    }
+
+    QuadElement quadElement;
+    quadElement.id = id;
+    quadElement.bottomLeft = rectBottomLeft;
+    quadElement.topRight = rectTopRight;
+    const auto elementIndex = m_elements.push_back(quadElement);
+    if (m_elementLeaves.size() < m_elements.range())
+    {
+        m_elementLeaves.resize(m_elements.range(), NIL);
+    }
+    m_elementLeaves[elementIndex] = NIL;
+    resetUpdateBounds(elementIndex);
+    insertElement(elementIndex);
+    return elementIndex;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::remove(uint32_t index)
+{
+    if (!m_elements.isLive(index))
+    {
+        return;
+    }
+
+    const auto element = m_elements[index];
+
+    FastArray<uint32_t> leaves;
+    FastArray<uint32_t> branches;
+    collectLeaves(element.bottomLeft, element.topRight, leaves, branches);
+
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        removeFromLeaf(leaves[i], index);
+        refitNodeBounds(leaves[i]);
+    }
+
+    m_elements.erase(index);
+    m_elementLeaves[index] = NIL;
+
+    // merge from the deepest branches, so merged children may allow their parents to merge too.
+    // bounds of children are refitted before their parents
+    while (!branches.empty())
+    {
+        const auto branchIndex = branches.pop();
+        tryMerge(branchIndex);
+        refitNodeBounds(branchIndex);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::update(
+  uint32_t index, Point newBottomLeft, Point newTopRight)
+{
+    if (!m_elements.isLive(index) || !isValidRectangle(newBottomLeft, newTopRight))
+    {
+        return false;
+    }
+
+    if (m_elementUpdateBounds.size() < m_elements.range())
+    {
+        m_elementUpdateBounds.resize(m_elements.range(), EMPTY_UPDATE_BOUNDS);
+    }
+
+    auto& element = m_elements[index];
+    auto& updateBounds = m_elementUpdateBounds[index];
+
+    // fast path: corners of element don't cross any center traversal compares them with
+    if (updateBounds.bottomLeftMin.x < newBottomLeft.x &&
+        newBottomLeft.x < updateBounds.bottomLeftMax.x &&
+        updateBounds.bottomLeftMin.y < newBottomLeft.y &&
+        newBottomLeft.y < updateBounds.bottomLeftMax.y &&
+        updateBounds.topRightMin.x < newTopRight.x && newTopRight.x < updateBounds.topRightMax.x &&
+        updateBounds.topRightMin.y < newTopRight.y && newTopRight.y < updateBounds.topRightMax.y)
+    {
+        element.bottomLeft = newBottomLeft;
+        element.topRight = newTopRight;
+        rewriteElementSlots(index);
+        growNodeBounds(index);
+        return true;
+    }
+
+    if (isInSameLeaves(element.bottomLeft, element.topRight, newBottomLeft, newTopRight))
+    {
+        updateBounds = computeUpdateBounds(newBottomLeft, newTopRight);
+        element.bottomLeft = newBottomLeft;
+        element.topRight = newTopRight;
+        rewriteElementSlots(index);
+        growNodeBounds(index);
+        return true;
+    }
+
+    FastArray<uint32_t> oldLeaves;
+    FastArray<uint32_t> oldBranches;
+    collectLeaves(element.bottomLeft, element.topRight, oldLeaves, oldBranches);
+
+    element.bottomLeft = newBottomLeft;
+    element.topRight = newTopRight;
+
+    for (size_t i = 0; i < oldLeaves.size(); ++i)
+    {
+        removeFromLeaf(oldLeaves[i], index);
+    }
+
+    m_elementLeaves[index] = NIL;
+    insertElement(index);
+    updateBounds = computeUpdateBounds(newBottomLeft, newTopRight);
+
+    // old leaves may have been split by insert, their children got bounds from it
+    for (size_t i = 0; i < oldLeaves.size(); ++i)
+    {
+        refitNodeBounds(oldLeaves[i]);
+    }
+
+    // insert never turns branches into leaves, so all old branches are still valid.
+    // merges only drop some of the centers update bounds were computed from, so they stay valid
+    while (!oldBranches.empty())
+    {
+        const auto branchIndex = oldBranches.pop();
+        tryMerge(branchIndex);
+        refitNodeBounds(branchIndex);
+    }
+
+    return true;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::queryBatch(
+  std::span<const AABB> areas, QueryBatchResults& results, ThreadPool& pool) const
+{
+    const auto areasCount = areas.size();
+    const auto chunksCount = (areasCount + QUERY_BATCH_CHUNK_SIZE - 1) / QUERY_BATCH_CHUNK_SIZE;
+
+    results.offsets.assign(areasCount + 1, 0);
+    results.threadIds.resize(pool.size());
+    results.threadContexts.resize(pool.size());
+    results.chunkSources.resize(chunksCount);
+    std::atomic<size_t> nextChunk{ 0 };
+
+    pool.run(
+      [&](size_t threadIndex)
+      {
+          auto& ids = results.threadIds[threadIndex];
+          ids.clear();
+          // taken before any chunk, so contexts of all threads grow on the first batch only
+          auto quadsToCheck = getTraversalStack(results.threadContexts[threadIndex]);
+          const auto collect = [&ids](const Payload& id, Point, Point)
+          {
+              ids.push_back(id);
+              return true;
+          };
+
+          for (auto chunk = nextChunk++; chunk < chunksCount; chunk = nextChunk++)
+          {
+              results.chunkSources[chunk] = { uint32_t(threadIndex), ids.size() };
+              const auto firstArea = chunk * QUERY_BATCH_CHUNK_SIZE;
+              const auto lastArea = std::min(firstArea + QUERY_BATCH_CHUNK_SIZE, areasCount);
+              for (auto i = firstArea; i < lastArea; ++i)
+              {
+                  const auto foundBefore = ids.size();
+                  // collect never stops the query, so it leaves the stack empty
+                  queryArea(areas[i].bottomLeft, areas[i].topRight, collect, nullptr, quadsToCheck);
+                  // counts are turned into offsets once all areas are queried
+                  results.offsets[i + 1] = uint32_t(ids.size() - foundBefore);
+              }
+          }
+      });
+
+    for (size_t i = 0; i < areasCount; ++i)
+    {
+        results.offsets[i + 1] += results.offsets[i];
+    }
+    if (pool.size() == 1)
+    {
+        // chunks were queried in order, buffers are swapped to be reused by the next batch
+        std::swap(results.ids, results.threadIds[0]);
+        return;
+    }
+    results.ids.resize(results.offsets.back());
+
+    // every thread moves Ids of the chunks it has queried to their place
+    pool.run(
+      [&](size_t threadIndex)
+      {
+          const auto& ids = results.threadIds[threadIndex];
+          for (size_t chunk = 0; chunk < chunksCount; ++chunk)
+          {
+              const auto [chunkThread, firstId] = results.chunkSources[chunk];
+              if (chunkThread != threadIndex)
+              {
+                  continue;
+              }
+
+              const auto firstArea = chunk * QUERY_BATCH_CHUNK_SIZE;
+              const auto lastArea = std::min(firstArea + QUERY_BATCH_CHUNK_SIZE, areasCount);
+              const auto chunkBegin = ids.begin() + firstId;
+              std::copy(chunkBegin,
+                        chunkBegin + (results.offsets[lastArea] - results.offsets[firstArea]),
+                        results.ids.begin() + results.offsets[firstArea]);
+          }
+      });
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::nearest(
+  Point point, size_t k, std::vector<Payload>& ids, Real maxDistance) const
+{
+    if (k == 0 || !(maxDistance >= 0))
+    {
+        return;
+    }
+
+    // squared distance from the point to rectangle, 0 if the point is inside it
+    const RealPoint realPoint(point);
+    const auto getDistance = [realPoint](RealPoint rectBottomLeft, RealPoint rectTopRight)
+    {
+        const auto dx =
+          std::max({ rectBottomLeft.x - realPoint.x, realPoint.x - rectTopRight.x, Real(0) });
+        const auto dy =
+          std::max({ rectBottomLeft.y - realPoint.y, realPoint.y - rectTopRight.y, Real(0) });
+        return dx * dx + dy * dy;
+    };
+    const auto isCloser = [](const auto& first, const auto& second)
+    { return first.distance < second.distance; };
+    const auto isFarther = [](const auto& first, const auto& second)
+    { return first.distance > second.distance; };
+
+    struct Candidate
+    {
+        Real distance;
+        Payload id;
+    };
+
+    // the best candidates found so far in max-heap, the k-th best one is on the top
+    std::vector<Candidate> candidates;
+    // quads in min-heap, the nearest one is on the top
+    std::vector<BoundedQuadData> quads;
+    // siblings of quads on the way from the popped quad to the leaf, they are pushed to the
+    // heap after the leaf is scanned, so most of them are pruned by its elements
+    std::vector<BoundedQuadData> siblings;
+
+    const auto maxSquaredDistance = maxDistance * maxDistance;
+    // whether element at the squared distance would improve the candidates
+    const auto isImproving = [&](Real distance)
+    {
+        return candidates.size() < k ? distance <= maxSquaredDistance
+                                     : distance < candidates.front().distance;
+    };
+
+    const auto scanLeaf = [&](const QuadNode& quad, const BoundedQuadData& leaf)
+    {
+        const auto capacity = quad.capacity;
+        const auto* minX = m_slots.bounds.data() + 4 * size_t(quad.firstChild);
+        const auto* minY = minX + capacity;
+        const auto* maxX = minY + capacity;
+        const auto* maxY = maxX + capacity;
+        const auto* slotIds = m_slots.ids.data() + quad.firstChild;
+
+        for (uint32_t i = 0; i < quad.count; ++i)
+        {
+            const RealPoint rectMin(minX[i], minY[i]);
+            const RealPoint rectMax(maxX[i], maxY[i]);
+            const auto distance = getDistance(rectMin, rectMax);
+            if (!isImproving(distance))
+            {
+                continue;
+            }
+
+            // element stored in several leaves is found only in the leaf containing its point
+            // nearest to the point. The leaf is not farther than the element, so it's visited
+            // whenever the element is improving
+            if (!isOwnerLeaf(glm::clamp(realPoint, rectMin, rectMax), rectMin, rectMax, leaf))
+            {
+                continue;
+            }
+
+            if (candidates.size() == k)
+            {
+                std::pop_heap(candidates.begin(), candidates.end(), isCloser);
+                candidates.pop_back();
+            }
+            candidates.push_back({ distance, slotIds[i] });
+            std::push_heap(candidates.begin(), candidates.end(), isCloser);
+        }
+    };
+
+    quads.push_back(getRootQuad());
+
+    while (!quads.empty())
+    {
+        std::pop_heap(quads.begin(), quads.end(), isFarther);
+        auto data = quads.back();
+        quads.pop_back();
+
+        // remaining quads are not nearer than this one
+        if (!isImproving(data.distance))
+        {
+            break;
+        }
+
+        // the nearest child is visited right away instead of going through the heap
+        const auto* quad = &m_quadNodes[data.quad.quadIndex];
+        while (quad->isBranch())
+        {
+            BoundedQuadData nearestChild;
+            bool hasNearestChild = false;
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                auto child = getChildQuad(data, quad->firstChild, quadrant);
+                child.distance = getDistance(child.boundsMin, child.boundsMax);
+                if (!isImproving(child.distance))
+                {
+                    continue;
+                }
+
+                if (!hasNearestChild)
+                {
+                    nearestChild = child;
+                    hasNearestChild = true;
+                    continue;
+                }
+                if (child.distance < nearestChild.distance)
+                {
+                    std::swap(child, nearestChild);
+                }
+                siblings.push_back(child);
+            }
+
+            if (!hasNearestChild)
+            {
+                break;
+            }
+            data = nearestChild;
+            quad = &m_quadNodes[data.quad.quadIndex];
+        }
+
+        if (quad->isLeaf())
+        {
+            scanLeaf(*quad, data);
+        }
+
+        for (const auto& sibling : siblings)
+        {
+            if (isImproving(sibling.distance))
+            {
+                quads.push_back(sibling);
+                std::push_heap(quads.begin(), quads.end(), isFarther);
+            }
+        }
+        siblings.clear();
+    }
+
+    std::sort_heap(candidates.begin(), candidates.end(), isCloser);
+    for (const auto& candidate : candidates)
+    {
+        ids.push_back(candidate.id);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::insertElement(uint32_t elementIndex)
+{
+    /*
+     * Cartestian coordinate system is used.
+     * Order of the quadrants in the quadtree:
+     * ┌───┬───┐
+     * │ 1 │ 2 │
+     * ├───┼───┤
+     * │ 3 │ 4 │
+     * └───┴───┘
+     *
+     */
+
+    auto& elementsToInsert = m_insertStack;
+    // at first, we want to insert our new element into root
+    const auto rootSize = m_areaTopRight - m_areaBottomLeft;
+    // the last quadrant found for the element is taken right away instead of going through the
+    // stack, so an element overlapping a single quadrant descends without touching it
+    InsertData nextInsertData{ elementIndex, 0, 0, m_areaBottomLeft, rootSize };
+    bool hasNextInsertData = true;
+
+    while (hasNextInsertData || !elementsToInsert.empty())
+    {
+        if (!hasNextInsertData)
+        {
+            nextInsertData = elementsToInsert.back();
+            elementsToInsert.pop_back();
+        }
+        hasNextInsertData = false;
+
+        // Index of QuadElement we want to insert &&
+        // Index of QuadNode we are working with
+        const auto [currentElementIndex,
+                    currentQuadIndex,
+                    currentDepth,
+                    currentBottomLeft,
+                    currentSize] = nextInsertData;
+        if (m_keepNodeBounds)
+        {
+            const auto& element = m_elements[currentElementIndex];
+            expandBounds(m_nodeBounds[currentQuadIndex], element.bottomLeft, element.topRight);
+        }
+        auto& currentQuad = m_quadNodes[currentQuadIndex];
+        uint32_t currentQuadFirstChild = currentQuad.firstChild;
+
+        if (currentQuad.isLeaf())
+        {
+            // if children count is less than max children count or we reached the max tree
+            // depth
+            // - we can just insert this element to current quadrant
+            if (currentQuad.count < getMaxElementsPerNode() || currentDepth == getMaxDepth())
+            {
+                appendToLeaf(currentQuadIndex, currentElementIndex);
+                continue;
+            }
+            else
+            {
+                // otherwise, subdivide, since max elements count is reached and max depth isn't
+                // reached. take out all elements of current node, subdivide it, then reinsert
+                // all elements again.
+
+                // push elements to reinsert
+                for (uint32_t i = 0; i < currentQuad.count; ++i)
+                {
+                    InsertData insertData;
+                    insertData.elementIndex = getSlotElement(currentQuad, i);
+                    resetUpdateBounds(insertData.elementIndex);
+                    auto& elementLeaf = m_elementLeaves[insertData.elementIndex];
+                    elementLeaf = elementLeaf == MULTIPLE_LEAVES ? MULTIPLE_LEAVES : NIL;
+                    insertData.quadIndex = currentQuadIndex;
+                    insertData.depth = currentDepth;
+                    insertData.bottomLeftBound = currentBottomLeft;
+                    insertData.size = currentSize;
+                    elementsToInsert.push_back(insertData);
+                }
+                if (currentQuad.capacity != 0)
+                {
+                    freeSlots(currentQuad.firstChild, currentQuad.capacity);
+                }
+
+                // we turn current node into branch
+                currentQuad.count = NIL;
+                currentQuad.capacity = 0;
+
+                QuadNode emptyLeaf;
+                emptyLeaf.count = 0;
+                emptyLeaf.firstChild = NIL;
+                emptyLeaf.capacity = 0;
+
+                if (m_freeNode == NIL)
+                {
+                    currentQuadFirstChild = m_quadNodes.size();
+                    currentQuad.firstChild = currentQuadFirstChild;
+                    m_quadNodes.push_back(emptyLeaf);
+                    m_quadNodes.push_back(emptyLeaf);
+                    m_quadNodes.push_back(emptyLeaf);
+                    m_quadNodes.push_back(emptyLeaf);
+                }
+                else
+                {
+                    // reuse block of 4 nodes freed by merge
+                    currentQuadFirstChild = m_freeNode;
+                    currentQuad.firstChild = currentQuadFirstChild;
+                    m_freeNode = m_quadNodes[m_freeNode].firstChild;
+                    m_quadNodes[currentQuadFirstChild + 0] = emptyLeaf;
+                    m_quadNodes[currentQuadFirstChild + 1] = emptyLeaf;
+                    m_quadNodes[currentQuadFirstChild + 2] = emptyLeaf;
+                    m_quadNodes[currentQuadFirstChild + 3] = emptyLeaf;
+                }
+
+                // branch keeps bounds of the same elements, children get them on reinsert
+                if (m_keepNodeBounds)
+                {
+                    m_nodeBounds.resize(m_quadNodes.range(), EMPTY_NODE_BOUNDS);
+                    std::fill_n(
+                      m_nodeBounds.begin() + currentQuadFirstChild, 4, EMPTY_NODE_BOUNDS);
+                }
+            }
+        }
+
+        const auto newSize = getSubQuadSize(currentSize);
+        const auto currentCenter = currentBottomLeft + newSize;
+        const auto newDepth = currentDepth + 1;
+
+        // Since element we want to insert is a rectangle (not a point), it may overlap several
+        // quadrants. In such case, we will insert it in all overlapped quadrants.
+        InsertData subQuadData;
+        subQuadData.depth = newDepth;
+        subQuadData.elementIndex = currentElementIndex;
+        subQuadData.size = newSize;
+
+        // pushes the quadrant found before and keeps this one as the next, so quadrants are
+        // processed in the same order as if all of them were pushed
+        const auto addSubQuad = [&](const InsertData& insertData)
+        {
+            if (hasNextInsertData)
+            {
+                elementsToInsert.push_back(nextInsertData);
+            }
+            nextInsertData = insertData;
+            hasNextInsertData = true;
+        };
+
+        const auto& currentElement = m_elements[currentElementIndex];
+
+        if (currentElement.bottomLeft.x < currentCenter.x &&
+            currentElement.topRight.y > currentCenter.y)
+        {
+            // quadrant #1
+            const auto quad1BottomLeft = currentBottomLeft + Point(0, newSize.y);
+            subQuadData.bottomLeftBound = quad1BottomLeft;
+            subQuadData.quadIndex = currentQuadFirstChild + 0;
+            addSubQuad(subQuadData);
+        }
+        if (currentElement.topRight.x > currentCenter.x &&
+            currentElement.topRight.y > currentCenter.y)
+        {
+            // quadrant #2;
+            subQuadData.bottomLeftBound = currentCenter;
+            subQuadData.quadIndex = currentQuadFirstChild + 1;
+            addSubQuad(subQuadData);
+        }
+        if (currentElement.bottomLeft.x < currentCenter.x &&
+            currentElement.bottomLeft.y < currentCenter.y)
+        {
+            // quadrant #3
+            subQuadData.bottomLeftBound = currentBottomLeft;
+            subQuadData.quadIndex = currentQuadFirstChild + 2;
+            addSubQuad(subQuadData);
+        }
+        if (currentElement.topRight.x > currentCenter.x &&
+            currentElement.bottomLeft.y < currentCenter.y)
+        {
+            // quadrant #4
+            const auto quad4BottomLeft = currentBottomLeft + Point(newSize.x, 0);
+            subQuadData.bottomLeftBound = quad4BottomLeft;
+            subQuadData.quadIndex = currentQuadFirstChild + 3;
+            addSubQuad(subQuadData);
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::initRoot()
+{
+    QuadNode root;
+    root.count = 0;
+    root.firstChild = NIL;
+    root.capacity = 0;
+    m_quadNodes.push_back(root);
+    if (m_keepNodeBounds)
+    {
+        m_nodeBounds.push_back(EMPTY_NODE_BOUNDS);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::collectLeaves(
+  Point rectBottomLeft,
+  Point rectTopRight,
+  FastArray<uint32_t>& leaves,
+  FastArray<uint32_t>& branches) const
+{
+    TraversalStack<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quadsToCheck.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        if (quad.isLeaf())
+        {
+            leaves.push_back(quadIndex);
+            continue;
+        }
+
+        branches.push_back(quadIndex);
+
+        // the same quadrants choice as in insert, so we visit exactly the leaves holding element
+        const auto subQuadSize = getSubQuadSize(size);
+        const auto center = bottomLeft + subQuadSize;
+
+        if (rectBottomLeft.x < center.x && rectTopRight.y > center.y)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 0, bottomLeft + Point(0, subQuadSize.y), subQuadSize });
+        }
+        if (rectTopRight.x > center.x && rectTopRight.y > center.y)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 1, center, subQuadSize });
+        }
+        if (rectBottomLeft.x < center.x && rectBottomLeft.y < center.y)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 2, bottomLeft, subQuadSize });
+        }
+        if (rectTopRight.x > center.x && rectBottomLeft.y < center.y)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 3, bottomLeft + Point(subQuadSize.x, 0), subQuadSize });
+        }
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::isInSameLeaves(
+  Point rectBottomLeft1, Point rectTopRight1, Point rectBottomLeft2, Point rectTopRight2) const
+{
+    TraversalStack<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quadsToCheck.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        if (quad.isLeaf())
+        {
+            continue;
+        }
+
+        const auto subQuadSize = getSubQuadSize(size);
+        const auto center = bottomLeft + subQuadSize;
+        const auto mask = getQuadrantsMask(rectBottomLeft1, rectTopRight1, center);
+
+        if (mask != getQuadrantsMask(rectBottomLeft2, rectTopRight2, center))
+        {
+            return false;
+        }
+
+        if (mask & 1u)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 0, bottomLeft + Point(0, subQuadSize.y), subQuadSize });
+        }
+        if (mask & 2u)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 1, center, subQuadSize });
+        }
+        if (mask & 4u)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 2, bottomLeft, subQuadSize });
+        }
+        if (mask & 8u)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 3, bottomLeft + Point(subQuadSize.x, 0), subQuadSize });
+        }
+    }
+
+    return true;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+auto BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::computeUpdateBounds(
+  Point rectBottomLeft, Point rectTopRight) const -> UpdateBounds
+{
+    // every center visited by insert constrains the corners of rectangle to the side of it
+    // they are currently on, so the traversal is the same while corners stay inside bounds
+    UpdateBounds bounds{ Point(MIN_SCALAR, MIN_SCALAR),
+                         Point(MAX_SCALAR, MAX_SCALAR),
+                         Point(MIN_SCALAR, MIN_SCALAR),
+                         Point(MAX_SCALAR, MAX_SCALAR) };
+
+    // bottom left corner goes to the left (bottom) of the center if it's less than the center
+    const auto constrainBottomLeft = [](Scalar value, Scalar center, Scalar& min, Scalar& max)
+    {
+        if (value < center)
+        {
+            max = std::min(max, center);
+        }
+        else
+        {
+            min = std::max(min, center);
+        }
+    };
+
+    // top right corner goes to the right (top) of the center only if it's greater than the
+    // center, the corner on the center stays on the left (bottom)
+    const auto constrainTopRight = [](Scalar value, Scalar center, Scalar& min, Scalar& max)
+    {
+        if (value > center)
+        {
+            min = std::max(min, center);
+        }
+        else
+        {
+            max = std::min(max, center);
+        }
+    };
+
+    TraversalStack<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto [quadIndex, bottomLeft, size] = quadsToCheck.pop();
+        const auto& quad = m_quadNodes[quadIndex];
+
+        if (quad.isLeaf())
+        {
+            continue;
+        }
+
+        const auto subQuadSize = getSubQuadSize(size);
+        const auto center = bottomLeft + subQuadSize;
+
+        constrainBottomLeft(
+          rectBottomLeft.x, center.x, bounds.bottomLeftMin.x, bounds.bottomLeftMax.x);
+        constrainBottomLeft(
+          rectBottomLeft.y, center.y, bounds.bottomLeftMin.y, bounds.bottomLeftMax.y);
+        constrainTopRight(rectTopRight.x, center.x, bounds.topRightMin.x, bounds.topRightMax.x);
+        constrainTopRight(rectTopRight.y, center.y, bounds.topRightMin.y, bounds.topRightMax.y);
+
+        if (rectBottomLeft.x < center.x && rectTopRight.y > center.y)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 0, bottomLeft + Point(0, subQuadSize.y), subQuadSize });
+        }
+        if (rectTopRight.x > center.x && rectTopRight.y > center.y)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 1, center, subQuadSize });
+        }
+        if (rectBottomLeft.x < center.x && rectBottomLeft.y < center.y)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 2, bottomLeft, subQuadSize });
+        }
+        if (rectTopRight.x > center.x && rectBottomLeft.y < center.y)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 3, bottomLeft + Point(subQuadSize.x, 0), subQuadSize });
+        }
+    }
+
+    return bounds;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::resetUpdateBounds(
+  uint32_t elementIndex)
+{
+    if (elementIndex < m_elementUpdateBounds.size())
+    {
+        m_elementUpdateBounds[elementIndex] = EMPTY_UPDATE_BOUNDS;
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::expandBounds(
+  AABB& bounds, Point rectBottomLeft, Point rectTopRight)
+{
+    bounds.bottomLeft.x = std::min(bounds.bottomLeft.x, rectBottomLeft.x);
+    bounds.bottomLeft.y = std::min(bounds.bottomLeft.y, rectBottomLeft.y);
+    bounds.topRight.x = std::max(bounds.topRight.x, rectTopRight.x);
+    bounds.topRight.y = std::max(bounds.topRight.y, rectTopRight.y);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::refitNodeBounds(uint32_t nodeIndex)
+{
+    if (!m_keepNodeBounds)
+    {
+        return;
+    }
+
+    const auto& node = m_quadNodes[nodeIndex];
+    auto bounds = EMPTY_NODE_BOUNDS;
+    if (node.isBranch())
+    {
+        for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+        {
+            const auto& childBounds = m_nodeBounds[node.firstChild + quadrant];
+            expandBounds(bounds, childBounds.bottomLeft, childBounds.topRight);
+        }
+    }
+    else if (node.count != 0)
+    {
+        const auto* minX = m_slots.bounds.data() + 4 * size_t(node.firstChild);
+        const auto* minY = minX + node.capacity;
+        const auto* maxX = minY + node.capacity;
+        const auto* maxY = maxX + node.capacity;
+        for (uint32_t i = 0; i < node.count; ++i)
+        {
+            expandBounds(bounds, Point(minX[i], minY[i]), Point(maxX[i], maxY[i]));
+        }
+    }
+    m_nodeBounds[nodeIndex] = bounds;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::refitAllNodeBounds()
+{
+    if (!m_keepNodeBounds)
+    {
+        return;
+    }
+
+    // children are refitted before their parents
+    m_nodeBounds.resize(m_quadNodes.range());
+    for (auto nodeIndex = static_cast<uint32_t>(m_quadNodes.range()); nodeIndex-- > 0;)
+    {
+        refitNodeBounds(nodeIndex);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::growNodeBounds(uint32_t elementIndex)
+{
+    if (!m_keepNodeBounds)
+    {
+        return;
+    }
+
+    // bounds of ancestors contain bounds of the leaf, so they don't grow if the leaf's don't
+    const auto& element = m_elements[elementIndex];
+    const auto elementLeaf = m_elementLeaves[elementIndex];
+    if (elementLeaf != NIL && elementLeaf != MULTIPLE_LEAVES)
+    {
+        const auto& leafBounds = m_nodeBounds[elementLeaf];
+        if (leafBounds.bottomLeft.x <= element.bottomLeft.x &&
+            leafBounds.bottomLeft.y <= element.bottomLeft.y &&
+            element.topRight.x <= leafBounds.topRight.x &&
+            element.topRight.y <= leafBounds.topRight.y)
+        {
+            return;
+        }
+    }
+
+    FastArray<uint32_t> leaves;
+    FastArray<uint32_t> branches;
+    collectLeaves(element.bottomLeft, element.topRight, leaves, branches);
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        expandBounds(m_nodeBounds[leaves[i]], element.bottomLeft, element.topRight);
+    }
+    for (size_t i = 0; i < branches.size(); ++i)
+    {
+        expandBounds(m_nodeBounds[branches[i]], element.bottomLeft, element.topRight);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::allocateSlots(uint32_t capacity)
+{
+    // free blocks of class k have at least 2^k slots
+    const auto sizeClass = static_cast<uint32_t>(std::countr_zero(capacity));
+
+    if (std::has_single_bit(capacity) && sizeClass < m_freeSlots.size() &&
+        m_freeSlots[sizeClass] != NIL)
+    {
+        const auto firstSlot = m_freeSlots[sizeClass];
+        m_freeSlots[sizeClass] = m_slots.elementIndices[firstSlot];
+        return firstSlot;
+    }
+
+    const auto firstSlot = static_cast<uint32_t>(m_slots.elementIndices.size());
+    m_slots.bounds.resize(m_slots.bounds.size() + 4 * size_t(capacity));
+    m_slots.ids.resize(m_slots.ids.size() + capacity);
+    m_slots.elementIndices.resize(m_slots.elementIndices.size() + capacity);
+    return firstSlot;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::freeSlots(
+  uint32_t firstSlot, uint32_t capacity)
+{
+    const auto sizeClass = static_cast<uint32_t>(std::bit_width(capacity) - 1);
+
+    if (m_freeSlots.size() <= sizeClass)
+    {
+        m_freeSlots.resize(sizeClass + 1, NIL);
+    }
+    m_slots.elementIndices[firstSlot] = m_freeSlots[sizeClass];
+    m_freeSlots[sizeClass] = firstSlot;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+uint32_t BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::getSlotElement(
+  const QuadNode& leaf, uint32_t offset) const
+{
+    return m_slots.elementIndices[size_t(leaf.firstChild) + offset];
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::writeSlot(
+  const QuadNode& leaf, uint32_t offset, uint32_t elementIndex)
+{
+    const auto& element = m_elements[elementIndex];
+    auto* bounds = m_slots.bounds.data() + 4 * size_t(leaf.firstChild) + offset;
+    bounds[0] = element.bottomLeft.x;
+    bounds[leaf.capacity] = element.bottomLeft.y;
+    bounds[2 * leaf.capacity] = element.topRight.x;
+    bounds[3 * leaf.capacity] = element.topRight.y;
+    m_slots.ids[size_t(leaf.firstChild) + offset] = element.id;
+    m_slots.elementIndices[size_t(leaf.firstChild) + offset] = elementIndex;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::copySlot(
+  const QuadNode& fromLeaf, uint32_t fromOffset, const QuadNode& toLeaf, uint32_t toOffset)
+{
+    const auto* fromBounds = m_slots.bounds.data() + 4 * size_t(fromLeaf.firstChild) + fromOffset;
+    auto* toBounds = m_slots.bounds.data() + 4 * size_t(toLeaf.firstChild) + toOffset;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        toBounds[i * toLeaf.capacity] = fromBounds[i * fromLeaf.capacity];
+    }
+
+    const auto fromSlot = size_t(fromLeaf.firstChild) + fromOffset;
+    const auto toSlot = size_t(toLeaf.firstChild) + toOffset;
+    m_slots.ids[toSlot] = m_slots.ids[fromSlot];
+    m_slots.elementIndices[toSlot] = m_slots.elementIndices[fromSlot];
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::copySlots(const QuadNode& fromLeaf,
+                                                                     const QuadNode& toLeaf)
+{
+    const auto* fromBounds = m_slots.bounds.data() + 4 * size_t(fromLeaf.firstChild);
+    auto* toBounds = m_slots.bounds.data() + 4 * size_t(toLeaf.firstChild);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        std::copy_n(fromBounds + i * size_t(fromLeaf.capacity),
+                    fromLeaf.count,
+                    toBounds + i * size_t(toLeaf.capacity));
+    }
+    std::copy_n(m_slots.ids.begin() + fromLeaf.firstChild,
+                fromLeaf.count,
+                m_slots.ids.begin() + toLeaf.firstChild);
+    std::copy_n(m_slots.elementIndices.begin() + fromLeaf.firstChild,
+                fromLeaf.count,
+                m_slots.elementIndices.begin() + toLeaf.firstChild);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::appendToLeaf(
+  uint32_t leafIndex, uint32_t elementIndex)
+{
+    auto& leaf = m_quadNodes[leafIndex];
+
+    if (leaf.count == leaf.capacity)
+    {
+        const auto oldLeaf = leaf;
+        leaf.capacity = std::max(std::bit_ceil(leaf.capacity + 1), MIN_LEAF_CAPACITY);
+        leaf.firstChild = allocateSlots(leaf.capacity);
+        copySlots(oldLeaf, leaf);
+        if (oldLeaf.capacity != 0)
+        {
+            freeSlots(oldLeaf.firstChild, oldLeaf.capacity);
+        }
+    }
+
+    writeSlot(leaf, leaf.count, elementIndex);
+    ++leaf.count;
+
+    auto& elementLeaf = m_elementLeaves[elementIndex];
+    elementLeaf = elementLeaf == NIL ? leafIndex : MULTIPLE_LEAVES;
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::removeFromLeaf(
+  uint32_t leafIndex, uint32_t elementIndex)
+{
+    auto& leaf = m_quadNodes[leafIndex];
+
+    for (uint32_t i = 0; i < leaf.count; ++i)
+    {
+        if (getSlotElement(leaf, i) != elementIndex)
+        {
+            continue;
+        }
+
+        --leaf.count;
+        if (i != leaf.count)
+        {
+            copySlot(leaf, leaf.count, leaf, i);
+        }
+
+        if (leaf.count == 0)
+        {
+            freeSlots(leaf.firstChild, leaf.capacity);
+            leaf.firstChild = NIL;
+            leaf.capacity = 0;
+        }
+        return;
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::rewriteElementSlots(
+  uint32_t elementIndex)
+{
+    const auto rewriteInLeaf = [this, elementIndex](uint32_t leafIndex)
+    {
+        const auto& leaf = m_quadNodes[leafIndex];
+        for (uint32_t i = 0; i < leaf.count; ++i)
+        {
+            if (getSlotElement(leaf, i) == elementIndex)
+            {
+                writeSlot(leaf, i, elementIndex);
+                return;
+            }
+        }
+    };
+
+    const auto elementLeaf = m_elementLeaves[elementIndex];
+    if (elementLeaf == NIL)
+    {
+        return;
+    }
+    if (elementLeaf != MULTIPLE_LEAVES)
+    {
+        rewriteInLeaf(elementLeaf);
+        return;
+    }
+
+    // leaves are the same for old and new bounds, so they are found by the new ones
+    const auto& element = m_elements[elementIndex];
+    FastArray<uint32_t> leaves;
+    FastArray<uint32_t> branches;
+    collectLeaves(element.bottomLeft, element.topRight, leaves, branches);
+
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        rewriteInLeaf(leaves[i]);
+    }
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+void BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>::tryMerge(uint32_t branchIndex)
+{
+    const auto firstChild = m_quadNodes[branchIndex].firstChild;
+
+    uint32_t totalCount = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const auto& child = m_quadNodes[firstChild + i];
+        if (child.isBranch())
+        {
+            return;
+        }
+        totalCount += child.count;
+    }
+
+    if (totalCount >= getMaxElementsPerNode())
+    {
+        return;
+    }
+
+    // move slots of children into the parent, dropping copies of elements
+    // which were stored in several children
+    QuadNode merged;
+    merged.count = 0;
+    merged.capacity = totalCount == 0 ? 0 : std::max(std::bit_ceil(totalCount), MIN_LEAF_CAPACITY);
+    merged.firstChild = totalCount == 0 ? NIL : allocateSlots(merged.capacity);
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const auto childIndex = firstChild + i;
+        const auto child = m_quadNodes[childIndex];
+        for (uint32_t offset = 0; offset < child.count; ++offset)
+        {
+            const auto elementIndex = getSlotElement(child, offset);
+            bool isDuplicate = false;
+            for (uint32_t mergedOffset = 0; mergedOffset < merged.count; ++mergedOffset)
+            {
+                if (getSlotElement(merged, mergedOffset) == elementIndex)
+                {
+                    isDuplicate = true;
+                    break;
+                }
+            }
+
+            if (!isDuplicate)
+            {
+                copySlot(child, offset, merged, merged.count);
+                ++merged.count;
+                if (m_elementLeaves[elementIndex] == childIndex)
+                {
+                    m_elementLeaves[elementIndex] = branchIndex;
+                }
+            }
+        }
+
+        if (child.capacity != 0)
+        {
+            freeSlots(child.firstChild, child.capacity);
+        }
+    }
+
+    m_quadNodes[branchIndex] = merged;
+
+    m_quadNodes[firstChild].firstChild = m_freeNode;
+    m_freeNode = firstChild;
+}
+
+}
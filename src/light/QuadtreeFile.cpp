@@ -0,0 +1,78 @@
+﻿#include "QuadtreeFile.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <vector>
+
+namespace light
+{
+
+namespace
+{
+
+uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + QUADTREE_FILE_ALIGNMENT - 1) / QUADTREE_FILE_ALIGNMENT *
+           QUADTREE_FILE_ALIGNMENT;
+}
+
+void writeLittleEndian(std::ofstream& file, const void* data, size_t elementSize, size_t count)
+{
+    const auto* bytes = static_cast<const char*>(data);
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        file.write(bytes, static_cast<std::streamsize>(elementSize * count));
+    }
+    else
+    {
+        std::vector<char> element(elementSize);
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::reverse_copy(
+              bytes + i * elementSize, bytes + (i + 1) * elementSize, element.begin());
+            file.write(element.data(), static_cast<std::streamsize>(elementSize));
+        }
+    }
+}
+
+}
+
+bool writeQuadtreeFile(const std::filesystem::path& path,
+                       QuadtreeFileHeader header,
+                       std::span<const QuadtreeFileArray, QUADTREE_FILE_SECTIONS_COUNT> sections)
+{
+    uint64_t offset = sizeof(QuadtreeFileHeader);
+    for (uint32_t section = 0; section < QUADTREE_FILE_SECTIONS_COUNT; ++section)
+    {
+        offset = alignOffset(offset);
+        header.sectionOffsets[section] = offset;
+        offset += uint64_t(sections[section].elementSize) * sections[section].count;
+    }
+    header.fileSize = offset;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        return false;
+    }
+
+    // all fields of the header are 64-bit
+    writeLittleEndian(
+      file, &header, sizeof(uint64_t), sizeof(QuadtreeFileHeader) / sizeof(uint64_t));
+
+    constexpr char padding[QUADTREE_FILE_ALIGNMENT] = {};
+    uint64_t written = sizeof(QuadtreeFileHeader);
+    for (uint32_t section = 0; section < QUADTREE_FILE_SECTIONS_COUNT; ++section)
+    {
+        const auto& array = sections[section];
+        file.write(padding, static_cast<std::streamsize>(header.sectionOffsets[section] - written));
+        writeLittleEndian(file, array.data, array.elementSize, array.count);
+        written = header.sectionOffsets[section] + uint64_t(array.elementSize) * array.count;
+    }
+
+    file.close();
+    return !file.fail();
+}
+
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace light
+{
+
+// First bytes of quadtree file, "LQUADTRE" read as little endian integer.
+constexpr uint64_t QUADTREE_FILE_MAGIC = 0x455254444155514C;
+// Version of the layout, files of other versions are rejected.
+constexpr uint64_t QUADTREE_FILE_VERSION = 1;
+// Alignment of sections in the file, mapped sections start at cache line boundaries.
+constexpr uint64_t QUADTREE_FILE_ALIGNMENT = 64;
+
+// Sections of quadtree file in the order they follow the header: corners of work area (bottom
+// left x, y, top right x, y), nodes (firstChild, count and capacity of every QuadNode), bounds
+// of leaf slots in blocks of BasicQuadtree::LeafSlots and Ids of leaf slots.
+constexpr uint32_t QUADTREE_FILE_AREA = 0;
+constexpr uint32_t QUADTREE_FILE_NODES = 1;
+constexpr uint32_t QUADTREE_FILE_BOUNDS = 2;
+constexpr uint32_t QUADTREE_FILE_IDS = 3;
+constexpr uint32_t QUADTREE_FILE_SECTIONS_COUNT = 4;
+
+// Kinds of coordinates stored in quadtree file.
+constexpr uint64_t QUADTREE_FILE_FLOATING_POINT = 0;
+constexpr uint64_t QUADTREE_FILE_INTEGER = 1;
+
+// Header of quadtree file. Fields of the header and of arrays in sections are stored in little
+// endian.
+struct QuadtreeFileHeader
+{
+    uint64_t magic;
+    uint64_t version;
+    // Kind and size in bytes of coordinates, size in bytes of Ids.
+    uint64_t scalarKind;
+    uint64_t scalarSize;
+    uint64_t payloadSize;
+    uint64_t elementsCount;
+    uint64_t nodesCount;
+    uint64_t slotsCount;
+    // Offsets of sections from the start of the file, multiples of QUADTREE_FILE_ALIGNMENT.
+    uint64_t sectionOffsets[QUADTREE_FILE_SECTIONS_COUNT];
+    uint64_t fileSize;
+};
+
+static_assert(sizeof(QuadtreeFileHeader) == 13 * sizeof(uint64_t));
+
+// Array written to a section of quadtree file.
+struct QuadtreeFileArray
+{
+    const void* data;
+    // Size of array elements in bytes, every element is written as a little endian integer of
+    // this size.
+    size_t elementSize;
+    size_t count;
+};
+
+/**
+ * @brief Writes quadtree file with header followed by sections.
+ * @param header Header with all fields except offsets and size of the file, they are filled by
+ * the function.
+ * @return False if the file can't be written.
+ */
+bool writeQuadtreeFile(const std::filesystem::path& path,
+                       QuadtreeFileHeader header,
+                       std::span<const QuadtreeFileArray, QUADTREE_FILE_SECTIONS_COUNT> sections);
+
+}
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include <light/Quadtree.h>
+#include <light/QuadtreeFile.h>
+
+#include <filesystem>
+#include <type_traits>
+#include <vector>
+
+namespace light
+{
+
+// Friend of BasicQuadtree writing its storage to quadtree files.
+class QuadtreeWriter
+{
+public:
+    template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+    static bool save(const BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>& quadtree,
+                     const std::filesystem::path& path);
+};
+
+/**
+ * @brief Writes flat image of the quadtree described by QuadtreeFileHeader: its nodes and bounds
+ * and Ids of leaf slots, the way they are stored in memory. Image of Quadtree can be mapped by
+ * QuadtreeView and queried without loading.
+ * @return False if the file can't be written.
+ */
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool saveQuadtree(const BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>& quadtree,
+                  const std::filesystem::path& path)
+{
+    return QuadtreeWriter::save(quadtree, path);
+}
+
+template<typename Scalar, uint32_t LeafCapacity, uint32_t MaxDepth, typename Payload>
+bool QuadtreeWriter::save(const BasicQuadtree<Scalar, LeafCapacity, MaxDepth, Payload>& quadtree,
+                          const std::filesystem::path& path)
+{
+    static_assert(std::is_integral_v<Payload>, "Ids are written as little endian integers");
+
+    const Scalar areaCorners[4] = { quadtree.m_areaBottomLeft.x,
+                                    quadtree.m_areaBottomLeft.y,
+                                    quadtree.m_areaTopRight.x,
+                                    quadtree.m_areaTopRight.y };
+    const auto& quadNodes = quadtree.m_quadNodes;
+    const auto& slots = quadtree.m_slots;
+    std::vector<uint32_t> nodes;
+    nodes.reserve(3 * quadNodes.range());
+    for (uint32_t nodeIndex = 0; nodeIndex < quadNodes.range(); ++nodeIndex)
+    {
+        const auto& node = quadNodes[nodeIndex];
+        nodes.insert(nodes.end(), { node.firstChild, node.count, node.capacity });
+    }
+
+    QuadtreeFileHeader header{};
+    header.magic = QUADTREE_FILE_MAGIC;
+    header.version = QUADTREE_FILE_VERSION;
+    header.scalarKind =
+      std::is_floating_point_v<Scalar> ? QUADTREE_FILE_FLOATING_POINT : QUADTREE_FILE_INTEGER;
+    header.scalarSize = sizeof(Scalar);
+    header.payloadSize = sizeof(Payload);
+    header.elementsCount = quadtree.m_elements.size();
+    header.nodesCount = quadNodes.range();
+    header.slotsCount = slots.ids.size();
+
+    const QuadtreeFileArray sections[QUADTREE_FILE_SECTIONS_COUNT] = {
+        { areaCorners, sizeof(Scalar), 4 },
+        { nodes.data(), sizeof(uint32_t), nodes.size() },
+        { slots.bounds.data(), sizeof(Scalar), slots.bounds.size() },
+        { slots.ids.data(), sizeof(Payload), slots.ids.size() }
+    };
+    return writeQuadtreeFile(path, header, sections);
+}
+
+}
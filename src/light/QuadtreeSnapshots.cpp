@@ -0,0 +1,8 @@
+﻿#include "QuadtreeSnapshots.h"
+
+namespace light
+{
+
+template class QuadtreeSnapshots<Quadtree>;
+
+}
@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#include <light/Quadtree.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace light
+{
+
+/**
+ * @brief Double-buffered tree published to concurrent readers. The writer rebuilds the back
+ * buffer while readers query the published version, then publish swaps them, so readers never
+ * wait for rebuilds and rebuilds never wait for readers. Readers keep the version they acquired
+ * alive until they release it, it's never modified after publishing. The retired version becomes
+ * the next back buffer once readers release it, a new tree is allocated only if some reader
+ * still holds it when the writer asks for the back buffer.
+ * @tparam Tree Tree with const queries safe to call concurrently, e.g. Quadtree.
+ */
+template<typename Tree>
+class QuadtreeSnapshots
+{
+public:
+    /**
+     * @brief Publishes an empty tree.
+     * @param args Arguments of Tree constructor, every buffer is constructed from them.
+     */
+    template<typename... Args>
+    explicit QuadtreeSnapshots(const Args&... args);
+
+    QuadtreeSnapshots(const QuadtreeSnapshots&) = delete;
+    QuadtreeSnapshots& operator=(const QuadtreeSnapshots&) = delete;
+
+    /**
+     * @brief Returns the published version, it stays valid and unchanged while it's held, even
+     * after QuadtreeSnapshots is destroyed. Safe to call from any thread concurrently with the
+     * writer.
+     */
+    std::shared_ptr<const Tree> acquire() const;
+
+    /**
+     * @brief Returns the back buffer invisible to readers. It keeps content of an older version
+     * or is empty, so it's meant to be rebuilt with build() or cleared before use. Must be
+     * called by the writer thread only.
+     */
+    Tree& back();
+
+    /**
+     * @brief Makes the buffer returned by the last back() the published version, readers
+     * acquiring after that see all changes done to it. Must be called by the writer thread only,
+     * after back().
+     */
+    void publish();
+
+private:
+    struct Buffer
+    {
+        template<typename... Args>
+        explicit Buffer(const Args&... args)
+          : tree(args...)
+        {
+        }
+
+        Tree tree;
+        // Set when the last reader of the published version releases it.
+        std::atomic<bool> isReleased{ true };
+    };
+
+    // Constructs a new buffer from arguments of QuadtreeSnapshots constructor.
+    std::function<std::shared_ptr<Buffer>()> m_makeBuffer;
+    // Guards only copies and swaps of the published pointer, never held while trees are built
+    // or queried. Unlike std::atomic<std::shared_ptr>, it's available in every standard library.
+    mutable std::mutex m_publishedMutex;
+    std::shared_ptr<const Tree> m_published;
+    // Buffers of the published version and the back one, owned by the writer.
+    std::shared_ptr<Buffer> m_front;
+    std::shared_ptr<Buffer> m_back;
+};
+
+template<typename Tree>
+template<typename... Args>
+QuadtreeSnapshots<Tree>::QuadtreeSnapshots(const Args&... args)
+  : m_makeBuffer{ [args...]() { return std::make_shared<Buffer>(args...); } }
+  , m_back{ m_makeBuffer() }
+{
+    publish();
+}
+
+template<typename Tree>
+std::shared_ptr<const Tree> QuadtreeSnapshots<Tree>::acquire() const
+{
+    std::lock_guard lock{ m_publishedMutex };
+    return m_published;
+}
+
+template<typename Tree>
+Tree& QuadtreeSnapshots<Tree>::back()
+{
+    // the retired version can't be acquired anymore, so once released it stays released. its
+    // last reader sets the flag with release store, so its reads precede our writes
+    if (!m_back || !m_back->isReleased.load(std::memory_order_acquire))
+    {
+        m_back = m_makeBuffer();
+    }
+    return m_back->tree;
+}
+
+template<typename Tree>
+void QuadtreeSnapshots<Tree>::publish()
+{
+    // readers share the tree through their own pointer, which marks the buffer released when
+    // the last of them is gone and keeps the buffer alive until then
+    m_back->isReleased.store(false, std::memory_order_relaxed);
+    std::shared_ptr<const Tree> published{
+        &m_back->tree,
+        [buffer = m_back](const Tree*)
+        { buffer->isReleased.store(true, std::memory_order_release); }
+    };
+    {
+        std::lock_guard lock{ m_publishedMutex };
+        m_published.swap(published);
+    }
+    m_front.swap(m_back);
+}
+
+}
@@ -0,0 +1,281 @@
+﻿#include "QuadtreeView.h"
+
+#include <light/QuadtreeFile.h>
+
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace light
+{
+
+namespace
+{
+
+// Maps the whole file for reading, returns null if it can't be mapped or is empty.
+const std::byte* mapFile(const std::filesystem::path& path, size_t& size)
+{
+#ifdef _WIN32
+    const auto file = CreateFileW(path.c_str(),
+                                  GENERIC_READ,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL,
+                                  nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    LARGE_INTEGER fileSize;
+    const void* data = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        // the view keeps the mapping alive after its handle is closed
+        const auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+        size = static_cast<size_t>(fileSize.QuadPart);
+    }
+    CloseHandle(file);
+    return static_cast<const std::byte*>(data);
+#else
+    const auto file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat fileStat;
+    void* data = MAP_FAILED;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+    {
+        size = static_cast<size_t>(fileStat.st_size);
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    }
+    // the mapping stays valid after the file is closed
+    ::close(file);
+    return data == MAP_FAILED ? nullptr : static_cast<const std::byte*>(data);
+#endif
+}
+
+void unmapFile(const std::byte* data, size_t size)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<std::byte*>(data), size);
+#endif
+}
+
+}
+
+QuadtreeView::~QuadtreeView()
+{
+    close();
+}
+
+QuadtreeView::QuadtreeView(QuadtreeView&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+QuadtreeView& QuadtreeView::operator=(QuadtreeView&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_dataSize = std::exchange(other.m_dataSize, 0);
+        m_nodes = std::exchange(other.m_nodes, nullptr);
+        m_bounds = std::exchange(other.m_bounds, nullptr);
+        m_ids = std::exchange(other.m_ids, nullptr);
+        m_elementsCount = std::exchange(other.m_elementsCount, 0);
+        m_areaBottomLeft = other.m_areaBottomLeft;
+        m_areaTopRight = other.m_areaTopRight;
+    }
+    return *this;
+}
+
+bool QuadtreeView::open(const std::filesystem::path& path)
+{
+    close();
+
+    m_data = mapFile(path, m_dataSize);
+    if (!m_data)
+    {
+        m_dataSize = 0;
+        return false;
+    }
+
+    if (!attach())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void QuadtreeView::close()
+{
+    if (m_data)
+    {
+        unmapFile(m_data, m_dataSize);
+    }
+    m_data = nullptr;
+    m_dataSize = 0;
+    m_nodes = nullptr;
+    m_bounds = nullptr;
+    m_ids = nullptr;
+    m_elementsCount = 0;
+}
+
+bool QuadtreeView::isOpen() const
+{
+    return m_nodes != nullptr;
+}
+
+size_t QuadtreeView::size() const
+{
+    return m_elementsCount;
+}
+
+bool QuadtreeView::attach()
+{
+    // mapped arrays are used as they are, so they must be in the byte order of this machine
+    if constexpr (std::endian::native != std::endian::little)
+    {
+        return false;
+    }
+
+    QuadtreeFileHeader header;
+    if (m_dataSize < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, m_data, sizeof(header));
+
+    if (header.magic != QUADTREE_FILE_MAGIC || header.version != QUADTREE_FILE_VERSION ||
+        header.scalarKind != QUADTREE_FILE_FLOATING_POINT || header.scalarSize != sizeof(float) ||
+        header.payloadSize != sizeof(Id) || header.fileSize != m_dataSize ||
+        header.nodesCount == 0 || header.nodesCount > NIL || header.slotsCount > NIL)
+    {
+        return false;
+    }
+
+    // every section lies inside the file and is aligned for its arrays
+    const uint64_t sectionSizes[QUADTREE_FILE_SECTIONS_COUNT] = {
+        4 * sizeof(float),
+        3 * sizeof(uint32_t) * header.nodesCount,
+        4 * sizeof(float) * header.slotsCount,
+        sizeof(Id) * header.slotsCount
+    };
+    for (uint32_t section = 0; section < QUADTREE_FILE_SECTIONS_COUNT; ++section)
+    {
+        const auto offset = header.sectionOffsets[section];
+        if (offset % QUADTREE_FILE_ALIGNMENT != 0 || offset > m_dataSize ||
+            sectionSizes[section] > m_dataSize - offset)
+        {
+            return false;
+        }
+    }
+
+    const auto getSection = [&](uint32_t section)
+    { return m_data + header.sectionOffsets[section]; };
+    float areaCorners[4];
+    std::memcpy(areaCorners, getSection(QUADTREE_FILE_AREA), sizeof(areaCorners));
+    m_areaBottomLeft = Point(areaCorners[0], areaCorners[1]);
+    m_areaTopRight = Point(areaCorners[2], areaCorners[3]);
+    m_nodes = reinterpret_cast<const uint32_t*>(getSection(QUADTREE_FILE_NODES));
+    m_bounds = reinterpret_cast<const float*>(getSection(QUADTREE_FILE_BOUNDS));
+    m_ids = reinterpret_cast<const Id*>(getSection(QUADTREE_FILE_IDS));
+    m_elementsCount = header.elementsCount;
+
+    // nodes reachable from the root point inside the sections, freed ones aren't checked.
+    // visiting more nodes than there are means a cycle
+    const auto nodesCount = static_cast<uint32_t>(header.nodesCount);
+    const auto slotsCount = static_cast<uint32_t>(header.slotsCount);
+    FastArray<uint32_t> nodesToCheck;
+    nodesToCheck.push_back(0);
+    uint64_t visitedCount = 0;
+    while (!nodesToCheck.empty())
+    {
+        const auto node = getNode(nodesToCheck.pop());
+        if (++visitedCount > nodesCount)
+        {
+            return false;
+        }
+
+        if (node.isBranch())
+        {
+            if (node.firstChild >= nodesCount || nodesCount - node.firstChild < 4)
+            {
+                return false;
+            }
+            for (uint32_t quadrant = 0; quadrant < 4; ++quadrant)
+            {
+                nodesToCheck.push_back(node.firstChild + quadrant);
+            }
+        }
+        else if (node.count != 0 &&
+                 (node.count > node.capacity || node.capacity % LEAF_SCAN_WIDTH != 0 ||
+                  node.firstChild >= slotsCount || slotsCount - node.firstChild < node.capacity))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+QuadNode QuadtreeView::getNode(uint32_t nodeIndex) const
+{
+    const auto* fields = m_nodes + 3 * size_t(nodeIndex);
+    QuadNode node;
+    node.firstChild = fields[0];
+    node.count = fields[1];
+    node.capacity = fields[2];
+    return node;
+}
+
+Point QuadtreeView::getLeafCornerBound(Point leafBottomLeft) const
+{
+    constexpr auto unbounded = -std::numeric_limits<float>::infinity();
+    return { leafBottomLeft.x == m_areaBottomLeft.x ? unbounded : leafBottomLeft.x,
+             leafBottomLeft.y == m_areaBottomLeft.y ? unbounded : leafBottomLeft.y };
+}
+
+bool QuadtreeView::isValidRectangle(Point rectBottomLeft, Point rectTopRight) const
+{
+    // if ill-formed rectangle
+    if (rectBottomLeft.x > rectTopRight.x || rectBottomLeft.y > rectTopRight.y)
+    {
+        return false;
+    }
+
+    // if rectangle is outside of work area
+    if (rectBottomLeft.x > m_areaTopRight.x || rectTopRight.x < m_areaBottomLeft.x ||
+        rectBottomLeft.y > m_areaTopRight.y || rectTopRight.y < m_areaBottomLeft.y)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,213 @@
+﻿#pragma once
+
+#include <light/FastArray.h>
+#include <light/LeafScan.h>
+#include <light/Quadtree.h>
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+
+namespace light
+{
+
+/**
+ * @brief Read-only Quadtree mapped from the file written by saveQuadtree. Queries run on the
+ * mapped bytes, nothing is deserialized: opening validates only reachable nodes, leaves are
+ * paged in by the first queries touching them, and processes mapping the same file share its
+ * pages in the page cache. Files of Quadtree, with float coordinates and Id, are supported.
+ */
+class QuadtreeView
+{
+public:
+    QuadtreeView() = default;
+
+    ~QuadtreeView();
+
+    QuadtreeView(QuadtreeView&& other) noexcept;
+    QuadtreeView& operator=(QuadtreeView&& other) noexcept;
+
+    QuadtreeView(const QuadtreeView&) = delete;
+    QuadtreeView& operator=(const QuadtreeView&) = delete;
+
+    /**
+     * @brief Maps the file, previously mapped one is unmapped.
+     * @return False if the file can't be mapped or isn't a valid image of Quadtree, the view is
+     * left closed in such case.
+     */
+    bool open(const std::filesystem::path& path);
+
+    void close();
+
+    bool isOpen() const;
+
+    size_t size() const;
+
+    using IterateObjectsCallback =
+      std::function<bool(const Id& id, Point bottomLeft, Point topRight)>;
+
+    /**
+     * @brief Calls callback once for every element overlapping specified area, the same
+     * elements in the same order Quadtree::forEachObjectInArea reports.
+     * @tparam Callback Any callable with signature of IterateObjectsCallback. Iteration stops
+     * when callback returns false.
+     */
+    template<typename Callback>
+    void forEachObjectInArea(Point areaBottomLeft, Point areaTopRight, Callback&& callback) const;
+
+    /**
+     * @brief Appends Ids of elements overlapping specified area to the container, every Id is
+     * appended once.
+     * @tparam Container Container of Ids with push_back, e.g. std::vector<Id>.
+     */
+    template<typename Container>
+    void findObjectsInArea(Point areaBottomLeft, Point areaTopRight, Container& ids) const;
+
+private:
+    struct TraverseQuadData
+    {
+        uint32_t quadIndex;
+        Point bottomLeft;
+        Point size;
+    };
+
+    // Checks header and reachable nodes of the mapped file and points sections to it. View is
+    // closed by caller if it fails.
+    bool attach();
+
+    // Node stored as 3 consecutive fields of the nodes section.
+    QuadNode getNode(uint32_t nodeIndex) const;
+
+    // See Quadtree::getLeafCornerBound.
+    Point getLeafCornerBound(Point leafBottomLeft) const;
+
+    bool isValidRectangle(Point rectBottomLeft, Point rectTopRight) const;
+
+    // Mapped file.
+    const std::byte* m_data = nullptr;
+    size_t m_dataSize = 0;
+
+    // Sections of the mapped file.
+    const uint32_t* m_nodes = nullptr;
+    const float* m_bounds = nullptr;
+    const Id* m_ids = nullptr;
+    size_t m_elementsCount = 0;
+
+    Point m_areaBottomLeft{ 0, 0 };
+    Point m_areaTopRight{ 0, 0 };
+};
+
+template<typename Callback>
+void QuadtreeView::forEachObjectInArea(Point areaBottomLeft,
+                                       Point areaTopRight,
+                                       Callback&& callback) const
+{
+    if (!isOpen() || !isValidRectangle(areaBottomLeft, areaTopRight))
+    {
+        return;
+    }
+
+    // the same traversal as in Quadtree, so quads and corner bounds are computed the same way
+    FastArray<TraverseQuadData> quadsToCheck;
+    quadsToCheck.push_back({ 0, m_areaBottomLeft, m_areaTopRight - m_areaBottomLeft });
+
+    while (!quadsToCheck.empty())
+    {
+        const auto quadData = quadsToCheck.pop();
+        const auto quad = getNode(quadData.quadIndex);
+
+        if (quad.isLeaf())
+        {
+            if (quad.count == 0)
+            {
+                continue;
+            }
+
+            const auto* minX = m_bounds + 4 * size_t(quad.firstChild);
+            const auto* minY = minX + quad.capacity;
+            const auto* maxX = minY + quad.capacity;
+            const auto* maxY = maxX + quad.capacity;
+            const auto* ids = m_ids + quad.firstChild;
+            const auto cornerBound = getLeafCornerBound(quadData.bottomLeft);
+
+            // capacity is a multiple of LEAF_SCAN_WIDTH, so the kernel stays inside the block
+            for (uint32_t first = 0; first < quad.count; first += LEAF_SCAN_WIDTH)
+            {
+                auto mask = getOverlapMask(minX + first,
+                                           minY + first,
+                                           maxX + first,
+                                           maxY + first,
+                                           areaBottomLeft,
+                                           areaTopRight);
+                if (quad.count - first < LEAF_SCAN_WIDTH)
+                {
+                    mask &= (1u << (quad.count - first)) - 1;
+                }
+
+                while (mask != 0)
+                {
+                    const auto i = first + static_cast<uint32_t>(std::countr_zero(mask));
+                    mask &= mask - 1;
+                    if (std::max(minX[i], areaBottomLeft.x) < cornerBound.x ||
+                        std::max(minY[i], areaBottomLeft.y) < cornerBound.y)
+                    {
+                        continue;
+                    }
+                    if (!callback(ids[i], Point(minX[i], minY[i]), Point(maxX[i], maxY[i])))
+                    {
+                        return;
+                    }
+                }
+            }
+            continue;
+        }
+
+        const auto subQuadSize = quadData.size / 2.0f;
+        const auto center = quadData.bottomLeft + subQuadSize;
+        const auto& bottomLeft = quadData.bottomLeft;
+
+        // area of zero width (height) lying on the center goes to the right (top) child, the
+        // same as in Quadtree
+        const bool isLeft = areaBottomLeft.x < center.x;
+        const bool isRight = areaTopRight.x > center.x || areaBottomLeft.x == center.x;
+        const bool isBottom = areaBottomLeft.y < center.y;
+        const bool isTop = areaTopRight.y > center.y || areaBottomLeft.y == center.y;
+
+        if (isLeft && isTop)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 0, bottomLeft + Point(0, subQuadSize.y), subQuadSize });
+        }
+        if (isRight && isTop)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 1, center, subQuadSize });
+        }
+        if (isLeft && isBottom)
+        {
+            quadsToCheck.push_back({ quad.firstChild + 2, bottomLeft, subQuadSize });
+        }
+        if (isRight && isBottom)
+        {
+            quadsToCheck.push_back(
+              { quad.firstChild + 3, bottomLeft + Point(subQuadSize.x, 0), subQuadSize });
+        }
+    }
+}
+
+template<typename Container>
+void QuadtreeView::findObjectsInArea(Point areaBottomLeft,
+                                     Point areaTopRight,
+                                     Container& ids) const
+{
+    forEachObjectInArea(areaBottomLeft,
+                        areaTopRight,
+                        [&ids](const Id& id, Point, Point)
+                        {
+                            ids.push_back(id);
+                            return true;
+                        });
+}
+
+}
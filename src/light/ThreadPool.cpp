@@ -0,0 +1,139 @@
+﻿#include "ThreadPool.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace light
+{
+
+ThreadPool::ThreadPool(size_t threadsCount)
+  : m_task{ nullptr }
+  , m_runCounter{ 0 }
+  , m_busyWorkersCount{ 0 }
+  , m_isStopping{ false }
+{
+    if (threadsCount == 0)
+    {
+        threadsCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    m_workers.reserve(threadsCount - 1);
+    for (size_t i = 1; i < threadsCount; ++i)
+    {
+        m_workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_isStopping = true;
+    }
+    m_taskCondition.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return m_workers.size() + 1;
+}
+
+void ThreadPool::run(const Task& task)
+{
+    {
+        std::lock_guard lock{ m_mutex };
+        m_task = &task;
+        m_busyWorkersCount = m_workers.size();
+        m_exception = nullptr;
+        ++m_runCounter;
+    }
+    m_taskCondition.notify_all();
+
+    try
+    {
+        task(0);
+    }
+    catch (...)
+    {
+        storeException(std::current_exception());
+    }
+
+    std::unique_lock lock{ m_mutex };
+    m_doneCondition.wait(lock, [this]() { return m_busyWorkersCount == 0; });
+    m_task = nullptr;
+
+    if (m_exception)
+    {
+        std::rethrow_exception(std::exchange(m_exception, nullptr));
+    }
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             const std::function<void(size_t begin, size_t end)>& function)
+{
+    run(
+      [this, count, &function](size_t threadIndex)
+      {
+          const auto begin = count * threadIndex / size();
+          const auto end = count * (threadIndex + 1) / size();
+          if (begin < end)
+          {
+              function(begin, end);
+          }
+      });
+}
+
+void ThreadPool::workerLoop(size_t threadIndex)
+{
+    uint64_t lastRun = 0;
+    while (true)
+    {
+        const Task* task = nullptr;
+        {
+            std::unique_lock lock{ m_mutex };
+            m_taskCondition.wait(
+              lock, [this, lastRun]() { return m_isStopping || m_runCounter != lastRun; });
+            if (m_isStopping)
+            {
+                return;
+            }
+            lastRun = m_runCounter;
+            task = m_task;
+        }
+
+        try
+        {
+            (*task)(threadIndex);
+        }
+        catch (...)
+        {
+            storeException(std::current_exception());
+        }
+
+        bool isLast = false;
+        {
+            std::lock_guard lock{ m_mutex };
+            isLast = --m_busyWorkersCount == 0;
+        }
+        if (isLast)
+        {
+            m_doneCondition.notify_one();
+        }
+    }
+}
+
+void ThreadPool::storeException(std::exception_ptr exception)
+{
+    std::lock_guard lock{ m_mutex };
+    if (!m_exception)
+    {
+        m_exception = exception;
+    }
+}
+
+}
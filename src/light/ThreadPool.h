@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace light
+{
+
+/**
+ * @brief Fixed set of threads running the same task in parallel. Threads are started once and
+ * wait for the next task between runs, so a run costs a wake up instead of thread creation.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void(size_t threadIndex)>;
+
+    /**
+     * @brief Starts worker threads.
+     * @param threadsCount Count of threads running every task, including the thread calling
+     * run. 0 means hardware concurrency.
+     */
+    explicit ThreadPool(size_t threadsCount = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    /**
+     * @brief Calls task on every thread of the pool with indices in [0, size()), the calling
+     * thread runs it with index 0. Returns when all threads are done. The first exception
+     * thrown by the task is rethrown after that.
+     */
+    void run(const Task& task);
+
+    /**
+     * @brief Splits [0, count) into contiguous ranges, one per thread, and calls function for
+     * every non-empty range on its thread.
+     */
+    void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function);
+
+private:
+    void workerLoop(size_t threadIndex);
+
+    // Stores the first exception thrown by the task of the current run.
+    void storeException(std::exception_ptr exception);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_taskCondition;
+    std::condition_variable m_doneCondition;
+    // Task of the current run, workers pick it up when run counter changes.
+    const Task* m_task;
+    uint64_t m_runCounter;
+    // Workers which haven't finished the task of the current run yet.
+    size_t m_busyWorkersCount;
+    std::exception_ptr m_exception;
+    bool m_isStopping;
+};
+
+}
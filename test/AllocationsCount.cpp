@@ -0,0 +1,43 @@
+﻿#include "AllocationsCount.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+std::atomic<size_t> allocationsCount{ 0 };
+
+}
+
+// replaced in their own translation unit, so they aren't inlined into code freeing memory
+void* operator new(std::size_t size)
+{
+    ++allocationsCount;
+    if (auto* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+namespace light::test
+{
+
+size_t getAllocationsCount()
+{
+    return allocationsCount.load();
+}
+
+}
@@ -0,0 +1,12 @@
+﻿#pragma once
+
+#include <cstddef>
+
+namespace light::test
+{
+
+// Count of heap allocations made through global operator new by the test binary, tests of
+// allocation free paths compare it before and after them.
+size_t getAllocationsCount();
+
+}
@@ -0,0 +1,99 @@
+﻿#include <light/CirclesSimulation.h>
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+constexpr size_t CIRCLES_COUNT = 10000;
+constexpr float CIRCLE_RADIUS = 0.003f;
+constexpr float SPEED = 0.5f;
+constexpr float TIME_DELTA = 1 / 60.0f;
+
+struct CircleState
+{
+    Point position;
+    Vector2d movementDirection;
+
+    bool operator==(const CircleState&) const = default;
+};
+
+std::vector<CircleState> getCircles(CirclesSimulation& simulation)
+{
+    std::vector<CircleState> circles;
+    simulation.forEachCircle(
+      [&circles](const Point& position, double, const Vector2d& movementDirection, float)
+      { circles.push_back({ position, movementDirection }); });
+    return circles;
+}
+
+}
+
+TEST(CirclesSimulationTests, SameResultsForAnyThreadsCount)
+{
+    constexpr int stepsCount = 50;
+    constexpr uint32_t seed = 7;
+
+    CirclesSimulation reference{
+        { 0, 0 }, { 1, 1 }, CIRCLES_COUNT, CIRCLE_RADIUS, SPEED, 1, seed
+    };
+    std::vector<std::vector<CircleState>> referenceSteps;
+    for (int step = 0; step < stepsCount; ++step)
+    {
+        reference.simulateStep(TIME_DELTA);
+        referenceSteps.push_back(getCircles(reference));
+    }
+
+    for (const size_t threadsCount : { 2, 3, 8 })
+    {
+        CirclesSimulation simulation{
+            { 0, 0 }, { 1, 1 }, CIRCLES_COUNT, CIRCLE_RADIUS, SPEED, threadsCount, seed
+        };
+        for (int step = 0; step < stepsCount; ++step)
+        {
+            simulation.simulateStep(TIME_DELTA);
+            // compared exactly, so results must be bit-identical
+            ASSERT_TRUE(getCircles(simulation) == referenceSteps[step])
+              << "threads " << threadsCount << ", step " << step;
+        }
+    }
+}
+
+TEST(CirclesSimulationTests, CollisionsAndBoxSides)
+{
+    CirclesSimulation simulation{ { 0, 0 }, { 1, 1 }, CIRCLES_COUNT, CIRCLE_RADIUS, SPEED, 4, 1 };
+    ASSERT_EQ(simulation.size(), CIRCLES_COUNT);
+
+    size_t collisionsCount = 0;
+    for (int step = 0; step < 20; ++step)
+    {
+        const auto before = getCircles(simulation);
+        simulation.simulateStep(TIME_DELTA);
+        const auto after = getCircles(simulation);
+
+        for (size_t i = 0; i < after.size(); ++i)
+        {
+            const auto& position = after[i].position;
+            EXPECT_GE(position.x, CIRCLE_RADIUS);
+            EXPECT_GE(position.y, CIRCLE_RADIUS);
+            EXPECT_LE(position.x, 1 - CIRCLE_RADIUS);
+            EXPECT_LE(position.y, 1 - CIRCLE_RADIUS);
+
+            // circles away from box sides change direction only by collisions
+            const bool isNearSide = position.x < 2 * CIRCLE_RADIUS ||
+                                    position.y < 2 * CIRCLE_RADIUS ||
+                                    position.x > 1 - 2 * CIRCLE_RADIUS ||
+                                    position.y > 1 - 2 * CIRCLE_RADIUS;
+            collisionsCount +=
+              !isNearSide && after[i].movementDirection != before[i].movementDirection;
+        }
+    }
+    EXPECT_GT(collisionsCount, 0);
+}
+
+}
@@ -2,6 +2,9 @@
 
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <string>
+
 namespace light::test
 {
 
@@ -62,4 +65,110 @@ TEST(FastArrayTests, PeekPop)
     EXPECT_TRUE(a.empty());
 }
 
+TEST(FastArrayTests, SpillKeepsElementsContiguous)
+{
+    FastArray<Int, 4> a;
+    EXPECT_EQ(a.capacity(), 4);
+
+    for (Int i = 0; i < 100; ++i)
+    {
+        a.push_back(i);
+        EXPECT_EQ(a.data() + i, &a[i]);
+    }
+    EXPECT_GE(a.capacity(), 100);
+
+    Int expected = 0;
+    for (const auto value : a)
+    {
+        EXPECT_EQ(value, expected++);
+    }
+    EXPECT_EQ(expected, 100);
+}
+
+TEST(FastArrayTests, PushBackOwnElementWhileGrowing)
+{
+    FastArray<Int, 2> a;
+    a.push_back(7);
+    a.push_back(8);
+    a.push_back(a[0]);
+    ASSERT_EQ(a.size(), 3);
+    EXPECT_EQ(a[2], 7);
+}
+
+TEST(FastArrayTests, ClearKeepsCapacity)
+{
+    FastArray<Int, 4> a;
+    for (Int i = 0; i < 10; ++i)
+    {
+        a.push_back(i);
+    }
+    const auto capacity = a.capacity();
+    const auto* data = a.data();
+
+    a.clear();
+    EXPECT_TRUE(a.empty());
+    EXPECT_EQ(a.capacity(), capacity);
+    EXPECT_EQ(a.data(), data);
+    EXPECT_EQ(a.begin(), a.end());
+}
+
+TEST(FastArrayTests, NonTrivialElements)
+{
+    FastArray<std::unique_ptr<Int>, 2> a;
+    for (Int i = 0; i < 5; ++i)
+    {
+        a.emplace_back(std::make_unique<Int>(i));
+    }
+
+    EXPECT_EQ(*a.peek(), 4);
+    const auto last = a.pop();
+    EXPECT_EQ(*last, 4);
+    EXPECT_EQ(a.size(), 4);
+    for (Int i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(*a[i], i);
+    }
+
+    const auto& inserted = a.emplace_back(new Int(10));
+    EXPECT_EQ(&inserted, &a[4]);
+}
+
+TEST(FastArrayTests, MoveAndCopy)
+{
+    // inline elements are moved one by one
+    FastArray<std::string, 4> inlineArray;
+    inlineArray.push_back("a");
+    inlineArray.push_back("b");
+    FastArray<std::string, 4> movedInline{ std::move(inlineArray) };
+    EXPECT_TRUE(inlineArray.empty());
+    ASSERT_EQ(movedInline.size(), 2);
+    EXPECT_EQ(movedInline[1], "b");
+
+    // heap block is taken as is
+    FastArray<std::string, 4> heapArray;
+    for (int i = 0; i < 10; ++i)
+    {
+        heapArray.push_back(std::to_string(i));
+    }
+    const auto* heapData = heapArray.data();
+    FastArray<std::string, 4> movedHeap;
+    movedHeap = std::move(heapArray);
+    EXPECT_TRUE(heapArray.empty());
+    EXPECT_EQ(heapArray.capacity(), 4);
+    EXPECT_EQ(movedHeap.data(), heapData);
+    EXPECT_EQ(movedHeap.size(), 10);
+
+    FastArray<std::string, 4> copy{ movedHeap };
+    EXPECT_NE(copy.data(), movedHeap.data());
+    ASSERT_EQ(copy.size(), movedHeap.size());
+    for (uint32_t i = 0; i < copy.size(); ++i)
+    {
+        EXPECT_EQ(copy[i], movedHeap[i]);
+    }
+
+    copy = movedInline;
+    ASSERT_EQ(copy.size(), 2);
+    EXPECT_EQ(copy[0], "a");
+}
+
 }
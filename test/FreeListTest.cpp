@@ -2,6 +2,9 @@
 
 #include <gtest/gtest.h>
 
+#include <utility>
+#include <vector>
+
 namespace light::test
 {
 using MyInt = uint32_t;
@@ -83,4 +86,111 @@ TEST(FreeListTests, RemoveAddSeveral)
     FreeList<MyInt> a;
 }
 
+TEST(FreeListTests, IsLive)
+{
+    FreeList<MyInt> a;
+    for (MyInt i = 0; i < 100; ++i)
+    {
+        a.push_back(i);
+    }
+    a.erase(3);
+    a.erase(64);
+
+    EXPECT_TRUE(a.isLive(0));
+    EXPECT_FALSE(a.isLive(3));
+    EXPECT_FALSE(a.isLive(64));
+    EXPECT_TRUE(a.isLive(99));
+    EXPECT_FALSE(a.isLive(100));
+    EXPECT_FALSE(a.isLive(NIL));
+
+    a.push_back(1000);
+    EXPECT_TRUE(a.isLive(64));
+
+    a.clear();
+    EXPECT_FALSE(a.isLive(0));
+}
+
+TEST(FreeListTests, EraseFreeSlot)
+{
+    FreeList<MyInt> a;
+    a.push_back(1);
+    a.erase(0);
+    EXPECT_DEBUG_DEATH(a.erase(0), "");
+}
+
+TEST(FreeListTests, ForEachLive)
+{
+    FreeList<MyInt> a;
+    for (MyInt i = 0; i < 200; ++i)
+    {
+        a.push_back(i);
+    }
+    std::vector<MyInt> expected;
+    for (MyInt i = 0; i < 200; ++i)
+    {
+        // whole words of free slots are skipped
+        if (i % 3 == 0 || (i >= 64 && i < 128))
+        {
+            a.erase(i);
+        }
+        else
+        {
+            expected.push_back(i);
+        }
+    }
+
+    std::vector<MyInt> visited;
+    std::as_const(a).forEachLive(
+      [&](uint32_t index, const MyInt& value)
+      {
+          EXPECT_EQ(index, value);
+          visited.push_back(value);
+      });
+    EXPECT_EQ(visited, expected);
+
+    a.forEachLive([](uint32_t, MyInt& value) { value *= 2; });
+    EXPECT_EQ(a[1], 2);
+}
+
+TEST(FreeListTests, Compact)
+{
+    FreeList<MyInt> a;
+    for (MyInt i = 0; i < 150; ++i)
+    {
+        a.push_back(i);
+    }
+    for (MyInt i = 0; i < 150; i += 2)
+    {
+        a.erase(i);
+    }
+    a.erase(149);
+
+    std::vector<std::pair<uint32_t, uint32_t>> remapped;
+    a.compact([&](uint32_t oldIndex, uint32_t newIndex)
+              { remapped.push_back({ oldIndex, newIndex }); });
+    EXPECT_EQ(a.size(), 74);
+    EXPECT_EQ(a.range(), 74);
+    ASSERT_EQ(remapped.size(), 74);
+    for (uint32_t i = 0; i < 74; ++i)
+    {
+        // odd values keep their order
+        EXPECT_EQ(a[i], 2 * i + 1);
+        EXPECT_TRUE(a.isLive(i));
+        EXPECT_EQ(remapped[i], std::make_pair(2 * i + 1, i));
+    }
+    EXPECT_FALSE(a.isLive(74));
+
+    // free chain is dropped, new elements are appended
+    EXPECT_EQ(a.push_back(1000), 74);
+    a.erase(10);
+    EXPECT_EQ(a.push_back(2000), 10);
+
+    // nothing moves in a list without free slots
+    FreeList<MyInt> dense;
+    dense.push_back(1);
+    dense.push_back(2);
+    dense.compact([](uint32_t, uint32_t) { FAIL(); });
+    EXPECT_EQ(dense.range(), 2);
+}
+
 }
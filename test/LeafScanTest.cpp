@@ -0,0 +1,108 @@
+﻿#include <light/LeafScan.h>
+#include <light/Quadtree.h>
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+struct LeafBounds
+{
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+};
+
+// Random bounds mixed with values equal to the rectangle sides, infinities and NaNs.
+LeafBounds generateBounds(size_t count, Point rectBottomLeft, Point rectTopRight)
+{
+    std::mt19937 rng{ 5 };
+    std::uniform_real_distribution<float> positionDist(-1, 2);
+    const float specialValues[] = { rectBottomLeft.x,
+                                    rectBottomLeft.y,
+                                    rectTopRight.x,
+                                    rectTopRight.y,
+                                    std::numeric_limits<float>::infinity(),
+                                    -std::numeric_limits<float>::infinity(),
+                                    std::numeric_limits<float>::quiet_NaN() };
+
+    const auto generate = [&]()
+    {
+        return rng() % 4 == 0 ? specialValues[rng() % std::size(specialValues)]
+                              : positionDist(rng);
+    };
+
+    LeafBounds bounds;
+    for (size_t i = 0; i < count; ++i)
+    {
+        bounds.minX.push_back(generate());
+        bounds.minY.push_back(generate());
+        bounds.maxX.push_back(generate());
+        bounds.maxY.push_back(generate());
+    }
+    return bounds;
+}
+
+}
+
+TEST(LeafScanTest, ScalarMatchesOverlapTest)
+{
+    const Point rectBottomLeft{ 0.25, 0.5 };
+    const Point rectTopRight{ 0.75, 1 };
+    const auto bounds = generateBounds(1024, rectBottomLeft, rectTopRight);
+
+    for (size_t first = 0; first < bounds.minX.size(); first += LEAF_SCAN_WIDTH)
+    {
+        const auto mask = getOverlapMaskScalar(&bounds.minX[first],
+                                               &bounds.minY[first],
+                                               &bounds.maxX[first],
+                                               &bounds.maxY[first],
+                                               rectBottomLeft,
+                                               rectTopRight);
+        for (uint32_t i = 0; i < LEAF_SCAN_WIDTH; ++i)
+        {
+            const Point bottomLeft{ bounds.minX[first + i], bounds.minY[first + i] };
+            const Point topRight{ bounds.maxX[first + i], bounds.maxY[first + i] };
+            EXPECT_EQ(((mask >> i) & 1u) != 0,
+                      isRectanglesOverlap(rectBottomLeft, rectTopRight, bottomLeft, topRight));
+        }
+    }
+}
+
+TEST(LeafScanTest, KernelsMatchScalar)
+{
+    const Point rectBottomLeft{ 0.25, 0.5 };
+    const Point rectTopRight{ 0.75, 1 };
+    const auto bounds = generateBounds(1024, rectBottomLeft, rectTopRight);
+
+    for (size_t first = 0; first < bounds.minX.size(); first += LEAF_SCAN_WIDTH)
+    {
+        const auto* minX = &bounds.minX[first];
+        const auto* minY = &bounds.minY[first];
+        const auto* maxX = &bounds.maxX[first];
+        const auto* maxY = &bounds.maxY[first];
+        const auto expected =
+          getOverlapMaskScalar(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight);
+
+        EXPECT_EQ(getOverlapMask(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight),
+                  expected);
+#if defined(LIGHT_LEAF_SCAN_SSE2)
+        EXPECT_EQ(getOverlapMaskSse2(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight),
+                  expected);
+#endif
+#if defined(LIGHT_LEAF_SCAN_AVX2)
+        EXPECT_EQ(getOverlapMaskAvx2(minX, minY, maxX, maxY, rectBottomLeft, rectTopRight),
+                  expected);
+#endif
+    }
+}
+
+}
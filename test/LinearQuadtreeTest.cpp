@@ -0,0 +1,144 @@
+﻿#include <light/LinearQuadtree.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+std::vector<Id> findIds(const LinearQuadtree& quadtree, Point areaBottomLeft, Point areaTopRight)
+{
+    std::vector<Id> ids;
+    quadtree.findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+std::vector<Id> findIdsBruteForce(const std::vector<QuadElement>& elements,
+                                  Point areaBottomLeft,
+                                  Point areaTopRight)
+{
+    std::vector<Id> ids;
+    for (const auto& element : elements)
+    {
+        if (isRectanglesOverlap(areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+        {
+            ids.push_back(element.id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+}
+
+TEST(LinearQuadtreeTests, BuildOne)
+{
+    LinearQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_TRUE(findIds(quadtree, { 0, 0 }, { 1, 1 }).empty());
+
+    const QuadElement element{ 7, { 0.2f, 0.4f }, { 0.3f, 0.6f } };
+    quadtree.build({ &element, 1 });
+    EXPECT_EQ(quadtree.size(), 1);
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 1, 1 }), std::vector<Id>{ 7 });
+    EXPECT_EQ(findIds(quadtree, { 0.25f, 0.5f }, { 0.26f, 0.51f }), std::vector<Id>{ 7 });
+    EXPECT_TRUE(findIds(quadtree, { 0.5f, 0.5f }, { 1, 1 }).empty());
+    // rectangles touching each other don't overlap
+    EXPECT_TRUE(findIds(quadtree, { 0.3f, 0.4f }, { 0.5f, 0.6f }).empty());
+
+    quadtree.clear();
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_TRUE(findIds(quadtree, { 0, 0 }, { 1, 1 }).empty());
+}
+
+TEST(LinearQuadtreeTests, BuildSkipsInvalid)
+{
+    const std::vector<QuadElement> elements = { { 0, { 0.5f, 0.5f }, { 0.4f, 0.6f } },
+                                                { 1, { 1.1f, 0.5f }, { 1.2f, 0.6f } },
+                                                { 2, { -0.2f, -0.2f }, { -0.1f, -0.1f } },
+                                                // sticking out of work area
+                                                { 3, { -0.5f, 0.5f }, { 0.1f, 1.5f } },
+                                                // degenerate rectangle on the center lines
+                                                { 4, { 0.5f, 0.5f }, { 0.5f, 0.5f } } };
+    LinearQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    EXPECT_EQ(quadtree.size(), 2);
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 1, 1 }), (std::vector<Id>{ 3, 4 }));
+    EXPECT_EQ(findIds(quadtree, { 0.4f, 0.4f }, { 0.6f, 0.6f }), std::vector<Id>{ 4 });
+}
+
+TEST(LinearQuadtreeTests, QueriesMatchBruteForce)
+{
+    std::mt19937 rng{ 71 };
+    // some elements stick out of work area, but none lies outside of it
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 5000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        // every tenth element is big enough to straddle centers of big quads
+        const float scale = id % 10 == 0 ? 8 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+    // elements lying on center lines of quads
+    const auto elementsCount = static_cast<Id>(elements.size());
+    elements.push_back({ elementsCount, { 0.25f, 0.25f }, { 0.25f, 0.5f } });
+    elements.push_back({ elementsCount + 1, { 0.5f, 0.75f }, { 0.625f, 0.75f } });
+    elements.push_back({ elementsCount + 2, { 0.375f, 0.125f }, { 0.375f, 0.125f } });
+
+    for (const int maxDepth : { 0, 1, 6, 10, int(LinearQuadtree::MAX_DEPTH), 20 })
+    {
+        LinearQuadtree linear{ { 0, 0 }, { 1, 1 }, maxDepth };
+        linear.build(elements);
+        EXPECT_EQ(linear.size(), elements.size());
+
+        // areas outside of work area find nothing, the same as in Quadtree
+        std::uniform_real_distribution<float> areaDist(-0.05f, 0.95f);
+        std::uniform_real_distribution<float> areaSizeDist(0.05f, 0.3f);
+        for (int i = 0; i < 200; ++i)
+        {
+            const Point areaBottomLeft{ areaDist(rng), areaDist(rng) };
+            const Point areaTopRight = areaBottomLeft + Point(areaSizeDist(rng), areaSizeDist(rng));
+            EXPECT_EQ(findIds(linear, areaBottomLeft, areaTopRight),
+                      findIdsBruteForce(elements, areaBottomLeft, areaTopRight));
+        }
+        // areas on center lines of quads
+        for (const auto& [areaBottomLeft, areaTopRight] :
+             { std::pair{ Point(0.25f, 0.25f), Point(0.5f, 0.5f) },
+               std::pair{ Point(0.5f, 0), Point(0.5f, 1) },
+               std::pair{ Point(0.375f, 0.125f), Point(0.625f, 0.75f) } })
+        {
+            EXPECT_EQ(findIds(linear, areaBottomLeft, areaTopRight),
+                      findIdsBruteForce(elements, areaBottomLeft, areaTopRight));
+        }
+
+        // returning false stops iteration
+        int visited = 0;
+        linear.forEachObjectInArea({ 0, 0 },
+                                   { 1, 1 },
+                                   [&visited](const Id&, Point, Point)
+                                   {
+                                       ++visited;
+                                       return false;
+                                   });
+        EXPECT_EQ(visited, 1);
+    }
+
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    LinearQuadtree linear{ { 0, 0 }, { 1, 1 } };
+    linear.build(elements);
+    EXPECT_LT(linear.memoryUsage(), quadtree.memoryUsage() / 2);
+}
+
+}
@@ -0,0 +1,165 @@
+﻿#include <light/LooseQuadtree.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+std::vector<Id> findIds(const LooseQuadtree& quadtree, Point areaBottomLeft, Point areaTopRight)
+{
+    std::vector<Id> ids;
+    quadtree.findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+size_t countQuads(const LooseQuadtree& quadtree)
+{
+    size_t count = 0;
+    quadtree.traverseQuads([&](const Point&, const Point&) { ++count; });
+    return count;
+}
+
+}
+
+TEST(LooseQuadtreeTests, InsertOne)
+{
+    LooseQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    const auto index = quadtree.insert({ 0.25, 0.25 }, { 0.75, 0.75 }, 3);
+    EXPECT_NE(index, NIL);
+    EXPECT_EQ(quadtree.size(), 1);
+    EXPECT_EQ(findIds(quadtree, { 0.7, 0.7 }, { 0.8, 0.8 }), std::vector<Id>{ 3 });
+    EXPECT_TRUE(findIds(quadtree, { 0.8, 0.8 }, { 0.9, 0.9 }).empty());
+
+    EXPECT_EQ(quadtree.insert({ 0.5, 0.5 }, { 0.4, 0.6 }, 4), NIL);
+    EXPECT_EQ(quadtree.insert({ 1.5, 0.5 }, { 1.6, 0.6 }, 5), NIL);
+
+    quadtree.remove(index);
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_TRUE(findIds(quadtree, { 0, 0 }, { 1, 1 }).empty());
+}
+
+TEST(LooseQuadtreeTests, Churn)
+{
+    std::mt19937 rng{ 43 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.001f, 0.05f);
+    std::uniform_real_distribution<float> stepDist(-0.01f, 0.01f);
+
+    // looseness 1 is an ordinary quadtree storing straddling elements in branches
+    for (const auto looseness : { 1.0f, 1.5f, 2.0f })
+    {
+        LooseQuadtree quadtree{ { 0, 0 }, { 1, 1 }, looseness, 4, 6 };
+        struct Inserted
+        {
+            uint32_t index;
+            Id id;
+            Point bottomLeft;
+            Point topRight;
+        };
+        std::vector<Inserted> inserted;
+
+        for (Id id = 0; id < 5000; ++id)
+        {
+            const auto action = rng() % 4;
+            if (!inserted.empty() && action == 0)
+            {
+                const auto position = rng() % inserted.size();
+                quadtree.remove(inserted[position].index);
+                inserted.erase(inserted.begin() + position);
+            }
+            else if (!inserted.empty() && action == 1)
+            {
+                // small moves mostly stay in the node, big ones move elements between nodes
+                auto& element = inserted[rng() % inserted.size()];
+                const auto scale = rng() % 8 == 0 ? 30.0f : 1.0f;
+                const auto step = Point(stepDist(rng), stepDist(rng)) * scale;
+                const auto bottomLeft = element.bottomLeft + step;
+                const auto topRight = element.topRight + step;
+                if (quadtree.update(element.index, bottomLeft, topRight))
+                {
+                    element.bottomLeft = bottomLeft;
+                    element.topRight = topRight;
+                }
+            }
+            else
+            {
+                const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+                const float scale = id % 20 == 0 ? 8 : 1;
+                const auto topRight = bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale;
+                const auto index = quadtree.insert(bottomLeft, topRight, id);
+                if (index != NIL)
+                {
+                    inserted.push_back({ index, id, bottomLeft, topRight });
+                }
+            }
+        }
+        EXPECT_EQ(quadtree.size(), inserted.size());
+
+        // every element is found once
+        std::vector<Id> ids;
+        quadtree.findObjectsInArea({ -1, -1 }, { 2, 2 }, ids);
+        EXPECT_EQ(ids.size(), inserted.size());
+
+        for (int i = 0; i < 100; ++i)
+        {
+            const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+            const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+
+            std::vector<Id> expected;
+            for (const auto& element : inserted)
+            {
+                if (isRectanglesOverlap(
+                      areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                {
+                    expected.push_back(element.id);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+        }
+
+        // removing everything merges the tree back into the root
+        for (const auto& element : inserted)
+        {
+            quadtree.remove(element.index);
+        }
+        EXPECT_EQ(quadtree.size(), 0);
+        EXPECT_EQ(countQuads(quadtree), 1);
+    }
+}
+
+TEST(LooseQuadtreeTests, ElementsAreNotCopied)
+{
+    // elements straddling centers of quads stay in a single node
+    LooseQuadtree quadtree{ { 0, 0 }, { 1, 1 }, 2, 1, 8 };
+    for (Id id = 0; id < 64; ++id)
+    {
+        const Point center{ 0.5f, (id + 0.5f) / 64 };
+        quadtree.insert(center - Point(0.001f), center + Point(0.001f), id);
+    }
+
+    size_t callsCount = 0;
+    quadtree.forEachObjectInArea({ 0, 0 },
+                                 { 1, 1 },
+                                 [&callsCount](const Id&, Point, Point)
+                                 {
+                                     ++callsCount;
+                                     return true;
+                                 });
+    EXPECT_EQ(callsCount, 64);
+    EXPECT_GT(countQuads(quadtree), 1);
+
+    quadtree.clear();
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_EQ(countQuads(quadtree), 1);
+}
+
+}
@@ -0,0 +1,196 @@
+﻿#include <light/PointQuadtree.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+bool isInside(Point areaBottomLeft, Point areaTopRight, Point position)
+{
+    return position.x > areaBottomLeft.x && position.y > areaBottomLeft.y &&
+           position.x < areaTopRight.x && position.y < areaTopRight.y;
+}
+
+std::vector<Id> findIds(const PointQuadtree& quadtree, Point areaBottomLeft, Point areaTopRight)
+{
+    std::vector<Id> ids;
+    quadtree.findPointsInArea(areaBottomLeft, areaTopRight, ids);
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+size_t countQuads(const PointQuadtree& quadtree)
+{
+    size_t count = 0;
+    quadtree.traverseQuads([&](const Point&, const Point&) { ++count; });
+    return count;
+}
+
+}
+
+TEST(PointQuadtreeTests, InsertOne)
+{
+    PointQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    const auto index = quadtree.insert({ 0.25, 0.5 }, 7);
+    EXPECT_NE(index, NIL);
+    EXPECT_EQ(quadtree.size(), 1);
+
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 1, 1 }), std::vector<Id>{ 7 });
+    EXPECT_EQ(findIds(quadtree, { 0.2, 0.4 }, { 0.3, 0.6 }), std::vector<Id>{ 7 });
+    EXPECT_TRUE(findIds(quadtree, { 0.5, 0.5 }, { 1, 1 }).empty());
+    // point on a side of the area isn't inside it
+    EXPECT_TRUE(findIds(quadtree, { 0.25, 0.4 }, { 0.3, 0.6 }).empty());
+
+    quadtree.remove(index);
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_TRUE(findIds(quadtree, { 0, 0 }, { 1, 1 }).empty());
+}
+
+TEST(PointQuadtreeTests, InsertOutside)
+{
+    PointQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    EXPECT_EQ(quadtree.insert({ -0.1, 0.5 }, 0), NIL);
+    EXPECT_EQ(quadtree.insert({ 0.5, 1.1 }, 1), NIL);
+    EXPECT_EQ(quadtree.insert({ std::numeric_limits<float>::quiet_NaN(), 0.5 }, 2), NIL);
+    EXPECT_EQ(quadtree.size(), 0);
+
+    // corners of work area are inside it
+    EXPECT_NE(quadtree.insert({ 0, 0 }, 3), NIL);
+    EXPECT_NE(quadtree.insert({ 1, 1 }, 4), NIL);
+    EXPECT_EQ(findIds(quadtree, { -1, -1 }, { 2, 2 }), (std::vector<Id>{ 3, 4 }));
+}
+
+TEST(PointQuadtreeTests, PointsOnCenterLines)
+{
+    std::mt19937 rng{ 37 };
+    std::uniform_real_distribution<float> positionDist(0, 1);
+    // points on center lines of quads go to the right (top) quadrants
+    std::uniform_int_distribution<int> gridDist(0, 16);
+
+    PointQuadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    std::vector<Point> positions;
+    for (Id id = 0; id < 5000; ++id)
+    {
+        const auto position = id % 4 == 0 ? Point(gridDist(rng), gridDist(rng)) / 16.0f
+                                          : Point(positionDist(rng), positionDist(rng));
+        EXPECT_NE(quadtree.insert(position, id), NIL);
+        positions.push_back(position);
+    }
+    EXPECT_EQ(quadtree.size(), 5000);
+
+    // areas with sides on center lines too
+    for (int i = 0; i < 200; ++i)
+    {
+        const auto areaBottomLeft = i % 2 == 0 ? Point(gridDist(rng), gridDist(rng)) / 16.0f
+                                               : Point(positionDist(rng), positionDist(rng));
+        const auto areaTopRight = areaBottomLeft + Point(gridDist(rng), gridDist(rng)) / 64.0f;
+
+        std::vector<Id> expected;
+        for (Id id = 0; id < positions.size(); ++id)
+        {
+            if (isInside(areaBottomLeft, areaTopRight, positions[id]))
+            {
+                expected.push_back(id);
+            }
+        }
+        EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+    }
+}
+
+TEST(PointQuadtreeTests, RemoveChurn)
+{
+    std::mt19937 rng{ 41 };
+    std::uniform_real_distribution<float> positionDist(0, 1);
+
+    PointQuadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    struct Inserted
+    {
+        uint32_t index;
+        Id id;
+        Point position;
+    };
+    std::vector<Inserted> inserted;
+
+    for (Id id = 0; id < 5000; ++id)
+    {
+        if (!inserted.empty() && rng() % 3 == 0)
+        {
+            const auto position = rng() % inserted.size();
+            quadtree.remove(inserted[position].index);
+            inserted.erase(inserted.begin() + position);
+        }
+        else
+        {
+            // clustered points reach max depth
+            const auto position = id % 8 == 0 ? Point(0.3f, 0.3f) + Point(id % 5, id % 3) * 1e-4f
+                                              : Point(positionDist(rng), positionDist(rng));
+            inserted.push_back({ quadtree.insert(position, id), id, position });
+        }
+    }
+    EXPECT_EQ(quadtree.size(), inserted.size());
+
+    for (int i = 0; i < 100; ++i)
+    {
+        const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+        const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+
+        std::vector<Id> expected;
+        for (const auto& point : inserted)
+        {
+            if (isInside(areaBottomLeft, areaTopRight, point.position))
+            {
+                expected.push_back(point.id);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+    }
+
+    // removing everything merges the tree back into the root
+    for (const auto& point : inserted)
+    {
+        quadtree.remove(point.index);
+    }
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_EQ(countQuads(quadtree), 1);
+
+    // freed nodes and slots are reused
+    for (Id id = 0; id < 1000; ++id)
+    {
+        quadtree.insert({ positionDist(rng), positionDist(rng) }, id);
+    }
+    EXPECT_EQ(findIds(quadtree, { -1, -1 }, { 2, 2 }).size(), 1000);
+
+    quadtree.clear();
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_EQ(countQuads(quadtree), 1);
+}
+
+TEST(PointQuadtreeTests, StopsIteration)
+{
+    PointQuadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    for (Id id = 0; id < 100; ++id)
+    {
+        quadtree.insert({ 0.005f + id * 0.0099f, 0.5f }, id);
+    }
+
+    size_t callsCount = 0;
+    quadtree.forEachPointInArea({ 0, 0 },
+                                { 1, 1 },
+                                [&callsCount](const Id&, Point)
+                                {
+                                    ++callsCount;
+                                    return callsCount < 10;
+                                });
+    EXPECT_EQ(callsCount, 10);
+}
+
+}
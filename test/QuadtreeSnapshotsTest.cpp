@@ -0,0 +1,172 @@
+﻿#include <light/QuadtreeSnapshots.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+constexpr Id VERSION_ELEMENTS_COUNT = 2000;
+
+// Elements of every version move and have Ids of the version, so readers can tell versions
+// apart and check they never see a mix of them.
+std::vector<QuadElement> makeVersionElements(Id version)
+{
+    std::vector<QuadElement> elements;
+    for (Id i = 0; i < VERSION_ELEMENTS_COUNT; ++i)
+    {
+        const auto cell = (i * 37 + version * 11) % VERSION_ELEMENTS_COUNT;
+        const Point bottomLeft{ 0.05f + 0.9f * float(cell % 40) / 40,
+                                0.05f + 0.9f * float(cell / 40) / 50 };
+        elements.push_back(
+          { version * VERSION_ELEMENTS_COUNT + i, bottomLeft, bottomLeft + Point(0.01f, 0.01f) });
+    }
+    return elements;
+}
+
+std::vector<Id> findIds(const Quadtree& quadtree)
+{
+    std::vector<Id> ids;
+    quadtree.findObjectsInArea({ 0, 0 }, { 1, 1 }, ids);
+    return ids;
+}
+
+}
+
+TEST(QuadtreeSnapshotsTests, ReusesReleasedBuffer)
+{
+    QuadtreeSnapshots<Quadtree> snapshots{ Point(0, 0), Point(1, 1) };
+    EXPECT_EQ(snapshots.acquire()->size(), 0);
+
+    auto* first = &snapshots.back();
+    first->build(makeVersionElements(1));
+    snapshots.publish();
+    EXPECT_EQ(snapshots.acquire().get(), first);
+    EXPECT_EQ(snapshots.acquire()->size(), VERSION_ELEMENTS_COUNT);
+
+    auto* second = &snapshots.back();
+    EXPECT_NE(second, first);
+    second->build(makeVersionElements(2));
+    snapshots.publish();
+
+    // nobody holds the first version, so buffers are swapped without allocations
+    EXPECT_EQ(&snapshots.back(), first);
+    EXPECT_EQ(snapshots.acquire().get(), second);
+}
+
+TEST(QuadtreeSnapshotsTests, ReaderKeepsVersion)
+{
+    QuadtreeSnapshots<Quadtree> snapshots{ Point(0, 0), Point(1, 1) };
+    snapshots.back().build(makeVersionElements(1));
+    snapshots.publish();
+
+    const auto held = snapshots.acquire();
+    const auto heldIds = findIds(*held);
+    EXPECT_EQ(heldIds.size(), VERSION_ELEMENTS_COUNT);
+
+    for (Id version = 2; version < 5; ++version)
+    {
+        auto& back = snapshots.back();
+        EXPECT_NE(&back, held.get());
+        back.build(makeVersionElements(version));
+        snapshots.publish();
+        EXPECT_EQ(findIds(*snapshots.acquire()).front() / VERSION_ELEMENTS_COUNT, version);
+    }
+
+    EXPECT_EQ(findIds(*held), heldIds);
+}
+
+TEST(QuadtreeSnapshotsTests, ReadersDuringRebuilds)
+{
+    constexpr Id versionsCount = 200;
+    constexpr size_t readersCount = 4;
+
+    // versions are built beforehand, so the writer only rebuilds
+    std::vector<std::vector<QuadElement>> versions;
+    for (Id version = 0; version < versionsCount; ++version)
+    {
+        versions.push_back(makeVersionElements(version));
+    }
+
+    QuadtreeSnapshots<Quadtree> snapshots{ Point(0, 0), Point(1, 1) };
+    snapshots.back().build(versions[0]);
+    snapshots.publish();
+
+    std::atomic<bool> isWriterDone{ false };
+    std::atomic<size_t> queriesCount{ 0 };
+    std::atomic<size_t> errorsCount{ 0 };
+
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < readersCount; ++i)
+    {
+        readers.emplace_back(
+          [&]()
+          {
+              Id lastVersion = 0;
+              // every reader queries at least once, even if the writer is already done
+              do
+              {
+                  const auto quadtree = snapshots.acquire();
+                  const auto ids = findIds(*quadtree);
+                  const auto version = ids.empty() ? 0 : ids.front() / VERSION_ELEMENTS_COUNT;
+
+                  // every element of the version is found and nothing else
+                  bool isConsistent = ids.size() == VERSION_ELEMENTS_COUNT;
+                  for (const auto id : ids)
+                  {
+                      isConsistent = isConsistent && id / VERSION_ELEMENTS_COUNT == version;
+                  }
+                  if (!isConsistent || version >= versionsCount)
+                  {
+                      ++errorsCount;
+                      continue;
+                  }
+
+                  // a small area finds the same elements as brute force over the version
+                  const auto& elements = versions[version];
+                  const Point areaBottomLeft{ 0.3f, 0.3f };
+                  const Point areaTopRight{ 0.5f, 0.45f };
+                  size_t expectedCount = 0;
+                  for (const auto& element : elements)
+                  {
+                      expectedCount += isRectanglesOverlap(
+                        areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight);
+                  }
+                  std::vector<Id> areaIds;
+                  quadtree->findObjectsInArea(areaBottomLeft, areaTopRight, areaIds);
+
+                  // versions are published in order
+                  if (areaIds.size() != expectedCount || version < lastVersion)
+                  {
+                      ++errorsCount;
+                  }
+                  lastVersion = version;
+                  ++queriesCount;
+              } while (!isWriterDone.load());
+          });
+    }
+
+    for (Id version = 1; version < versionsCount; ++version)
+    {
+        snapshots.back().build(versions[version]);
+        snapshots.publish();
+    }
+    isWriterDone = true;
+
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    EXPECT_EQ(errorsCount.load(), 0);
+    EXPECT_GT(queriesCount.load(), 0);
+    EXPECT_EQ(findIds(*snapshots.acquire()).front() / VERSION_ELEMENTS_COUNT, versionsCount - 1);
+}
+
+}
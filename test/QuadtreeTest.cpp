@@ -1,10 +1,45 @@
-﻿#include <light/Quadtree.h>
+﻿#include "AllocationsCount.h"
+
+#include <light/Quadtree.inl>
+#include <light/ThreadPool.h>
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
 namespace light::test
 {
 
+namespace
+{
+
+std::vector<Id> findIds(const Quadtree& quadtree, Point areaBottomLeft, Point areaTopRight)
+{
+    std::vector<Id> ids;
+    quadtree.forEachObjectInArea(areaBottomLeft,
+                                 areaTopRight,
+                                 [&](const Id& id, Point, Point)
+                                 {
+                                     ids.push_back(id);
+                                     return true;
+                                 });
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+size_t countQuads(const Quadtree& quadtree)
+{
+    size_t count = 0;
+    quadtree.traverseQuads([&](const Point&, const Point&) { ++count; });
+    return count;
+}
+
+}
+
 TEST(RectanglesOverlapTest, SameRectangle_1)
 {
     Point bottomLeft{ 0, 0 };
@@ -67,7 +102,7 @@ TEST(QuadtreeTests, InsertOne)
     const Point areaBottomLeft{ 0, 0 };
     const Point areaTopRight{ 1, 1 };
     Quadtree quadtree{ areaBottomLeft, areaTopRight };
-    quadtree.insert(Point(0.2, 0.2), Point(0.3, 0.3), Id(1));
+    EXPECT_NE(quadtree.insert(Point(0.2, 0.2), Point(0.3, 0.3), Id(1)), NIL);
     EXPECT_EQ(quadtree.size(), 1);
 
     int counter = 0;
@@ -91,10 +126,1767 @@ TEST(QuadtreeTests, InsertOne)
     EXPECT_EQ(counter, 0);
 }
 
+TEST(QuadtreeTests, Remove)
+{
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    const auto index1 = quadtree.insert(Point(0.2, 0.2), Point(0.3, 0.3), Id(1));
+    const auto index2 = quadtree.insert(Point(0.6, 0.6), Point(0.7, 0.7), Id(2));
+    ASSERT_NE(index1, NIL);
+    ASSERT_NE(index2, NIL);
+
+    quadtree.remove(index1);
+    EXPECT_EQ(quadtree.size(), 1);
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 1, 1 }), std::vector<Id>{ 2 });
+
+    quadtree.remove(index2);
+    EXPECT_EQ(quadtree.size(), 0);
+    EXPECT_TRUE(findIds(quadtree, { 0, 0 }, { 1, 1 }).empty());
+
+    // indices of no stored element are ignored
+    quadtree.remove(index1);
+    quadtree.remove(NIL);
+    EXPECT_FALSE(quadtree.update(index2, Point(0.1, 0.1), Point(0.2, 0.2)));
+    EXPECT_EQ(quadtree.size(), 0);
+}
+
+TEST(QuadtreeTests, InsertInvalid)
+{
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    EXPECT_EQ(quadtree.insert(Point(0.3, 0.3), Point(0.2, 0.2), Id(1)), NIL);
+    EXPECT_EQ(quadtree.insert(Point(2, 2), Point(3, 3), Id(2)), NIL);
+    EXPECT_EQ(quadtree.size(), 0);
+}
+
+TEST(QuadtreeTests, RemoveMergesQuads)
+{
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 8 };
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < 64; ++i)
+    {
+        const Point bottomLeft{ (i % 8) / 8.0f + 0.01f, (i / 8) / 8.0f + 0.01f };
+        indices.push_back(quadtree.insert(bottomLeft, bottomLeft + Point(0.05, 0.05), Id(i)));
+    }
+    const auto splitQuadsCount = countQuads(quadtree);
+    EXPECT_GT(splitQuadsCount, 1);
+
+    for (const auto index : indices)
+    {
+        quadtree.remove(index);
+    }
+    EXPECT_EQ(countQuads(quadtree), 1);
+
+    // freed quads are reused by the next splits
+    for (int i = 0; i < 64; ++i)
+    {
+        const Point bottomLeft{ (i % 8) / 8.0f + 0.01f, (i / 8) / 8.0f + 0.01f };
+        EXPECT_NE(quadtree.insert(bottomLeft, bottomLeft + Point(0.05, 0.05), Id(i)), NIL);
+    }
+    EXPECT_EQ(countQuads(quadtree), splitQuadsCount);
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 1, 1 }).size(), 64);
+}
+
+TEST(QuadtreeTests, RemoveChurn)
+{
+    std::mt19937 rng{ 42 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.001f, 0.05f);
+
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    struct Inserted
+    {
+        uint32_t index;
+        Id id;
+        Point bottomLeft;
+        Point topRight;
+    };
+    std::vector<Inserted> inserted;
+
+    for (Id id = 0; id < 3000; ++id)
+    {
+        if (!inserted.empty() && rng() % 3 == 0)
+        {
+            const auto position = rng() % inserted.size();
+            quadtree.remove(inserted[position].index);
+            inserted.erase(inserted.begin() + position);
+        }
+        else
+        {
+            const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+            const Point topRight = bottomLeft + Point(sizeDist(rng), sizeDist(rng));
+            const auto index = quadtree.insert(bottomLeft, topRight, id);
+            inserted.push_back({ index, id, bottomLeft, topRight });
+        }
+    }
+    EXPECT_EQ(quadtree.size(), inserted.size());
+
+    for (int i = 0; i < 100; ++i)
+    {
+        const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+        const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+
+        std::vector<Id> expected;
+        for (const auto& element : inserted)
+        {
+            if (isRectanglesOverlap(
+                  areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+            {
+                expected.push_back(element.id);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+    }
+}
+
+TEST(QuadtreeTests, Update)
+{
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 1, 8 };
+    const auto index1 = quadtree.insert(Point(0.1, 0.1), Point(0.2, 0.2), Id(1));
+    const auto index2 = quadtree.insert(Point(0.6, 0.6), Point(0.7, 0.7), Id(2));
+
+    // stays in the same quadrant
+    EXPECT_TRUE(quadtree.update(index1, Point(0.15, 0.15), Point(0.25, 0.25)));
+    EXPECT_TRUE(findIds(quadtree, { 0.1, 0.1 }, { 0.12, 0.12 }).empty());
+    EXPECT_EQ(findIds(quadtree, { 0.22, 0.22 }, { 0.24, 0.24 }), std::vector<Id>{ 1 });
+
+    // crosses into the quadrant of the second element
+    EXPECT_TRUE(quadtree.update(index1, Point(0.8, 0.8), Point(0.9, 0.9)));
+    EXPECT_TRUE(findIds(quadtree, { 0, 0 }, { 0.5, 0.5 }).empty());
+    EXPECT_EQ(findIds(quadtree, { 0.5, 0.5 }, { 1, 1 }), (std::vector<Id>{ 1, 2 }));
+    EXPECT_EQ(quadtree.size(), 2);
+
+    // invalid extents leave element untouched
+    EXPECT_FALSE(quadtree.update(index2, Point(2, 2), Point(3, 3)));
+    EXPECT_EQ(findIds(quadtree, { 0.65, 0.65 }, { 0.66, 0.66 }), std::vector<Id>{ 2 });
+}
+
+TEST(QuadtreeTests, UpdateChurn)
+{
+    std::mt19937 rng{ 7 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> offsetDist(-0.02f, 0.02f);
+
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    std::vector<uint32_t> indices;
+    std::vector<Point> bottomLefts;
+    const Point elementSize{ 0.03, 0.03 };
+
+    for (Id id = 0; id < 1000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        bottomLefts.push_back(bottomLeft);
+        indices.push_back(quadtree.insert(bottomLeft, bottomLeft + elementSize, id));
+    }
+
+    for (int step = 0; step < 20; ++step)
+    {
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            auto& bottomLeft = bottomLefts[i];
+            bottomLeft.x = std::clamp(bottomLeft.x + offsetDist(rng), 0.0f, 0.95f);
+            bottomLeft.y = std::clamp(bottomLeft.y + offsetDist(rng), 0.0f, 0.95f);
+            EXPECT_TRUE(quadtree.update(indices[i], bottomLeft, bottomLeft + elementSize));
+        }
+
+        const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+        const Point areaTopRight = areaBottomLeft + Point(0.2, 0.2);
+        std::vector<Id> expected;
+        for (size_t i = 0; i < bottomLefts.size(); ++i)
+        {
+            if (isRectanglesOverlap(
+                  areaBottomLeft, areaTopRight, bottomLefts[i], bottomLefts[i] + elementSize))
+            {
+                expected.push_back(Id(i));
+            }
+        }
+        EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+    }
+    EXPECT_EQ(quadtree.size(), indices.size());
+}
+
+TEST(QuadtreeTests, UpdateCornersOnSplitLines)
+{
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 1, 4 };
+    EXPECT_NE(quadtree.insert(Point(0.6, 0.6), Point(0.7, 0.7), Id(2)), NIL);
+    const auto index = quadtree.insert(Point(0.1, 0.1), Point(0.5, 0.3), Id(1));
+
+    // top right corner on the center isn't inserted to the right of it, so moving it across
+    // the center adds the element to leaves on the right
+    EXPECT_TRUE(quadtree.update(index, Point(0.1, 0.1), Point(0.5, 0.3)));
+    EXPECT_TRUE(quadtree.update(index, Point(0.1, 0.1), Point(0.6, 0.3)));
+    EXPECT_EQ(findIds(quadtree, { 0.55, 0.15 }, { 0.58, 0.25 }), std::vector<Id>{ 1 });
+
+    // the same for the top side
+    EXPECT_TRUE(quadtree.update(index, Point(0.1, 0.1), Point(0.3, 0.5)));
+    EXPECT_TRUE(quadtree.update(index, Point(0.1, 0.1), Point(0.3, 0.5)));
+    EXPECT_TRUE(quadtree.update(index, Point(0.1, 0.1), Point(0.3, 0.6)));
+    EXPECT_EQ(findIds(quadtree, { 0.15, 0.55 }, { 0.25, 0.58 }), std::vector<Id>{ 1 });
+
+    // bottom left corner on the center is inserted to the right of it only
+    EXPECT_TRUE(quadtree.update(index, Point(0.5, 0.5), Point(0.55, 0.55)));
+    EXPECT_TRUE(quadtree.update(index, Point(0.5, 0.5), Point(0.55, 0.55)));
+    EXPECT_TRUE(quadtree.update(index, Point(0.4, 0.4), Point(0.55, 0.55)));
+    EXPECT_EQ(findIds(quadtree, { 0.42, 0.42 }, { 0.45, 0.45 }), std::vector<Id>{ 1 });
+
+    // random moves of corners snapped to split lines of the tree, elements have nonzero sizes,
+    // as elements lying on split lines are not stored
+    std::mt19937 rng{ 3 };
+    std::uniform_int_distribution<int> lineDist(0, 15);
+    std::uniform_int_distribution<int> sizeDist(1, 4);
+    Quadtree gridTree{ { 0, 0 }, { 1, 1 }, 2, 4 };
+    std::vector<uint32_t> indices;
+    std::vector<std::pair<Point, Point>> rects;
+    const auto makeRect = [&]()
+    {
+        const Point bottomLeft{ lineDist(rng) / 16.0f, lineDist(rng) / 16.0f };
+        const Point size{ sizeDist(rng) / 16.0f, sizeDist(rng) / 16.0f };
+        return std::pair{ bottomLeft, glm::min(bottomLeft + size, Point(1, 1)) };
+    };
+    for (Id id = 0; id < 100; ++id)
+    {
+        rects.push_back(makeRect());
+        indices.push_back(gridTree.insert(rects.back().first, rects.back().second, id));
+    }
+    for (int step = 0; step < 50; ++step)
+    {
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            // the same rectangle again caches bounds of corners lying on split lines
+            if (step % 2 == 0)
+            {
+                rects[i] = makeRect();
+            }
+            EXPECT_TRUE(gridTree.update(indices[i], rects[i].first, rects[i].second));
+        }
+
+        for (int query = 0; query < 20; ++query)
+        {
+            const Point areaBottomLeft{ (lineDist(rng) + 0.5f) / 17, (lineDist(rng) + 0.5f) / 17 };
+            const Point areaTopRight = areaBottomLeft + Point(0.05f, 0.05f);
+            std::vector<Id> expected;
+            for (size_t i = 0; i < rects.size(); ++i)
+            {
+                if (isRectanglesOverlap(
+                      areaBottomLeft, areaTopRight, rects[i].first, rects[i].second))
+                {
+                    expected.push_back(Id(i));
+                }
+            }
+            ASSERT_EQ(findIds(gridTree, areaBottomLeft, areaTopRight), expected) << step;
+        }
+    }
+}
+
+TEST(QuadtreeTests, MaxDepthLeafGrows)
+{
+    // all elements end up in a single leaf at max depth, which outgrows its slots several times
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 3 };
+    std::vector<uint32_t> indices;
+    for (Id id = 0; id < 100; ++id)
+    {
+        indices.push_back(quadtree.insert(Point(0.01, 0.01), Point(0.02, 0.02), id));
+    }
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 0.1, 0.1 }).size(), 100);
+
+    for (Id id = 0; id < 100; id += 2)
+    {
+        quadtree.remove(indices[id]);
+    }
+    for (Id id = 1; id < 100; id += 4)
+    {
+        EXPECT_TRUE(quadtree.update(indices[id], Point(0.011, 0.011), Point(0.015, 0.015)));
+    }
+
+    const auto ids = findIds(quadtree, { 0.016, 0.016 }, { 0.1, 0.1 });
+    EXPECT_EQ(ids.size(), 25);
+    for (const auto id : ids)
+    {
+        EXPECT_EQ(id % 4, 3);
+    }
+    EXPECT_EQ(findIds(quadtree, { 0, 0 }, { 0.1, 0.1 }).size(), 50);
+}
+
+TEST(QuadtreeTests, WideLeaves)
+{
+    std::mt19937 rng{ 11 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0, 0.05f);
+
+    // leaf scan goes over several kernel widths and partially filled tails
+    for (const int maxElementsPerNode : { 5, 32, 64 })
+    {
+        Quadtree quadtree{ { 0, 0 }, { 1, 1 }, maxElementsPerNode, 6 };
+        std::vector<QuadElement> elements;
+        for (Id id = 0; id < 2000; ++id)
+        {
+            const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+            elements.push_back(
+              { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) });
+            EXPECT_NE(
+              quadtree.insert(elements.back().bottomLeft, elements.back().topRight, id), NIL);
+        }
+        Quadtree built{ { 0, 0 }, { 1, 1 }, maxElementsPerNode, 6 };
+        built.build(elements);
+
+        for (int i = 0; i < 50; ++i)
+        {
+            const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+            const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+
+            std::vector<Id> expected;
+            for (const auto& element : elements)
+            {
+                if (isRectanglesOverlap(
+                      areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                {
+                    expected.push_back(element.id);
+                }
+            }
+            EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+            EXPECT_EQ(findIds(built, areaBottomLeft, areaTopRight), expected);
+        }
+    }
+}
+
+TEST(QuadtreeTests, Build)
+{
+
+    std::mt19937 rng{ 3 };
+    std::uniform_real_distribution<float> positionDist(0.0f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.0f, 0.05f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 5000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        elements.push_back({ id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) });
+    }
+    // ill-formed rectangle and rectangle outside of work area are skipped
+    elements.push_back({ Id(5000), Point(0.5, 0.5), Point(0.4, 0.4) });
+    elements.push_back({ Id(5001), Point(1.5, 1.5), Point(1.6, 1.6) });
+
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (const auto& element : elements)
+    {
+        const auto index = inserted.insert(element.bottomLeft, element.topRight, element.id);
+        EXPECT_EQ(index == NIL, element.id >= 5000);
+    }
+
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    built.build(elements);
+    EXPECT_EQ(built.size(), 5000);
+    EXPECT_EQ(built.size(), inserted.size());
+
+    for (int i = 0; i < 200; ++i)
+    {
+        const Point areaBottomLeft{ positionDist(rng) - 0.05f, positionDist(rng) - 0.05f };
+        const Point areaTopRight = areaBottomLeft + Point(0.15, 0.1);
+        EXPECT_EQ(findIds(built, areaBottomLeft, areaTopRight),
+                  findIds(inserted, areaBottomLeft, areaTopRight));
+    }
+
+    // built tree can be edited further
+    for (uint32_t index = 0; index < 100; ++index)
+    {
+        built.remove(index);
+    }
+    EXPECT_TRUE(built.update(100, Point(0.9, 0.9), Point(0.91, 0.91)));
+    EXPECT_EQ(built.size(), inserted.size() - 100);
+
+    const auto ids = findIds(built, { 0.899, 0.899 }, { 0.911, 0.911 });
+    EXPECT_NE(std::find(ids.begin(), ids.end(), Id(100)), ids.end());
+    EXPECT_TRUE(findIds(built, { -1, -1 }, { 2, 2 }).front() >= 100);
+}
+
+TEST(QuadtreeTests, ParallelBuild)
+{
+    std::mt19937 rng{ 19 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 20000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        const float scale = id % 50 == 0 ? 3 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+    // degenerate rectangle lying on center lines
+    elements.push_back({ Id(20000), Point(0.5, 0.25), Point(0.5, 0.75) });
+
+    Quadtree serial{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    serial.build(elements);
+
+    const auto getQuads = [](const Quadtree& quadtree)
+    {
+        std::vector<std::pair<Point, Point>> quads;
+        quadtree.traverseQuads([&quads](const Point& bottomLeft, const Point& size)
+                               { quads.emplace_back(bottomLeft, size); });
+        return quads;
+    };
+
+    // pool of one thread builds the tree serially
+    for (const size_t threadsCount : { 1, 2, 3, 8, 64 })
+    {
+        ThreadPool pool{ threadsCount };
+        Quadtree parallel{ { 0, 0 }, { 1, 1 }, 8, 6 };
+        parallel.build(elements, pool);
+        EXPECT_EQ(parallel.size(), serial.size());
+        EXPECT_EQ(getQuads(parallel), getQuads(serial));
+
+        for (int i = 0; i < 100; ++i)
+        {
+            const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+            const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+            std::vector<Id> expected;
+            serial.findObjectsInArea(areaBottomLeft, areaTopRight, expected);
+            std::vector<Id> ids;
+            parallel.findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+            EXPECT_EQ(ids, expected);
+        }
+
+        // leaves of elements are tracked, so parallel built tree can be edited further
+        for (uint32_t index = 0; index < elements.size(); index += 2)
+        {
+            parallel.remove(index);
+        }
+        for (uint32_t index = 1; index < elements.size(); index += 4)
+        {
+            EXPECT_TRUE(parallel.update(index, Point(0.9, 0.9), Point(0.91, 0.91)));
+        }
+        for (int i = 0; i < 100; ++i)
+        {
+            const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+            const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+            std::vector<Id> expected;
+            for (Id id = 1; id < elements.size(); id += 2)
+            {
+                const bool isMoved = id % 4 == 1;
+                const auto bottomLeft = isMoved ? Point(0.9, 0.9) : elements[id].bottomLeft;
+                const auto topRight = isMoved ? Point(0.91, 0.91) : elements[id].topRight;
+                if (isRectanglesOverlap(areaBottomLeft, areaTopRight, bottomLeft, topRight))
+                {
+                    expected.push_back(id);
+                }
+            }
+            EXPECT_EQ(findIds(parallel, areaBottomLeft, areaTopRight), expected);
+        }
+    }
+}
+
+TEST(QuadtreeTests, Nearest)
+{
+    std::mt19937 rng{ 23 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+    std::uniform_int_distribution<int> gridDist(0, 8);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 3000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        const float scale = id % 20 == 0 ? 8 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+    // elements stored in several leaves with sides on center lines of quads
+    for (Id id = 3000; id < 3200; ++id)
+    {
+        const Point bottomLeft = Point(gridDist(rng), gridDist(rng)) / 8.0f;
+        const Point size{ float(1 + gridDist(rng) % 3), float(1 + gridDist(rng) % 3) };
+        elements.push_back({ id, bottomLeft, bottomLeft + size / 8.0f });
+    }
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (const auto& element : elements)
+    {
+        EXPECT_NE(inserted.insert(element.bottomLeft, element.topRight, element.id), NIL);
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    built.build(elements);
+
+    const auto getDistance = [&elements](Point point, Id id)
+    {
+        const auto& element = elements[id];
+        const auto nearestPoint = glm::clamp(point, element.bottomLeft, element.topRight);
+        return glm::length(point - nearestPoint);
+    };
+
+    // points outside of work area are fine too
+    // and points on center lines of quads, their nearest points on elements lie on them too
+    std::uniform_real_distribution<float> pointDist(-0.5f, 1.5f);
+    for (int i = 0; i < 300; ++i)
+    {
+        const Point point = i < 200 ? Point(pointDist(rng), pointDist(rng))
+                                    : Point(gridDist(rng), gridDist(rng)) / 8.0f;
+        const size_t k = i % 3 == 0 ? 1 : i % 3 == 1 ? 10 : 100;
+        const float maxDistance = i % 4 == 0 ? 0.05f : std::numeric_limits<float>::infinity();
+
+        std::vector<float> expected;
+        for (Id id = 0; id < elements.size(); ++id)
+        {
+            const auto distance = getDistance(point, id);
+            if (distance <= maxDistance)
+            {
+                expected.push_back(distance);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        expected.resize(std::min(expected.size(), k));
+
+        for (const auto* quadtree : { &inserted, &built })
+        {
+            std::vector<Id> ids;
+            quadtree->nearest(point, k, ids, maxDistance);
+
+            // ties may be broken in any way, so distances are compared
+            std::vector<float> distances;
+            for (const auto id : ids)
+            {
+                distances.push_back(getDistance(point, id));
+            }
+            EXPECT_EQ(distances, expected);
+
+            std::sort(ids.begin(), ids.end());
+            EXPECT_EQ(std::unique(ids.begin(), ids.end()), ids.end());
+        }
+    }
+
+    std::vector<Id> ids;
+    inserted.nearest({ 0.5, 0.5 }, 0, ids);
+    EXPECT_TRUE(ids.empty());
+    Quadtree empty{ { 0, 0 }, { 1, 1 } };
+    empty.nearest({ 0.5, 0.5 }, 5, ids);
+    EXPECT_TRUE(ids.empty());
+}
+
+TEST(QuadtreeTests, Raycast)
+{
+    std::mt19937 rng{ 29 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 3000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        const float scale = id % 20 == 0 ? 8 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+    // elements touching center lines of quads with their sides
+    const auto elementsCount = static_cast<Id>(elements.size());
+    elements.push_back({ elementsCount, { 0.4f, 0.4f }, { 0.5f, 0.5f } });
+    elements.push_back({ elementsCount + 1, { 0.5f, 0.1f }, { 0.6f, 0.25f } });
+    elements.push_back({ elementsCount + 2, { 0.25f, 0.75f }, { 0.375f, 0.875f } });
+
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (const auto& element : elements)
+    {
+        EXPECT_NE(inserted.insert(element.bottomLeft, element.topRight, element.id), NIL);
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    built.build(elements);
+
+    // parameters at which the ray enters every element it hits, sorted
+    const auto getHits = [&elements](Point origin, Point direction, float maxT)
+    {
+        std::vector<std::pair<float, Id>> hits;
+        for (const auto& element : elements)
+        {
+            auto tEnter = 0.0f;
+            auto tExit = maxT;
+            for (int axis = 0; axis < 2; ++axis)
+            {
+                if (direction[axis] == 0)
+                {
+                    if (origin[axis] < element.bottomLeft[axis] ||
+                        origin[axis] > element.topRight[axis])
+                    {
+                        tEnter = 1;
+                        tExit = 0;
+                    }
+                    continue;
+                }
+                auto t1 = (element.bottomLeft[axis] - origin[axis]) * (1 / direction[axis]);
+                auto t2 = (element.topRight[axis] - origin[axis]) * (1 / direction[axis]);
+                tEnter = std::max(tEnter, std::min(t1, t2));
+                tExit = std::min(tExit, std::max(t1, t2));
+            }
+            if (tEnter <= tExit)
+            {
+                hits.push_back({ tEnter, element.id });
+            }
+        }
+        std::sort(hits.begin(), hits.end());
+        return hits;
+    };
+
+    struct Ray
+    {
+        Point origin;
+        Point direction;
+        float maxT;
+    };
+    constexpr auto infinity = std::numeric_limits<float>::infinity();
+    // rays lying on center lines of quads, passing through centers and starting outside of
+    // work area
+    std::vector<Ray> rays = { { { 0.5f, 1.2f }, { 0, -1 }, infinity },
+                              { { -0.5f, 0.25f }, { 2, 0 }, infinity },
+                              { { 0.375f, 0 }, { 0, 0.5f }, 1.5f },
+                              { { 0, 0 }, { 1, 1 }, infinity },
+                              { { 1, 0 }, { -1, 1 }, 0.7f },
+                              { { 0.5f, 0.5f }, { -1, -1 }, infinity } };
+    std::uniform_real_distribution<float> originDist(-0.5f, 1.5f);
+    std::uniform_real_distribution<float> directionDist(-1, 1);
+    std::uniform_real_distribution<float> maxTDist(0, 2);
+    for (int i = 0; i < 200; ++i)
+    {
+        rays.push_back({ { originDist(rng), originDist(rng) },
+                         { directionDist(rng), directionDist(rng) },
+                         i % 2 == 0 ? maxTDist(rng) : infinity });
+    }
+
+    for (const auto& ray : rays)
+    {
+        const auto expected = getHits(ray.origin, ray.direction, ray.maxT);
+        std::vector<float> expectedTs;
+        std::vector<Id> expectedIds;
+        for (const auto& [t, id] : expected)
+        {
+            expectedTs.push_back(t);
+            expectedIds.push_back(id);
+        }
+
+        for (const auto* quadtree : { &inserted, &built })
+        {
+            std::vector<float> ts;
+            std::vector<Id> ids;
+            quadtree->raycast(ray.origin,
+                              ray.direction,
+                              ray.maxT,
+                              [&](const Id& id, float t)
+                              {
+                                  ts.push_back(t);
+                                  ids.push_back(id);
+                                  return true;
+                              });
+            // hits are reported in order, ties may be broken in any way
+            EXPECT_EQ(ts, expectedTs);
+            std::sort(ids.begin(), ids.end());
+            std::sort(expectedIds.begin(), expectedIds.end());
+            EXPECT_EQ(ids, expectedIds);
+
+            std::vector<float> firstTs;
+            quadtree->raycast(ray.origin,
+                              ray.direction,
+                              ray.maxT,
+                              [&firstTs](const Id&, float t)
+                              {
+                                  firstTs.push_back(t);
+                                  return false;
+                              });
+            EXPECT_EQ(firstTs.size(), std::min<size_t>(expected.size(), 1));
+            if (!expected.empty() && !firstTs.empty())
+            {
+                EXPECT_EQ(firstTs.front(), expected.front().first);
+            }
+        }
+    }
+
+    size_t callsCount = 0;
+    built.raycast({ 0.5f, 0.5f },
+                  { 0, 0 },
+                  1,
+                  [&callsCount](const Id&, float)
+                  {
+                      ++callsCount;
+                      return true;
+                  });
+    EXPECT_EQ(callsCount, 0);
+}
+
+TEST(QuadtreeTests, Visitors)
+{
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    for (Id id = 0; id < 100; ++id)
+    {
+        const Point bottomLeft{ float(id % 10) / 10, float(id / 10) / 10 };
+        EXPECT_NE(quadtree.insert(bottomLeft, bottomLeft + Point(0.05, 0.05), id), NIL);
+    }
+    const Point areaBottomLeft{ 0.22, 0.32 };
+    const Point areaTopRight{ 0.58, 0.61 };
+    const auto expected = findIds(quadtree, areaBottomLeft, areaTopRight);
+    EXPECT_EQ(expected.size(), 16);
+
+    // std::function is still accepted
+    std::vector<Id> ids;
+    const Quadtree::IterateObjectsCallback callback = [&ids](const Id& id, Point, Point)
+    {
+        ids.push_back(id);
+        return true;
+    };
+    quadtree.forEachObjectInArea(areaBottomLeft, areaTopRight, callback);
+    std::sort(ids.begin(), ids.end());
+    EXPECT_EQ(ids, expected);
+
+    FastArray<Id> foundIds;
+    quadtree.findObjectsInArea(areaBottomLeft, areaTopRight, foundIds);
+    std::vector<Id> sortedIds;
+    while (!foundIds.empty())
+    {
+        sortedIds.push_back(foundIds.pop());
+    }
+    std::sort(sortedIds.begin(), sortedIds.end());
+    EXPECT_EQ(sortedIds, expected);
+
+    // returning false stops iteration
+    int visited = 0;
+    quadtree.forEachObjectInArea(areaBottomLeft,
+                                 areaTopRight,
+                                 [&visited](const Id&, Point, Point)
+                                 {
+                                     ++visited;
+                                     return false;
+                                 });
+    EXPECT_EQ(visited, 1);
+
+    size_t quads = 0;
+    quadtree.traverseQuads([&quads](const Point&, const Point&) { ++quads; });
+    EXPECT_GT(quads, 1);
+}
+
+TEST(QuadtreeTests, OverlappingPairs)
+{
+    std::mt19937 rng{ 7 };
+    // some elements stick out of work area, but none lies outside of it
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 2000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        // every tenth element is big enough to be stored in many leaves
+        const float scale = id % 10 == 0 ? 6 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    std::vector<uint32_t> indices;
+    for (const auto& element : elements)
+    {
+        indices.push_back(inserted.insert(element.bottomLeft, element.topRight, element.id));
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    built.build(elements);
+
+    const auto checkPairs = [&elements](const Quadtree& quadtree)
+    {
+        std::vector<std::pair<Id, Id>> expected;
+        for (size_t i = 0; i < elements.size(); ++i)
+        {
+            for (size_t j = i + 1; j < elements.size(); ++j)
+            {
+                if (isRectanglesOverlap(elements[i].bottomLeft,
+                                        elements[i].topRight,
+                                        elements[j].bottomLeft,
+                                        elements[j].topRight))
+                {
+                    expected.emplace_back(elements[i].id, elements[j].id);
+                }
+            }
+        }
+
+        // every pair is reported exactly once, so no duplicates are removed here
+        std::vector<std::pair<Id, Id>> pairs;
+        quadtree.forEachOverlappingPair(
+          [&pairs](const Id& id1, const Id& id2)
+          {
+              pairs.emplace_back(std::min(id1, id2), std::max(id1, id2));
+              return true;
+          });
+        std::sort(pairs.begin(), pairs.end());
+        EXPECT_EQ(pairs, expected);
+    };
+
+    checkPairs(inserted);
+    checkPairs(built);
+
+    // pairs stay unique after elements are moved between leaves and leaves are merged
+    for (size_t i = 0; i < elements.size(); i += 3)
+    {
+        auto& element = elements[i];
+        element.bottomLeft = Point(positionDist(rng), positionDist(rng));
+        element.topRight = element.bottomLeft + Point(sizeDist(rng), sizeDist(rng));
+        EXPECT_TRUE(inserted.update(indices[i], element.bottomLeft, element.topRight));
+    }
+    checkPairs(inserted);
+
+    for (size_t i = elements.size() / 2; i < elements.size(); ++i)
+    {
+        inserted.remove(indices[i]);
+    }
+    elements.resize(elements.size() / 2);
+    checkPairs(inserted);
+
+    // returning false stops iteration
+    int visited = 0;
+    inserted.forEachOverlappingPair(
+      [&visited](const Id&, const Id&)
+      {
+          ++visited;
+          return false;
+      });
+    EXPECT_EQ(visited, 1);
+}
+
+TEST(QuadtreeTests, QueriesAreDuplicateFree)
+{
+    std::mt19937 rng{ 13 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.2f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 1000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        elements.push_back({ id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) });
+    }
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (const auto& element : elements)
+    {
+        EXPECT_NE(inserted.insert(element.bottomLeft, element.topRight, element.id), NIL);
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    built.build(elements);
+
+    for (const auto* quadtree : { &inserted, &built })
+    {
+        QueryStats stats;
+        for (int i = 0; i < 100; ++i)
+        {
+            // some areas stick out of work area too
+            const Point areaBottomLeft{ positionDist(rng) - 0.05f, positionDist(rng) - 0.05f };
+            const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+
+            std::vector<Id> expected;
+            for (const auto& element : elements)
+            {
+                if (isRectanglesOverlap(
+                      areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                {
+                    expected.push_back(element.id);
+                }
+            }
+
+            std::vector<Id> ids;
+            quadtree->findObjectsInArea(areaBottomLeft, areaTopRight, ids, &stats);
+            std::sort(ids.begin(), ids.end());
+            EXPECT_EQ(ids, expected);
+        }
+        // elements of this size are stored in several leaves often
+        EXPECT_GT(stats.suppressedDuplicates, 0);
+    }
+}
+
+TEST(QuadtreeTests, LineQueriesOnSplitLines)
+{
+    std::mt19937 rng{ 23 };
+    std::uniform_int_distribution<int> lineDist(0, 16);
+    std::uniform_int_distribution<int> sizeDist(1, 4);
+    std::uniform_int_distribution<int> clusterDist(0, 3);
+    const auto onGrid = [](int line) { return float(line) / 16; };
+
+    // dense cluster splits its quad deeper than the sparse neighbours, so lines on split lines
+    // pass both between children of a branch and through leaves spanning them
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 600; ++id)
+    {
+        const bool isClustered = id % 2 == 0;
+        const Point bottomLeft{ onGrid(isClustered ? clusterDist(rng) : lineDist(rng) % 12),
+                                onGrid(isClustered ? clusterDist(rng) : lineDist(rng) % 12) };
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(onGrid(sizeDist(rng)), onGrid(sizeDist(rng))) });
+    }
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    for (const auto& element : elements)
+    {
+        EXPECT_NE(inserted.insert(element.bottomLeft, element.topRight, element.id), NIL);
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 4, 6 };
+    built.build(elements);
+
+    std::vector<AABB> areas;
+    for (int i = 0; i < 400; ++i)
+    {
+        const int line = lineDist(rng);
+        auto from = lineDist(rng);
+        auto to = lineDist(rng);
+        if (from > to)
+        {
+            std::swap(from, to);
+        }
+        // vertical and horizontal lines, points are lines of zero length
+        if (i % 2 == 0)
+        {
+            areas.push_back({ { onGrid(line), onGrid(from) }, { onGrid(line), onGrid(to) } });
+        }
+        else
+        {
+            areas.push_back({ { onGrid(from), onGrid(line) }, { onGrid(to), onGrid(line) } });
+        }
+    }
+
+    ThreadPool pool{ 3 };
+    QueryBatchResults results;
+    for (const auto* quadtree : { &inserted, &built })
+    {
+        quadtree->queryBatch(areas, results, pool);
+        for (size_t i = 0; i < areas.size(); ++i)
+        {
+            const auto& [areaBottomLeft, areaTopRight] = areas[i];
+            std::vector<Id> expected;
+            for (const auto& element : elements)
+            {
+                if (isRectanglesOverlap(
+                      areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                {
+                    expected.push_back(element.id);
+                }
+            }
+
+            std::vector<Id> ids;
+            quadtree->findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+            std::sort(ids.begin(), ids.end());
+            EXPECT_EQ(ids, expected) << i;
+
+            std::vector<Id> batchIds(results.ids.begin() + results.offsets[i],
+                                     results.ids.begin() + results.offsets[i + 1]);
+            std::sort(batchIds.begin(), batchIds.end());
+            EXPECT_EQ(batchIds, expected) << i;
+        }
+    }
+}
+
+TEST(QuadtreeTests, NodeBounds)
+{
+    std::mt19937 rng{ 23 };
+    std::uniform_real_distribution<float> centerDist(0.1f, 0.9f);
+    std::normal_distribution<float> clusterDist(0, 0.01f);
+    std::uniform_real_distribution<float> sizeDist(0.001f, 0.01f);
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+
+    // elements gathered in a few clusters leave most of the quads they fall into empty
+    std::vector<Point> clusterCenters;
+    for (int i = 0; i < 4; ++i)
+    {
+        clusterCenters.emplace_back(centerDist(rng), centerDist(rng));
+    }
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 2000; ++id)
+    {
+        const auto bottomLeft =
+          clusterCenters[id % clusterCenters.size()] + Point(clusterDist(rng), clusterDist(rng));
+        elements.push_back({ id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) });
+    }
+
+    Quadtree plain{ { 0, 0 }, { 1, 1 }, 8, 8 };
+    plain.build(elements);
+    Quadtree bounded{ { 0, 0 }, { 1, 1 }, 8, 8, true };
+    bounded.build(elements);
+
+    const auto checkQueries = [&](QueryStats* plainStats, QueryStats* boundedStats)
+    {
+        for (int i = 0; i < 200; ++i)
+        {
+            const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+            const Point areaTopRight = areaBottomLeft + Point(0.05, 0.05);
+
+            std::vector<Id> expected;
+            for (const auto& element : elements)
+            {
+                if (isRectanglesOverlap(
+                      areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                {
+                    expected.push_back(element.id);
+                }
+            }
+
+            std::vector<Id> ids;
+            bounded.findObjectsInArea(areaBottomLeft, areaTopRight, ids, boundedStats);
+            std::sort(ids.begin(), ids.end());
+            EXPECT_EQ(ids, expected);
+            if (plainStats)
+            {
+                ids.clear();
+                plain.findObjectsInArea(areaBottomLeft, areaTopRight, ids, plainStats);
+            }
+        }
+    };
+
+    QueryStats plainStats;
+    QueryStats boundedStats;
+    checkQueries(&plainStats, &boundedStats);
+    EXPECT_LT(boundedStats.nodesVisited, plainStats.nodesVisited * 3 / 4);
+
+    // bounds follow elements moved, removed and inserted
+    for (Id id = 0; id < 500; ++id)
+    {
+        auto& element = elements[id];
+        const Point offset{ clusterDist(rng), clusterDist(rng) };
+        element.bottomLeft += offset;
+        element.topRight += offset;
+        EXPECT_TRUE(bounded.update(id, element.bottomLeft, element.topRight));
+    }
+    for (Id id = 500; id < 1500; ++id)
+    {
+        bounded.remove(id);
+    }
+    elements.erase(elements.begin() + 500, elements.begin() + 1500);
+    for (Id id = 2000; id < 2500; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        elements.push_back({ id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) });
+        EXPECT_NE(bounded.insert(elements.back().bottomLeft, elements.back().topRight, id), NIL);
+    }
+    checkQueries(nullptr, nullptr);
+}
+
+TEST(QuadtreeTests, CircleQuery)
+{
+    std::mt19937 rng{ 31 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+    std::uniform_int_distribution<int> gridDist(0, 8);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 2000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        const float scale = id % 20 == 0 ? 8 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+    // elements with sides on center lines of quads
+    for (Id id = 2000; id < 2200; ++id)
+    {
+        const Point bottomLeft = Point(gridDist(rng), gridDist(rng)) / 8.0f;
+        const Point size{ float(1 + gridDist(rng) % 3), float(1 + gridDist(rng) % 3) };
+        elements.push_back({ id, bottomLeft, bottomLeft + size / 8.0f });
+    }
+
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (const auto& element : elements)
+    {
+        EXPECT_NE(inserted.insert(element.bottomLeft, element.topRight, element.id), NIL);
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6, true };
+    built.build(elements);
+
+    const auto checkCircle = [&](Point center, float radius, QueryStats& stats)
+    {
+        std::vector<Id> expected;
+        for (const auto& element : elements)
+        {
+            const auto offset = glm::clamp(center, element.bottomLeft, element.topRight) - center;
+            if (glm::dot(offset, offset) < radius * radius)
+            {
+                expected.push_back(element.id);
+            }
+        }
+
+        for (const auto* quadtree : { &inserted, &built })
+        {
+            std::vector<Id> ids;
+            quadtree->forEachObjectInCircle(center,
+                                            radius,
+                                            [&ids](const Id& id, Point, Point)
+                                            {
+                                                ids.push_back(id);
+                                                return true;
+                                            },
+                                            &stats);
+            std::sort(ids.begin(), ids.end());
+            EXPECT_EQ(ids, expected);
+        }
+    };
+
+    QueryStats stats;
+    std::uniform_real_distribution<float> centerDist(-0.1f, 1.1f);
+    std::uniform_real_distribution<float> radiusDist(0.01f, 0.3f);
+    for (int i = 0; i < 200; ++i)
+    {
+        checkCircle({ centerDist(rng), centerDist(rng) }, radiusDist(rng), stats);
+    }
+    // centers and nearest points of elements on center lines of quads
+    for (int i = 0; i < 100; ++i)
+    {
+        checkCircle(Point(gridDist(rng), gridDist(rng)) / 8.0f, (1 + gridDist(rng)) / 16.0f, stats);
+    }
+    EXPECT_GT(stats.suppressedDuplicates, 0);
+
+    // the whole work area is inside, elements are reported without tests
+    std::vector<Id> ids;
+    built.forEachObjectInCircle({ 0.5f, 0.5f },
+                                2,
+                                [&ids](const Id& id, Point, Point)
+                                {
+                                    ids.push_back(id);
+                                    return true;
+                                });
+    EXPECT_EQ(ids.size(), elements.size());
+
+    ids.clear();
+    built.forEachObjectInCircle({ 0.5f, 0.5f },
+                                0,
+                                [&ids](const Id& id, Point, Point)
+                                {
+                                    ids.push_back(id);
+                                    return true;
+                                });
+    EXPECT_TRUE(ids.empty());
+}
+
+TEST(QuadtreeTests, PolygonQuery)
+{
+    std::mt19937 rng{ 37 };
+    std::uniform_real_distribution<float> positionDist(-0.02f, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.02f, 0.05f);
+    std::uniform_int_distribution<int> gridDist(0, 8);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 2000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        const float scale = id % 20 == 0 ? 8 : 1;
+        elements.push_back(
+          { id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) * scale });
+    }
+    for (Id id = 2000; id < 2200; ++id)
+    {
+        const Point bottomLeft = Point(gridDist(rng), gridDist(rng)) / 8.0f;
+        const Point size{ float(1 + gridDist(rng) % 3), float(1 + gridDist(rng) % 3) };
+        elements.push_back({ id, bottomLeft, bottomLeft + size / 8.0f });
+    }
+
+    Quadtree inserted{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (const auto& element : elements)
+    {
+        EXPECT_NE(inserted.insert(element.bottomLeft, element.topRight, element.id), NIL);
+    }
+    Quadtree built{ { 0, 0 }, { 1, 1 }, 8, 6, true };
+    built.build(elements);
+
+    // separating axes of the rectangle and of edges of counterclockwise polygon
+    const auto isOverlapping = [](const std::vector<Point>& polygon, const QuadElement& element)
+    {
+        Point boundsMin = polygon[0];
+        Point boundsMax = polygon[0];
+        for (const auto& vertex : polygon)
+        {
+            boundsMin = glm::min(boundsMin, vertex);
+            boundsMax = glm::max(boundsMax, vertex);
+        }
+        if (!isRectanglesOverlap(boundsMin, boundsMax, element.bottomLeft, element.topRight))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < polygon.size(); ++i)
+        {
+            const auto edge = polygon[(i + 1) % polygon.size()] - polygon[i];
+            const Point normal{ edge.y, -edge.x };
+            const Point corner{ normal.x > 0 ? element.bottomLeft.x : element.topRight.x,
+                                normal.y > 0 ? element.bottomLeft.y : element.topRight.y };
+            if (!(glm::dot(normal, corner) < glm::dot(normal, polygon[i])))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const auto checkPolygon = [&](std::vector<Point> polygon, QueryStats& stats)
+    {
+        std::vector<Id> expected;
+        for (const auto& element : elements)
+        {
+            if (isOverlapping(polygon, element))
+            {
+                expected.push_back(element.id);
+            }
+        }
+
+        // winding order doesn't matter
+        if (rng() % 2 == 0)
+        {
+            std::reverse(polygon.begin(), polygon.end());
+        }
+        for (const auto* quadtree : { &inserted, &built })
+        {
+            std::vector<Id> ids;
+            quadtree->forEachObjectInPolygon(polygon,
+                                             [&ids](const Id& id, Point, Point)
+                                             {
+                                                 ids.push_back(id);
+                                                 return true;
+                                             },
+                                             &stats);
+            std::sort(ids.begin(), ids.end());
+            EXPECT_EQ(ids, expected);
+        }
+    };
+
+    QueryStats stats;
+    std::uniform_real_distribution<float> centerDist(-0.1f, 1.1f);
+    std::uniform_real_distribution<float> radiusDist(0.01f, 0.4f);
+    std::uniform_real_distribution<float> angleDist(0, 6.28f);
+    for (int i = 0; i < 200; ++i)
+    {
+        // regular polygons of random sizes and rotations
+        const Point center{ centerDist(rng), centerDist(rng) };
+        const auto radius = radiusDist(rng);
+        const auto angle = angleDist(rng);
+        const auto verticesCount = 3 + i % 6;
+        std::vector<Point> polygon;
+        for (int vertex = 0; vertex < verticesCount; ++vertex)
+        {
+            const auto vertexAngle = angle + 6.2831853f * vertex / verticesCount;
+            polygon.push_back(center +
+                              radius * Point(std::cos(vertexAngle), std::sin(vertexAngle)));
+        }
+        checkPolygon(polygon, stats);
+    }
+    // diamonds and squares with vertices on center lines of quads
+    for (int i = 0; i < 100; ++i)
+    {
+        const auto center = Point(gridDist(rng), gridDist(rng)) / 8.0f;
+        const auto size = (1 + gridDist(rng)) / 16.0f;
+        if (i % 2 == 0)
+        {
+            checkPolygon({ center + Point(0, -size),
+                           center + Point(size, 0),
+                           center + Point(0, size),
+                           center + Point(-size, 0) },
+                         stats);
+        }
+        else
+        {
+            checkPolygon({ center + Point(-size, -size),
+                           center + Point(size, -size),
+                           center + Point(size, size),
+                           center + Point(-size, size) },
+                         stats);
+        }
+    }
+    EXPECT_GT(stats.suppressedDuplicates, 0);
+
+    // thin band along the diagonal visits a fraction of quads overlapping its bounding box
+    const std::vector<Point> band{
+        { 0, 0 }, { 0.02f, 0 }, { 1, 0.98f }, { 1, 1 }, { 0.98f, 1 }, { 0, 0.02f }
+    };
+    QueryStats bandStats;
+    checkPolygon(band, bandStats);
+    QueryStats areaStats;
+    std::vector<Id> ids;
+    built.findObjectsInArea({ 0, 0 }, { 1, 1 }, ids, &areaStats);
+    EXPECT_LT(bandStats.nodesVisited, areaStats.nodesVisited);
+
+    // degenerate polygons find nothing
+    ids.clear();
+    const auto collect = [&ids](const Id& id, Point, Point)
+    {
+        ids.push_back(id);
+        return true;
+    };
+    const std::vector<Point> segment{ { 0, 0 }, { 1, 1 } };
+    built.forEachObjectInPolygon(segment, collect);
+    const std::vector<Point> collinear{ { 0, 0 }, { 0.5f, 0.5f }, { 1, 1 } };
+    built.forEachObjectInPolygon(collinear, collect);
+    EXPECT_TRUE(ids.empty());
+}
+
+TEST(QuadtreeTests, Compact)
+{
+    std::mt19937 rng{ 31 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.001f, 0.03f);
+    std::uniform_real_distribution<float> offsetDist(-0.02f, 0.02f);
+    const QuadElement removed{ 0, { 1, 1 }, { 0, 0 } };
+
+    for (const bool keepNodeBounds : { false, true })
+    {
+        Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 6, keepNodeBounds };
+        quadtree.reserve(4000);
+        // element of every index, ill-formed rectangle if it's removed
+        std::vector<QuadElement> elements;
+        const auto insertElement = [&](Id id)
+        {
+            const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+            const QuadElement element{ id, bottomLeft, bottomLeft + Point(sizeDist(rng), 0.01f) };
+            const auto index = quadtree.insert(element.bottomLeft, element.topRight, element.id);
+            elements.resize(std::max(elements.size(), size_t(index) + 1), removed);
+            elements[index] = element;
+        };
+        const auto checkQueries = [&]()
+        {
+            for (int i = 0; i < 100; ++i)
+            {
+                const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+                const Point areaTopRight = areaBottomLeft + Point(0.1, 0.1);
+
+                std::vector<Id> expected;
+                for (const auto& element : elements)
+                {
+                    if (isRectanglesOverlap(
+                          areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                    {
+                        expected.push_back(element.id);
+                    }
+                }
+                std::sort(expected.begin(), expected.end());
+                EXPECT_EQ(findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+            }
+        };
+        // removes, moves and inserts elements, leaving free nodes and slots behind
+        const auto churn = [&](Id firstId)
+        {
+            for (Id id = firstId; id < firstId + 3000; ++id)
+            {
+                const auto index = static_cast<uint32_t>(rng() % elements.size());
+                auto& element = elements[index];
+                if (element.bottomLeft.x > element.topRight.x)
+                {
+                    insertElement(id);
+                }
+                else if (rng() % 2 == 0)
+                {
+                    quadtree.remove(index);
+                    element = removed;
+                }
+                else
+                {
+                    const Point offset{ offsetDist(rng), offsetDist(rng) };
+                    const auto bottomLeft = glm::clamp(
+                      element.bottomLeft + offset, Point(0, 0), Point(0.95f, 0.95f));
+                    element.topRight += bottomLeft - element.bottomLeft;
+                    element.bottomLeft = bottomLeft;
+                    EXPECT_TRUE(quadtree.update(index, element.bottomLeft, element.topRight));
+                }
+            }
+        };
+
+        for (Id id = 0; id < 4000; ++id)
+        {
+            insertElement(id);
+        }
+        churn(4000);
+        checkQueries();
+
+        const auto quadsCount = countQuads(quadtree);
+        const auto memoryUsage = quadtree.memoryUsage();
+        quadtree.compact();
+        EXPECT_EQ(countQuads(quadtree), quadsCount);
+        EXPECT_LT(quadtree.memoryUsage(), memoryUsage);
+        checkQueries();
+
+        // indices of elements and their leaves stay valid after compaction
+        churn(7000);
+        checkQueries();
+        quadtree.compact();
+        checkQueries();
+
+        // elements are moved into a dense prefix, holes of removed ones are dropped
+        const auto elementsMemoryUsage = quadtree.memoryUsage();
+        quadtree.compact(
+          [&](uint32_t oldIndex, uint32_t newIndex)
+          {
+              EXPECT_LT(newIndex, oldIndex);
+              elements[newIndex] = elements[oldIndex];
+          });
+        elements.resize(quadtree.size());
+        EXPECT_LT(quadtree.memoryUsage(), elementsMemoryUsage);
+        checkQueries();
+        churn(10000);
+        checkQueries();
+    }
+}
+
+TEST(QuadtreeTests, QueryContext)
+{
+    std::mt19937 rng{ 13 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+
+    // copies of the same point are never separated, so their leaf is at max depth, deeper than
+    // the stack of forEachObjectInArea holds without allocations. quads near the origin stay
+    // exact in floats down to it
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 50 };
+    for (Id id = 0; id < 2000; ++id)
+    {
+        const Point point{ positionDist(rng), positionDist(rng) };
+        EXPECT_NE(quadtree.insert(point, point, id), NIL);
+    }
+    for (Id id = 2000; id < 2010; ++id)
+    {
+        EXPECT_NE(quadtree.insert(Point(1e-20f, 1e-20f), Point(1e-20f, 1e-20f), id), NIL);
+    }
+
+    std::vector<std::pair<Point, Point>> areas;
+    for (int i = 0; i < 200; ++i)
+    {
+        const Point areaBottomLeft{ positionDist(rng), positionDist(rng) };
+        areas.emplace_back(areaBottomLeft, areaBottomLeft + Point(0.1, 0.1));
+    }
+    areas.emplace_back(Point(0, 0), Point(1, 1));
+    areas.emplace_back(Point(0, 0), Point(0.01f, 0.01f));
+
+    Quadtree::QueryContext context;
+    std::vector<Id> ids;
+    ids.reserve(quadtree.size());
+    const auto queryAll = [&](bool check)
+    {
+        for (const auto& [areaBottomLeft, areaTopRight] : areas)
+        {
+            ids.clear();
+            quadtree.findObjectsInArea(areaBottomLeft, areaTopRight, ids, context);
+            if (check)
+            {
+                std::sort(ids.begin(), ids.end());
+                EXPECT_EQ(ids, findIds(quadtree, areaBottomLeft, areaTopRight));
+            }
+        }
+    };
+    queryAll(true);
+
+    // context and output keep their storage, so repeated queries don't allocate
+    const auto allocationsBefore = getAllocationsCount();
+    queryAll(false);
+    EXPECT_EQ(getAllocationsCount(), allocationsBefore);
+}
+
+TEST(QuadtreeTests, QueryBatch)
+{
+    std::mt19937 rng{ 17 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0, 0.05f);
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 3000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        elements.push_back({ id, bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)) });
+    }
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    quadtree.build(elements);
+
+    std::vector<AABB> areas;
+    for (int i = 0; i < 1000; ++i)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        areas.push_back({ bottomLeft, bottomLeft + Point(0.05, 0.05) });
+    }
+    // ill-formed area finds nothing
+    areas.push_back({ Point(0.5, 0.5), Point(0.4, 0.4) });
+
+    QueryBatchResults results;
+    for (const size_t threadsCount : { 1, 4 })
+    {
+        ThreadPool pool{ threadsCount };
+        quadtree.queryBatch(areas, results, pool);
+        ASSERT_EQ(results.offsets.size(), areas.size() + 1);
+        EXPECT_EQ(results.offsets.front(), 0);
+        EXPECT_EQ(results.offsets.back(), results.ids.size());
+
+        for (size_t i = 0; i < areas.size(); ++i)
+        {
+            std::vector<Id> expected;
+            quadtree.findObjectsInArea(areas[i].bottomLeft, areas[i].topRight, expected);
+            const std::vector<Id> ids(results.ids.begin() + results.offsets[i],
+                                      results.ids.begin() + results.offsets[i + 1]);
+            EXPECT_EQ(ids, expected);
+        }
+    }
+
+    ThreadPool pool{ 2 };
+    quadtree.queryBatch({}, results, pool);
+    EXPECT_EQ(results.offsets, std::vector<uint32_t>{ 0 });
+    EXPECT_TRUE(results.ids.empty());
+}
+
+TEST(QuadtreeTests, QueryBatchReusesScratch)
+{
+    std::mt19937 rng{ 19 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0, 0.05f);
+
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 8, 6 };
+    for (Id id = 0; id < 3000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        EXPECT_NE(
+          quadtree.insert(bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)), id), NIL);
+    }
+    std::vector<AABB> areas;
+    for (int i = 0; i < 1000; ++i)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        areas.push_back({ bottomLeft, bottomLeft + Point(0.05, 0.05) });
+    }
+
+    for (const size_t threadsCount : { 1, 4 })
+    {
+        ThreadPool pool{ threadsCount };
+        QueryBatchResults results;
+        // the first batches grow the buffers, single thread swaps two of them between batches
+        quadtree.queryBatch(areas, results, pool);
+        quadtree.queryBatch(areas, results, pool);
+        // any thread may get all chunks of the next batch
+        for (auto& ids : results.threadIds)
+        {
+            ids.reserve(results.ids.size());
+        }
+
+        const auto getCapacities = [&results]()
+        {
+            std::vector<size_t> capacities{ results.offsets.capacity(),
+                                            results.ids.capacity(),
+                                            results.chunkSources.capacity(),
+                                            results.threadContexts.capacity() };
+            for (const auto& ids : results.threadIds)
+            {
+                capacities.push_back(ids.capacity());
+            }
+            return capacities;
+        };
+        const auto capacities = getCapacities();
+        EXPECT_EQ(results.threadContexts.size(), threadsCount);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            const auto allocationsBefore = getAllocationsCount();
+            quadtree.queryBatch(areas, results, pool);
+            // only tasks handed to the pool may allocate, traversal stacks of threads are kept
+            EXPECT_LE(getAllocationsCount() - allocationsBefore, 2);
+            EXPECT_EQ(getCapacities(), capacities);
+        }
+    }
+}
+
+template<typename QuadtreeType>
+class BasicQuadtreeTests : public ::testing::Test
+{
+protected:
+    using Scalar = typename QuadtreeType::Point::value_type;
+    using Payload = decltype(QuadtreeType::QuadElement::id);
+    using Point = typename QuadtreeType::Point;
+    using Real = typename QuadtreeType::Real;
+    using RealPoint = typename QuadtreeType::RealPoint;
+
+    // integer coordinates are exact in every scalar type, so all trees must agree with brute
+    // force; side of work area is divisible by 2^maxDepth
+    static constexpr Scalar AREA_SIZE = 1 << 16;
+    static constexpr uint32_t ID_SHIFT = 8 * sizeof(Payload) - 16;
+
+    std::vector<typename QuadtreeType::QuadElement> makeElements(uint32_t count, uint32_t seed)
+    {
+        std::mt19937 rng{ seed };
+        // elements at the top right stick out of work area, but none lies outside of it
+        std::uniform_int_distribution<int> positionDist(0, 62000);
+        std::uniform_int_distribution<int> sizeDist(100, 3000);
+
+        std::vector<typename QuadtreeType::QuadElement> elements;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const Point bottomLeft(positionDist(rng), positionDist(rng));
+            // every tenth element is big enough to be stored in many leaves
+            const int scale = i % 10 == 0 ? 8 : 1;
+            const Point size(sizeDist(rng) * scale, sizeDist(rng) * scale);
+            // Ids are stored in the high bits, so 64-bit Ids don't fit 32 bits
+            const auto id = static_cast<Payload>(Payload(i) << ID_SHIFT);
+            elements.push_back({ id, bottomLeft, bottomLeft + size });
+        }
+        return elements;
+    }
+
+    static bool isOverlap(Point bottomLeft1, Point topRight1, Point bottomLeft2, Point topRight2)
+    {
+        return topRight2.x > bottomLeft1.x && topRight2.y > bottomLeft1.y &&
+               bottomLeft2.x < topRight1.x && bottomLeft2.y < topRight1.y;
+    }
+
+    static std::vector<Payload> findIds(const QuadtreeType& quadtree,
+                                        Point areaBottomLeft,
+                                        Point areaTopRight)
+    {
+        std::vector<Payload> ids;
+        quadtree.findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+};
+
+using BasicQuadtreeTypes = ::testing::Types<BasicQuadtree<double>,
+                                            BasicQuadtree<float, 8, 6>,
+                                            BasicQuadtree<int32_t, 8, 6>,
+                                            BasicQuadtree<float, 4, 6, uint64_t>>;
+TYPED_TEST_SUITE(BasicQuadtreeTests, BasicQuadtreeTypes);
+
+TYPED_TEST(BasicQuadtreeTests, QueriesMatchBruteForce)
+{
+    using Point = typename TestFixture::Point;
+    using Payload = typename TestFixture::Payload;
+
+    auto elements = this->makeElements(2000, 47);
+    TypeParam inserted{ { 0, 0 }, { this->AREA_SIZE, this->AREA_SIZE }, 8, 6 };
+    std::vector<uint32_t> indices;
+    for (const auto& element : elements)
+    {
+        indices.push_back(inserted.insert(element.bottomLeft, element.topRight, element.id));
+    }
+    TypeParam built{ { 0, 0 }, { this->AREA_SIZE, this->AREA_SIZE }, 8, 6 };
+    built.build(elements);
+    ThreadPool pool{ 3 };
+    TypeParam builtInParallel{ { 0, 0 }, { this->AREA_SIZE, this->AREA_SIZE }, 8, 6 };
+    builtInParallel.build(elements, pool);
+
+    // elements are moved and removed in the inserted tree only, others are checked first
+    std::mt19937 rng{ 53 };
+    std::uniform_int_distribution<int> areaDist(-2000, 60000);
+    const auto checkAreas = [&](const TypeParam& quadtree)
+    {
+        for (int i = 0; i < 50; ++i)
+        {
+            const Point areaBottomLeft(areaDist(rng), areaDist(rng));
+            const auto areaTopRight = areaBottomLeft + Point(6000, 6000);
+
+            std::vector<Payload> expected;
+            for (const auto& element : elements)
+            {
+                if (this->isOverlap(
+                      areaBottomLeft, areaTopRight, element.bottomLeft, element.topRight))
+                {
+                    expected.push_back(element.id);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            EXPECT_EQ(this->findIds(quadtree, areaBottomLeft, areaTopRight), expected);
+        }
+
+        size_t expectedPairs = 0;
+        for (size_t i = 0; i < elements.size(); ++i)
+        {
+            for (size_t j = i + 1; j < elements.size(); ++j)
+            {
+                expectedPairs += this->isOverlap(elements[i].bottomLeft,
+                                                 elements[i].topRight,
+                                                 elements[j].bottomLeft,
+                                                 elements[j].topRight);
+            }
+        }
+        size_t pairs = 0;
+        quadtree.forEachOverlappingPair(
+          [&pairs](const Payload&, const Payload&)
+          {
+              ++pairs;
+              return true;
+          });
+        EXPECT_EQ(pairs, expectedPairs);
+    };
+
+    checkAreas(built);
+    checkAreas(builtInParallel);
+    checkAreas(inserted);
+
+    const auto moved = this->makeElements(static_cast<uint32_t>(elements.size()), 59);
+    for (size_t i = 0; i < elements.size(); i += 3)
+    {
+        elements[i].bottomLeft = moved[i].bottomLeft;
+        elements[i].topRight = moved[i].topRight;
+        EXPECT_TRUE(inserted.update(indices[i], elements[i].bottomLeft, elements[i].topRight));
+    }
+    for (size_t i = elements.size() / 2; i < elements.size(); ++i)
+    {
+        inserted.remove(indices[i]);
+    }
+    elements.resize(elements.size() / 2);
+    EXPECT_EQ(inserted.size(), elements.size());
+    checkAreas(inserted);
+}
+
+TYPED_TEST(BasicQuadtreeTests, NearestAndRaycast)
+{
+    using Point = typename TestFixture::Point;
+    using Payload = typename TestFixture::Payload;
+    using Real = typename TestFixture::Real;
+    using RealPoint = typename TestFixture::RealPoint;
+
+    const auto elements = this->makeElements(2000, 61);
+    TypeParam quadtree{ { 0, 0 }, { this->AREA_SIZE, this->AREA_SIZE }, 8, 6 };
+    quadtree.build(elements);
+
+    const auto getDistance = [](RealPoint point, Point bottomLeft, Point topRight)
+    {
+        const auto dx = std::max({ Real(bottomLeft.x) - point.x, point.x - topRight.x, Real(0) });
+        const auto dy = std::max({ Real(bottomLeft.y) - point.y, point.y - topRight.y, Real(0) });
+        return dx * dx + dy * dy;
+    };
+
+    std::mt19937 rng{ 67 };
+    std::uniform_int_distribution<int> pointDist(-10000, 75000);
+    for (int i = 0; i < 50; ++i)
+    {
+        const Point point(pointDist(rng), pointDist(rng));
+        std::vector<Real> expected;
+        for (const auto& element : elements)
+        {
+            expected.push_back(getDistance(RealPoint(point), element.bottomLeft, element.topRight));
+        }
+        std::sort(expected.begin(), expected.end());
+        expected.resize(10);
+
+        std::vector<Payload> ids;
+        quadtree.nearest(point, 10, ids);
+        std::vector<Real> distances;
+        for (const auto id : ids)
+        {
+            const auto& element = elements[id >> this->ID_SHIFT];
+            distances.push_back(
+              getDistance(RealPoint(point), element.bottomLeft, element.topRight));
+        }
+        EXPECT_EQ(distances, expected);
+    }
+
+    // horizontal rays along rows of elements, hits are reported in the order of their left sides
+    for (int i = 0; i < 50; ++i)
+    {
+        const RealPoint origin(-5000, pointDist(rng));
+        std::vector<Real> expected;
+        for (const auto& element : elements)
+        {
+            if (element.bottomLeft.y <= origin.y && origin.y <= element.topRight.y)
+            {
+                expected.push_back(Real(element.bottomLeft.x) - origin.x);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<Real> ts;
+        quadtree.raycast(origin,
+                         RealPoint(1, 0),
+                         std::numeric_limits<Real>::infinity(),
+                         [&ts](const Payload&, Real t)
+                         {
+                             ts.push_back(t);
+                             return true;
+                         });
+        EXPECT_EQ(ts, expected);
+    }
+}
+
 // TEST(QuadtreeTests, SubdivideFirstQuad)
 // TEST(QuadtreeTests, MaxDepth)
 // TEST(QuadtreeTests, MaxChildren)
 // TEST(QuadtreeTests, InsertMany)
-// TEST(QuadtreeTests, Remove)
 // TEST(QuadtreeTests, Cleanup)
 }
@@ -0,0 +1,161 @@
+﻿#include <light/Quadtree.inl>
+#include <light/QuadtreeIO.h>
+#include <light/QuadtreeView.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+namespace light::test
+{
+
+namespace
+{
+
+std::filesystem::path getTestFilePath(const char* name)
+{
+    return std::filesystem::temp_directory_path() / name;
+}
+
+std::vector<Id> findIds(const Quadtree& quadtree, Point areaBottomLeft, Point areaTopRight)
+{
+    std::vector<Id> ids;
+    quadtree.findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+    return ids;
+}
+
+std::vector<Id> findIds(const QuadtreeView& view, Point areaBottomLeft, Point areaTopRight)
+{
+    std::vector<Id> ids;
+    view.findObjectsInArea(areaBottomLeft, areaTopRight, ids);
+    return ids;
+}
+
+}
+
+TEST(QuadtreeViewTests, OpenEmpty)
+{
+    const auto path = getTestFilePath("quadtree_view_empty.bin");
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    ASSERT_TRUE(saveQuadtree(quadtree, path));
+
+    QuadtreeView view;
+    EXPECT_FALSE(view.isOpen());
+    EXPECT_TRUE(findIds(view, { 0, 0 }, { 1, 1 }).empty());
+
+    ASSERT_TRUE(view.open(path));
+    EXPECT_TRUE(view.isOpen());
+    EXPECT_EQ(view.size(), 0);
+    EXPECT_TRUE(findIds(view, { 0, 0 }, { 1, 1 }).empty());
+
+    view.close();
+    EXPECT_FALSE(view.isOpen());
+    std::filesystem::remove(path);
+}
+
+TEST(QuadtreeViewTests, QueriesMatchQuadtree)
+{
+    std::mt19937 rng{ 37 };
+    std::uniform_real_distribution<float> positionDist(0, 0.95f);
+    std::uniform_real_distribution<float> sizeDist(0.001f, 0.05f);
+
+    // removals leave freed nodes and slots in the image
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 }, 4, 8 };
+    std::vector<uint32_t> indices;
+    for (Id id = 0; id < 3000; ++id)
+    {
+        const Point bottomLeft{ positionDist(rng), positionDist(rng) };
+        indices.push_back(
+          quadtree.insert(bottomLeft, bottomLeft + Point(sizeDist(rng), sizeDist(rng)), id));
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        quadtree.remove(indices[i]);
+    }
+
+    const auto path = getTestFilePath("quadtree_view_queries.bin");
+    ASSERT_TRUE(saveQuadtree(quadtree, path));
+    QuadtreeView opened;
+    ASSERT_TRUE(opened.open(path));
+    // the mapping moves with the view
+    const auto view = std::move(opened);
+    EXPECT_FALSE(opened.isOpen());
+    EXPECT_EQ(view.size(), quadtree.size());
+
+    for (int i = 0; i < 200; ++i)
+    {
+        const Point areaBottomLeft{ positionDist(rng) - 0.05f, positionDist(rng) - 0.05f };
+        const Point areaTopRight = areaBottomLeft + Point(0.15, 0.1);
+        // the same traversal reports the same elements in the same order
+        EXPECT_EQ(findIds(view, areaBottomLeft, areaTopRight),
+                  findIds(quadtree, areaBottomLeft, areaTopRight));
+    }
+    // lines on split lines of the tree
+    for (int line = 0; line <= 16; ++line)
+    {
+        const float position = float(line) / 16;
+        EXPECT_EQ(findIds(view, { position, 0 }, { position, 1 }),
+                  findIds(quadtree, { position, 0 }, { position, 1 }));
+        EXPECT_EQ(findIds(view, { 0, position }, { 1, position }),
+                  findIds(quadtree, { 0, position }, { 1, position }));
+    }
+
+    int visited = 0;
+    view.forEachObjectInArea({ 0, 0 },
+                             { 1, 1 },
+                             [&visited](const Id&, Point, Point)
+                             {
+                                 ++visited;
+                                 return false;
+                             });
+    EXPECT_EQ(visited, 1);
+    std::filesystem::remove(path);
+}
+
+TEST(QuadtreeViewTests, OpenRejectsInvalidFiles)
+{
+    QuadtreeView view;
+    EXPECT_FALSE(view.open(getTestFilePath("quadtree_view_missing.bin")));
+
+    std::vector<QuadElement> elements;
+    for (Id id = 0; id < 100; ++id)
+    {
+        const Point bottomLeft{ 0.009f * float(id), 0.5f };
+        elements.push_back({ id, bottomLeft, bottomLeft + Point(0.01f, 0.01f) });
+    }
+    Quadtree quadtree{ { 0, 0 }, { 1, 1 } };
+    quadtree.build(elements);
+    const auto path = getTestFilePath("quadtree_view_invalid.bin");
+    ASSERT_TRUE(saveQuadtree(quadtree, path));
+    const auto fileSize = std::filesystem::file_size(path);
+
+    // truncated file
+    std::filesystem::resize_file(path, fileSize - 1);
+    EXPECT_FALSE(view.open(path));
+    EXPECT_FALSE(view.isOpen());
+
+    // file of another coordinates type
+    BasicQuadtree<double> doubleQuadtree{ { 0, 0 }, { 1, 1 } };
+    ASSERT_TRUE(saveQuadtree(doubleQuadtree, path));
+    EXPECT_FALSE(view.open(path));
+
+    // corrupted magic
+    ASSERT_TRUE(saveQuadtree(quadtree, path));
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.put('X');
+    }
+    EXPECT_FALSE(view.open(path));
+
+    ASSERT_TRUE(saveQuadtree(quadtree, path));
+    EXPECT_TRUE(view.open(path));
+    EXPECT_EQ(view.size(), elements.size());
+    view.close();
+    std::filesystem::remove(path);
+}
+
+}
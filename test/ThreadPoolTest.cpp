@@ -0,0 +1,58 @@
+﻿#include <light/ThreadPool.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace light::test
+{
+
+TEST(ThreadPoolTests, RunsTaskOnEveryThread)
+{
+    ThreadPool pool{ 4 };
+    EXPECT_EQ(pool.size(), 4);
+
+    // pool is reused between runs
+    for (int run = 0; run < 100; ++run)
+    {
+        std::vector<int> calls(pool.size(), 0);
+        pool.run([&calls](size_t threadIndex) { ++calls[threadIndex]; });
+        EXPECT_EQ(calls, std::vector<int>(pool.size(), 1));
+    }
+}
+
+TEST(ThreadPoolTests, SingleThread)
+{
+    ThreadPool pool{ 1 };
+    EXPECT_EQ(pool.size(), 1);
+
+    size_t calledIndex = 1;
+    pool.run([&calledIndex](size_t threadIndex) { calledIndex = threadIndex; });
+    EXPECT_EQ(calledIndex, 0);
+}
+
+TEST(ThreadPoolTests, RethrowsException)
+{
+    ThreadPool pool{ 3 };
+    std::atomic<int> calls{ 0 };
+    EXPECT_THROW(pool.run(
+                   [&calls](size_t threadIndex)
+                   {
+                       ++calls;
+                       if (threadIndex == 2)
+                       {
+                           throw std::runtime_error("task failed");
+                       }
+                   }),
+                 std::runtime_error);
+    EXPECT_EQ(calls, 3);
+
+    // pool stays usable
+    calls = 0;
+    pool.run([&calls](size_t) { ++calls; });
+    EXPECT_EQ(calls, 3);
+}
+
+}